@@ -2,54 +2,203 @@
 // Created by jorge on 16/08/24.
 //
 
-#include <array>
+#include <algorithm>
 #include <cstddef>
 #include <filesystem>
 #include <fstream>
-#include <iostream>
+#include <memory>
+#include <new>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <variant>
+#include <vector>
 
 #include "hash.h"
 
+#include <boost/core/span.hpp>
+#include <boost/interprocess/exceptions.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include <hash-library/md5.h>
 #include <hash-library/sha256.h>
 #include <opencv2/core/mat.hpp>
-#include <opencv2/img_hash/average_hash.hpp>
-#include <opencv2/img_hash/phash.hpp>
 #include <spdlog/spdlog.h>
+#include <tbb/parallel_for.h>
+#include <xxhash.h>
+
+#include "album/perceptual_hash.h"
+#include "helper/cv_mat_operations.h"
 
 namespace album_architect::hash {
 
-/// Size of the buffer for image loading
-constexpr static auto image_load_buffer_size = std::size_t {4096U};
+namespace bip = boost::interprocess;
+
+/// Size of the buffer for reading files that can't be mapped
+constexpr static auto file_read_buffer_size = std::size_t {1U} << 20U;
+
+/// Alignment of the read buffer, a page, so reads are done in whole pages
+constexpr static auto file_read_buffer_alignment = std::size_t {4096U};
+
+/// Size of the chunks given to each digest in turn when calculating several
+/// of them, small enough to still be in the cache for the next digest
+constexpr static auto digest_chunk_size = std::size_t {64U} << 10U;
+
+namespace {
+/// Frees a buffer allocated with the alignment for reading files
+struct AlignedBufferDelete {
+  void operator()(char* data) const {
+    ::operator delete[](data, std::align_val_t {file_read_buffer_alignment});
+  }
+};
+
+/// Streaming XXH3 with 128 bits, with the same interface as the digests of
+/// hash-library
+class XXH3Hash {
+public:
+  XXH3Hash()
+      : m_state(XXH3_createState()) {
+    XXH3_128bits_reset(m_state.get());
+  }
+
+  /// Adds data to the digest
+  /// @param data
+  /// @param size
+  void add(const void* data, std::size_t size) {
+    XXH3_128bits_update(m_state.get(), data, size);
+  }
+
+  /// Returns the digest of the data added so far, as hexadecimal in the
+  /// canonical big endian order
+  /// @return
+  auto getHash() const -> std::string {
+    constexpr auto digits = std::string_view {"0123456789abcdef"};
+    auto canonical = XXH128_canonical_t {};
+    XXH128_canonicalFromHash(&canonical, XXH3_128bits_digest(m_state.get()));
+
+    auto ret = std::string {};
+    ret.reserve(sizeof(canonical.digest) * 2);
+    for (const auto byte : canonical.digest) {
+      ret.push_back(digits[byte >> 4U]);
+      ret.push_back(digits[byte & 0xFU]);
+    }
+    return ret;
+  }
+
+private:
+  /// Frees the state of the digest
+  struct StateDelete {
+    void operator()(XXH3_state_t* state) const { XXH3_freeState(state); }
+  };
+
+  std::unique_ptr<XXH3_state_t, StateDelete> m_state;
+};
+
+/// Any of the supported digests
+using Digest = std::variant<MD5, SHA256, XXH3Hash>;
+
+/// Creates the digest for the given algorithm
+/// @param algorithm
+/// @return
+auto make_digest(DigestAlgorithm algorithm) -> Digest {
+  switch (algorithm) {
+    case DigestAlgorithm::md5:
+      return Digest {std::in_place_type<MD5>};
+    case DigestAlgorithm::sha256:
+      return Digest {std::in_place_type<SHA256>};
+    case DigestAlgorithm::xxh3_128:
+    default:
+      return Digest {std::in_place_type<XXH3Hash>};
+  }
+}
+
+/// Passes the contents of the file to the consumer. The file is mapped and
+/// hinted as read sequentially, so the kernel reads ahead in large blocks
+/// while the data is consumed. Files that can't be mapped are read with a
+/// large aligned buffer instead.
+/// @tparam Consumer Called with each block of data and its size
+/// @param path
+/// @param consume
+/// @return False if the file couldn't be read
+template<class Consumer>
+auto read_file(const std::filesystem::path& path, Consumer&& consume) -> bool {
+  auto error = std::error_code {};
+  const auto size = std::filesystem::file_size(path, error);
+  if (error) {
+    spdlog::error("Couldn't read file in {}. Error: {}",
+                  path.string(),
+                  error.message());
+    return false;
+  }
+
+  // Empty files can't be mapped, and have nothing to read
+  if (size == 0) {
+    return true;
+  }
+
+  try {
+    const auto file = bip::file_mapping(path.c_str(), bip::read_only);
+    auto region = bip::mapped_region(file, bip::read_only);
+    region.advise(bip::mapped_region::advice_sequential);
+    consume(static_cast<const char*>(region.get_address()), region.get_size());
+    return true;
+  } catch (const bip::interprocess_exception& e) {
+    spdlog::debug("Couldn't map file in {}, reading it instead. Error: {}",
+                  path.string(),
+                  e.what());
+  }
+
+  auto file = std::ifstream(path, std::ios::binary);
+  if (!file) {
+    spdlog::error("Couldn't read file in {}", path.string());
+    return false;
+  }
+
+  const auto buffer = std::unique_ptr<char[], AlignedBufferDelete>(
+      static_cast<char*>(::operator new[](
+          file_read_buffer_size,
+          std::align_val_t {file_read_buffer_alignment})));
+  while (file) {
+    file.read(buffer.get(), file_read_buffer_size);
+    consume(buffer.get(), static_cast<std::size_t>(file.gcount()));
+  }
+  return file.eof();
+}
 
 /// General function for calculating a hash
 /// @tparam T
 /// @param path
 /// @return
-namespace {
 template<class T>
 auto calculate_hash(const std::filesystem::path& path)
     -> std::optional<std::string> {
-  // Load image
-  auto image_file = std::ifstream(path, std::ios::binary);
-  if (!image_file) {
-    spdlog::error("Couldn't load image file in {}", path.string());
-    return {};
-  }
-
-  // Read data from image file into hasher
-  auto buffer = std::array<std::ifstream::char_type, image_load_buffer_size> {};
   auto hash = T {};
-  while (image_file) {
-    image_file.read(buffer.data(), image_load_buffer_size);
-    const auto n_read = image_file.gcount();
-    hash.add(buffer.data(), static_cast<std::size_t>(n_read));
+  const auto is_read = read_file(path,
+                                 [&hash](const char* data, std::size_t size)
+                                 { hash.add(data, size); });
+  if (!is_read) {
+    return {};
   }
-
   return hash.getHash();
 }
+
+/// Calculates the hashes of several files in parallel, so reading some files
+/// overlaps with hashing others
+/// @tparam T
+/// @param paths
+/// @return
+template<class T>
+auto calculate_hashes(boost::span<const std::filesystem::path> paths)
+    -> std::vector<std::optional<std::string>> {
+  auto ret = std::vector<std::optional<std::string>>(paths.size());
+  tbb::parallel_for(std::size_t {0},
+                    paths.size(),
+                    [&paths, &ret](std::size_t index)
+                    { ret[index] = calculate_hash<T>(paths[index]); });
+  return ret;
+}
 }  // namespace
 
 auto Hash::calculate_md5(const std::filesystem::path& path)
@@ -60,18 +209,87 @@ auto Hash::calculate_sha256(const std::filesystem::path& path)
     -> std::optional<std::string> {
   return calculate_hash<SHA256>(path);
 }
-auto Hash::calculate_average_hash(const cv::Mat& input) -> cv::Mat {
-  const auto hasher = cv::img_hash::AverageHash::create();
+auto Hash::calculate_xxh3_128(const std::filesystem::path& path)
+    -> std::optional<std::string> {
+  return calculate_hash<XXH3Hash>(path);
+}
+auto Hash::calculate_partial_xxh3_128(const std::filesystem::path& path,
+                                      std::size_t block_size)
+    -> std::optional<std::string> {
+  auto error = std::error_code {};
+  const auto size = std::filesystem::file_size(path, error);
+  if (error || size <= 2 * block_size) {
+    return calculate_xxh3_128(path);
+  }
 
-  auto output = cv::Mat {};
-  hasher->compute(input, output);
-  return output;
+  auto file = std::ifstream(path, std::ios::binary);
+  auto buffer = std::string(block_size, '\0');
+  auto hash = XXH3Hash {};
+  file.read(buffer.data(), static_cast<std::streamsize>(block_size));
+  hash.add(buffer.data(), block_size);
+  file.seekg(static_cast<std::streamoff>(size - block_size));
+  file.read(buffer.data(), static_cast<std::streamsize>(block_size));
+  hash.add(buffer.data(), block_size);
+  if (!file) {
+    spdlog::error("Couldn't read file in {}", path.string());
+    return {};
+  }
+  return hash.getHash();
 }
-auto Hash::calculate_p_hash(const cv::Mat& input) -> cv::Mat {
-  const auto hasher = cv::img_hash::PHash::create();
+auto Hash::calculate_digests(const std::filesystem::path& path,
+                             boost::span<const DigestAlgorithm> algorithms)
+    -> std::optional<std::vector<std::string>> {
+  auto digests = std::vector<Digest> {};
+  digests.reserve(algorithms.size());
+  for (const auto algorithm : algorithms) {
+    digests.push_back(make_digest(algorithm));
+  }
 
-  auto output = cv::Mat {};
-  hasher->compute(input, output);
-  return output;
+  const auto is_read = read_file(
+      path,
+      [&digests](const char* data, std::size_t size)
+      {
+        for (auto offset = std::size_t {0}; offset < size;
+             offset += digest_chunk_size)
+        {
+          const auto chunk_size = std::min(digest_chunk_size, size - offset);
+          for (auto& digest : digests) {
+            std::visit([&](auto& hash) { hash.add(data + offset, chunk_size); },
+                       digest);
+          }
+        }
+      });
+  if (!is_read) {
+    return {};
+  }
+
+  auto ret = std::vector<std::string> {};
+  ret.reserve(digests.size());
+  for (auto& digest : digests) {
+    ret.push_back(
+        std::visit([](auto& hash) { return hash.getHash(); }, digest));
+  }
+  return ret;
+}
+auto Hash::calculate_md5(boost::span<const std::filesystem::path> paths)
+    -> std::vector<std::optional<std::string>> {
+  return calculate_hashes<MD5>(paths);
+}
+auto Hash::calculate_sha256(boost::span<const std::filesystem::path> paths)
+    -> std::vector<std::optional<std::string>> {
+  return calculate_hashes<SHA256>(paths);
+}
+auto Hash::calculate_xxh3_128(boost::span<const std::filesystem::path> paths)
+    -> std::vector<std::optional<std::string>> {
+  return calculate_hashes<XXH3Hash>(paths);
+}
+auto Hash::calculate_average_hash(const cv::Mat& input) -> cv::Mat {
+  return cvmat::uint64_to_mat(PerceptualHash::average_hash(input));
+}
+auto Hash::calculate_p_hash(const cv::Mat& input) -> cv::Mat {
+  return cvmat::uint64_to_mat(PerceptualHash::p_hash(input));
+}
+auto Hash::calculate_d_hash(const cv::Mat& input) -> cv::Mat {
+  return cvmat::uint64_to_mat(PerceptualHash::d_hash(input));
 }
 }  // namespace album_architect::hash
\ No newline at end of file
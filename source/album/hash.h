@@ -1,14 +1,25 @@
 #ifndef HASH_H
 #define HASH_H
 
+#include <cstddef>
 #include <cstdint>
 #include <filesystem>
 #include <optional>
 #include <string>
+#include <vector>
+
+#include <boost/core/span.hpp>
 #include <opencv2/core/mat.hpp>
 
 namespace album_architect::hash {
 
+/// Digests of the contents of a file
+enum class DigestAlgorithm : std::uint8_t {
+  md5,
+  sha256,
+  xxh3_128
+};
+
 /// Supports the creation of several hashes out of files or data
 class Hash {
 public:
@@ -24,15 +35,70 @@ public:
   static auto calculate_sha256(const std::filesystem::path& path)
       -> std::optional<std::string>;
 
-  /// Calculates the average hash of the given input
+  /// Calculates the hash of a given file using XXH3 with 128 bits. It isn't
+  /// cryptographic, but it is much faster than the other digests, so it is
+  /// the one to use for finding files with the same contents.
+  /// @param path
+  /// @return
+  static auto calculate_xxh3_128(const std::filesystem::path& path)
+      -> std::optional<std::string>;
+
+  /// Calculates the XXH3 with 128 bits of the first and last block of a file,
+  /// to rule out files with the same size without reading them whole. Files
+  /// that aren't larger than both blocks are hashed whole, so their digest is
+  /// the same as the one of calculate_xxh3_128.
+  /// @param path
+  /// @param block_size
+  /// @return
+  static auto calculate_partial_xxh3_128(const std::filesystem::path& path,
+                                         std::size_t block_size)
+      -> std::optional<std::string>;
+
+  /// Calculates several digests of a given file, reading it only once
+  /// @param path
+  /// @param algorithms
+  /// @return The digests in the same order as the algorithms, or None if the
+  /// file couldn't be read
+  static auto calculate_digests(const std::filesystem::path& path,
+                                boost::span<const DigestAlgorithm> algorithms)
+      -> std::optional<std::vector<std::string>>;
+
+  /// Calculates the MD5 of several files. Files are hashed in parallel, so
+  /// reading some of them overlaps with hashing others.
+  /// @param paths
+  /// @return The hash of each file, or None if it couldn't be read
+  static auto calculate_md5(boost::span<const std::filesystem::path> paths)
+      -> std::vector<std::optional<std::string>>;
+
+  /// Calculates the SHA256 of several files, in parallel
+  /// @param paths
+  /// @return The hash of each file, or None if it couldn't be read
+  static auto calculate_sha256(boost::span<const std::filesystem::path> paths)
+      -> std::vector<std::optional<std::string>>;
+
+  /// Calculates the XXH3 with 128 bits of several files, in parallel
+  /// @param paths
+  /// @return The hash of each file, or None if it couldn't be read
+  static auto calculate_xxh3_128(
+      boost::span<const std::filesystem::path> paths)
+      -> std::vector<std::optional<std::string>>;
+
+  /// Calculates the average hash of the given input, as a matrix of 8 bytes
+  /// like cv::img_hash returns
   /// @param input
   /// @return
   static auto calculate_average_hash(const cv::Mat& input) -> cv::Mat;
 
-  /// Calculates the pHash of the given input
+  /// Calculates the pHash of the given input, as a matrix of 8 bytes
   /// @param input
   /// @return
   static auto calculate_p_hash(const cv::Mat& input) -> cv::Mat;
+
+  /// Calculates the difference hash of the given input, as a matrix of 8
+  /// bytes
+  /// @param input
+  /// @return
+  static auto calculate_d_hash(const cv::Mat& input) -> cv::Mat;
 };
 
 }  // namespace album_architect::hash
@@ -3,13 +3,17 @@
 //
 
 #include <algorithm>
+#include <array>
+#include <cstddef>
 #include <cstdint>
 #include <filesystem>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "image.h"
 
@@ -17,6 +21,8 @@
 #include <OpenImageIO/imagebuf.h>
 #include <OpenImageIO/imagebufalgo_opencv.h>
 #include <OpenImageIO/imageio.h>
+#include <boost/core/span.hpp>
+#include <magic_enum/magic_enum.hpp>
 #include <spdlog/spdlog.h>
 
 #include "album/hash.h"
@@ -33,6 +39,12 @@ public:
 
   std::map<std::string, std::string> metadata;
 
+  /// Hashes of the file, calculated the first time they are requested
+  std::mutex hashes_mutex;
+  std::array<std::optional<std::string>,
+             magic_enum::enum_count<HashAlgorithm>()>
+      hashes;
+
   // NOLINTBEGIN(*-easily-swappable-parameters)
   ImageImpl(std::filesystem::path path,
             OIIO::ImageBuf image,
@@ -100,14 +112,59 @@ auto Image::get_metadata() const -> const std::map<std::string, std::string>& {
 }
 auto Image::get_hash(const HashAlgorithm algorithm) const
     -> std::optional<std::string> {
+  auto guard = std::scoped_lock(m_impl->hashes_mutex);
+  auto& hash = m_impl->hashes.at(static_cast<std::size_t>(algorithm));
+  if (hash) {
+    return hash;
+  }
+
   switch (algorithm) {
     case HashAlgorithm::md5:
-      return hash::Hash::calculate_md5(m_impl->path);
+      hash = hash::Hash::calculate_md5(m_impl->path);
+      break;
     case HashAlgorithm::sha256:
-      return hash::Hash::calculate_sha256(m_impl->path);
+      hash = hash::Hash::calculate_sha256(m_impl->path);
+      break;
+    case HashAlgorithm::xxh3_128:
+      hash = hash::Hash::calculate_xxh3_128(m_impl->path);
+      break;
     default:
-      return {};
+      break;
+  }
+  return hash;
+}
+auto Image::get_hashes(boost::span<const HashAlgorithm> algorithms) const
+    -> std::vector<std::optional<std::string>> {
+  auto guard = std::scoped_lock(m_impl->hashes_mutex);
+  auto missing_algorithms = std::vector<HashAlgorithm> {};
+  for (const auto algorithm : algorithms) {
+    const auto& hash = m_impl->hashes.at(static_cast<std::size_t>(algorithm));
+    if (!hash) {
+      missing_algorithms.push_back(algorithm);
+    }
+  }
+
+  if (!missing_algorithms.empty()) {
+    const auto digests =
+        hash::Hash::calculate_digests(m_impl->path, missing_algorithms);
+    if (digests) {
+      auto digest = digests->begin();
+      for (const auto algorithm : algorithms) {
+        auto& hash = m_impl->hashes.at(static_cast<std::size_t>(algorithm));
+        if (!hash) {
+          hash = *digest;
+          ++digest;
+        }
+      }
+    }
+  }
+
+  auto ret = std::vector<std::optional<std::string>> {};
+  ret.reserve(algorithms.size());
+  for (const auto algorithm : algorithms) {
+    ret.push_back(m_impl->hashes.at(static_cast<std::size_t>(algorithm)));
   }
+  return ret;
 }
 auto Image::get_image_hash(ImageHashAlgorithm algorithm) const -> cv::Mat {
   auto mat = cv::Mat {};
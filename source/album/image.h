@@ -9,16 +9,18 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <vector>
 
+#include <boost/core/span.hpp>
 #include <opencv2/core/mat.hpp>
 
+#include "album/hash.h"
+
 namespace album_architect::album {
 
-/// Represents the different hashing algorithms currently supported
-enum class HashAlgorithm : std::uint8_t {
-  md5,
-  sha256
-};
+/// Represents the different hashing algorithms currently supported, which are
+/// the digests of the hash module
+using HashAlgorithm = hash::DigestAlgorithm;
 
 /// Represents the different hashing algorithms for image
 enum class ImageHashAlgorithm : std::uint8_t {
@@ -80,6 +82,13 @@ public:
   /// @return
   auto get_hash(HashAlgorithm algorithm) const -> std::optional<std::string>;
 
+  /// Returns several hashes of the image. The ones that weren't requested
+  /// before are calculated together, reading the file only once.
+  /// @param algorithms
+  /// @return The hashes in the same order as the algorithms
+  auto get_hashes(boost::span<const HashAlgorithm> algorithms) const
+      -> std::vector<std::optional<std::string>>;
+
   /// Returns the given algorithms as a CV2 mat
   /// @param algorithm
   /// @return
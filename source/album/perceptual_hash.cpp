@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+
+#include "perceptual_hash.h"
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/mat.hpp>
+#include <opencv2/imgproc.hpp>
+
+namespace album_architect::hash {
+
+/// Number of bits of every hash
+constexpr static auto hash_bits = std::size_t {64};
+
+/// Side of the image scaled for the average hash
+constexpr static auto average_hash_side = std::size_t {8};
+
+/// Side of the image scaled for the pHash, and of its DCT
+constexpr static auto p_hash_side = std::size_t {32};
+
+/// Side of the lowest frequencies of the DCT that make the pHash
+constexpr static auto p_hash_frequencies = std::size_t {8};
+
+/// Size of the image scaled for the dHash, with one more column than bits
+constexpr static auto d_hash_width = std::size_t {9};
+constexpr static auto d_hash_height = std::size_t {8};
+
+/// Weights of blue, green and red in the gray conversion, with the same
+/// fixed point of 15 bits that cv::cvtColor uses for 8-bit images
+constexpr static auto gray_shift = 15U;
+constexpr static auto gray_blue = 3735U;
+constexpr static auto gray_green = 19235U;
+constexpr static auto gray_red = 9798U;
+
+struct PerceptualHash::HelperFunctions {
+  /// Gray pixels of an image of the given size, row by row
+  template<std::size_t Width, std::size_t Height>
+  using Gray = std::array<std::uint8_t, Width * Height>;
+
+  /// Bits of a hash, one per byte, before packing them
+  using Bits = std::array<std::uint8_t, hash_bits>;
+
+  /// Converts pixels with the given number of channels to gray
+  /// @tparam Channels
+  /// @tparam Size
+  /// @param pixels
+  /// @param output
+  template<int Channels, std::size_t Size>
+  static void to_gray(const std::uint8_t* pixels,
+                      std::array<std::uint8_t, Size>& output) {
+    constexpr auto rounding = 1U << (gray_shift - 1U);
+    for (auto index = std::size_t {0}; index < Size; ++index) {
+      const auto* pixel = pixels + (index * Channels);
+      output[index] = static_cast<std::uint8_t>(
+          (pixel[0] * gray_blue + pixel[1] * gray_green + pixel[2] * gray_red
+           + rounding)
+          >> gray_shift);
+    }
+  }
+
+  /// Scales the image to the given size, with the same bit-exact
+  /// interpolation as cv::img_hash, and converts it to gray. The scaled
+  /// image is kept on the stack.
+  /// @tparam Width
+  /// @tparam Height
+  /// @param input
+  /// @return
+  template<std::size_t Width, std::size_t Height>
+  static auto scale_to_gray(const cv::Mat& input) -> Gray<Width, Height> {
+    CV_Assert(input.type() == CV_8UC1 || input.type() == CV_8UC3
+              || input.type() == CV_8UC4);
+
+    constexpr auto max_channels = 4;
+    constexpr auto max_size = Width * Height * max_channels;
+    auto scaled_pixels = std::array<std::uint8_t, max_size> {};
+    const auto size = cv::Size(static_cast<int>(Width),
+                               static_cast<int>(Height));
+    auto scaled = cv::Mat(size, input.type(), scaled_pixels.data());
+    cv::resize(input, scaled, size, 0, 0, cv::INTER_LINEAR_EXACT);
+
+    auto ret = Gray<Width, Height> {};
+    switch (input.channels()) {
+      case 1:
+        std::copy_n(scaled_pixels.begin(), ret.size(), ret.begin());
+        break;
+      case 3:
+        to_gray<3>(scaled_pixels.data(), ret);
+        break;
+      default:
+        to_gray<max_channels>(scaled_pixels.data(), ret);
+        break;
+    }
+    return ret;
+  }
+
+  /// Packs the bits the way cv::img_hash does, a byte for each row of 8
+  /// bits with the first one as the lowest bit, and the first row as the
+  /// highest byte of the result
+  /// @param bits
+  /// @return
+  static auto pack(const Bits& bits) -> std::uint64_t {
+    constexpr auto bits_per_byte = 8U;
+    auto ret = std::uint64_t {0};
+    for (auto byte = 0U; byte < hash_bits / bits_per_byte; ++byte) {
+      auto value = std::uint64_t {0};
+      for (auto bit = 0U; bit < bits_per_byte; ++bit) {
+        value |= std::uint64_t {bits[(byte * bits_per_byte) + bit]} << bit;
+      }
+      ret |= value << (bits_per_byte * (7U - byte));
+    }
+    return ret;
+  }
+};
+
+auto PerceptualHash::average_hash(const cv::Mat& input) -> std::uint64_t {
+  const auto gray =
+      HelperFunctions::scale_to_gray<average_hash_side, average_hash_side>(
+          input);
+
+  // The mean is rounded to even, as cvRound does
+  const auto sum = std::accumulate(gray.begin(), gray.end(), 0U);
+  const auto mean = static_cast<unsigned>(
+      std::lrint(static_cast<double>(sum) / static_cast<double>(gray.size())));
+
+  auto bits = HelperFunctions::Bits {};
+  for (auto index = std::size_t {0}; index < bits.size(); ++index) {
+    bits[index] = static_cast<std::uint8_t>(gray[index] > mean);
+  }
+  return HelperFunctions::pack(bits);
+}
+auto PerceptualHash::p_hash(const cv::Mat& input) -> std::uint64_t {
+  const auto gray =
+      HelperFunctions::scale_to_gray<p_hash_side, p_hash_side>(input);
+
+  // The whole DCT is calculated with cv::dct in float, as cv::img_hash does.
+  // On flat images every coefficient is close to 0 and its sign only
+  // depends on the rounding, which any other DCT would do differently.
+  auto values = std::array<float, p_hash_side * p_hash_side> {};
+  std::copy(gray.begin(), gray.end(), values.begin());
+  constexpr auto side = static_cast<int>(p_hash_side);
+  auto values_mat = cv::Mat(side, side, CV_32F, values.data());
+  cv::dct(values_mat, values_mat);
+
+  auto coefficients = std::array<float, hash_bits> {};
+  for (auto row = std::size_t {0}; row < p_hash_frequencies; ++row) {
+    for (auto column = std::size_t {0}; column < p_hash_frequencies; ++column)
+    {
+      coefficients[(row * p_hash_frequencies) + column] =
+          values[(row * p_hash_side) + column];
+    }
+  }
+  coefficients[0] = 0.0F;
+
+  const auto mean = static_cast<float>(
+      std::accumulate(coefficients.begin(), coefficients.end(), 0.0)
+      / static_cast<double>(coefficients.size()));
+  auto bits = HelperFunctions::Bits {};
+  for (auto index = std::size_t {0}; index < bits.size(); ++index) {
+    bits[index] = static_cast<std::uint8_t>(coefficients[index] > mean);
+  }
+  return HelperFunctions::pack(bits);
+}
+auto PerceptualHash::d_hash(const cv::Mat& input) -> std::uint64_t {
+  const auto gray =
+      HelperFunctions::scale_to_gray<d_hash_width, d_hash_height>(input);
+
+  auto bits = HelperFunctions::Bits {};
+  for (auto row = std::size_t {0}; row < d_hash_height; ++row) {
+    const auto* pixels = gray.data() + (row * d_hash_width);
+    for (auto column = std::size_t {0}; column < d_hash_width - 1; ++column) {
+      bits[(row * (d_hash_width - 1)) + column] =
+          static_cast<std::uint8_t>(pixels[column + 1] > pixels[column]);
+    }
+  }
+  return HelperFunctions::pack(bits);
+}
+
+}  // namespace album_architect::hash
@@ -0,0 +1,44 @@
+#ifndef ALBUMARCHITECT_PERCEPTUAL_HASH_H
+#define ALBUMARCHITECT_PERCEPTUAL_HASH_H
+
+#include <cstdint>
+
+#include <opencv2/core/mat.hpp>
+
+namespace album_architect::hash {
+
+/// Perceptual hashes of images, calculated on a small gray copy of the image
+/// without the objects of cv::img_hash. The average hash and the pHash give
+/// the same bits as cv::img_hash, so stored hashes stay valid. Hashes are
+/// returned as 64-bit words, in the byte order of cvmat::mat_to_uint64.
+///
+/// Images must be 8-bit with 1, 3 (BGR) or 4 (BGRA) channels, otherwise a
+/// cv::Exception is thrown, as cv::img_hash does.
+class PerceptualHash {
+public:
+  /// Calculates the average hash, where each bit tells if a pixel of the
+  /// image scaled to 8x8 is brighter than their mean
+  /// @param input
+  /// @return
+  static auto average_hash(const cv::Mat& input) -> std::uint64_t;
+
+  /// Calculates the pHash, where each bit tells if one of the 8x8 lowest
+  /// frequencies of the DCT of the image scaled to 32x32 is above their mean
+  /// @param input
+  /// @return
+  static auto p_hash(const cv::Mat& input) -> std::uint64_t;
+
+  /// Calculates the difference hash, where each bit tells if a pixel of the
+  /// image scaled to 9x8 is brighter than the one on its left
+  /// @param input
+  /// @return
+  static auto d_hash(const cv::Mat& input) -> std::uint64_t;
+
+private:
+  /// Contains internal helper functions
+  struct HelperFunctions;
+};
+
+}  // namespace album_architect::hash
+
+#endif  // ALBUMARCHITECT_PERCEPTUAL_HASH_H
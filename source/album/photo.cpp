@@ -2,8 +2,12 @@
 // Created by jorelmb on 18/09/24.
 //
 
+#include <algorithm>
+#include <cstddef>
 #include <optional>
+#include <string>
 #include <utility>
+#include <vector>
 
 #include "album/photo.h"
 
@@ -12,8 +16,10 @@
 #include <opencv2/core/mat.hpp>
 #include <spdlog/spdlog.h>
 
+#include "album/hash.h"
 #include "album/image.h"
 #include "album/photo_metadata.h"
+#include "files/helper.h"
 #include "files/tree.h"
 
 namespace album_architect::album {
@@ -51,16 +57,20 @@ auto Photo::load_image() -> bool {
     return false;
   }
 
-  PhotoMetadata::set_photo_state(m_file_element, PhotoState::ok);
+  // The ok state is stored by the callers, together with what they store
   m_image = std::move(loaded_image);
 
   return true;
 }
 auto Photo::get_image() -> std::optional<cv::Mat> {
   // Check if image is loaded
+  const auto was_loaded = m_image.has_value();
   if (!load_image() || !m_image) {
     return {};
   }
+  if (!was_loaded) {
+    PhotoMetadata::set_photo_state(m_file_element, PhotoState::ok);
+  }
 
   // Get the image data
   auto out = cv::Mat {};
@@ -88,7 +98,8 @@ auto Photo::get_image_hash(ImageHashAlgorithm algorithm)
   // Calculate hash and store
   try {
     auto image_hash = m_image->get_image_hash(algorithm);
-    PhotoMetadata::store_hash(m_file_element, algorithm, image_hash);
+    PhotoMetadata::store_hashes(
+        m_file_element, {&algorithm, 1}, {&image_hash, 1}, PhotoState::ok);
     return image_hash;
   } catch (cv::Exception& e) {
     spdlog::error("Failed to generate hash ({}) for photo: {}. Error: {}",
@@ -99,6 +110,88 @@ auto Photo::get_image_hash(ImageHashAlgorithm algorithm)
     return {};
   }
 }
+auto Photo::get_image_hashes(boost::span<const ImageHashAlgorithm> algorithms)
+    -> std::vector<std::optional<cv::Mat>> {
+  auto ret = PhotoMetadata::get_stored_hashes(m_file_element, algorithms);
+  if (std::ranges::all_of(ret,
+                          [](const auto& hash) { return hash.has_value(); }))
+  {
+    return ret;
+  }
+
+  // Check if image is loaded
+  if (!load_image() || !m_image) {
+    return ret;
+  }
+
+  // Calculate the missing hashes and store them together
+  auto missing_algorithms = std::vector<ImageHashAlgorithm> {};
+  auto missing_hashes = std::vector<cv::Mat> {};
+  for (auto index = std::size_t {0}; index < algorithms.size(); ++index) {
+    if (ret[index]) {
+      continue;
+    }
+
+    try {
+      ret[index] = m_image->get_image_hash(algorithms[index]);
+    } catch (cv::Exception& e) {
+      spdlog::error("Failed to generate hash ({}) for photo: {}. Error: {}",
+                    magic_enum::enum_name(algorithms[index]),
+                    m_file_element.get_path().string(),
+                    e.what());
+      PhotoMetadata::set_photo_state(m_file_element, PhotoState::error);
+      return std::vector<std::optional<cv::Mat>>(algorithms.size());
+    }
+    missing_algorithms.push_back(algorithms[index]);
+    missing_hashes.push_back(*ret[index]);
+  }
+
+  PhotoMetadata::store_hashes(
+      m_file_element, missing_algorithms, missing_hashes, PhotoState::ok);
+  return ret;
+}
+auto Photo::get_hash(HashAlgorithm algorithm) -> std::optional<std::string> {
+  return get_hashes({&algorithm, 1}).front();
+}
+auto Photo::get_hashes(boost::span<const HashAlgorithm> algorithms)
+    -> std::vector<std::optional<std::string>> {
+  // A stat is enough to know if the stored digests are still valid
+  const auto& path = m_file_element.get_path();
+  const auto fingerprint = files::get_file_fingerprint(path);
+  if (!fingerprint) {
+    spdlog::error("Couldn't read file in {}", path.string());
+    return std::vector<std::optional<std::string>>(algorithms.size());
+  }
+
+  auto ret = PhotoMetadata::get_stored_digests(
+      m_file_element, algorithms, *fingerprint);
+  auto missing_algorithms = std::vector<HashAlgorithm> {};
+  for (auto index = std::size_t {0}; index < algorithms.size(); ++index) {
+    if (!ret[index]) {
+      missing_algorithms.push_back(algorithms[index]);
+    }
+  }
+  if (missing_algorithms.empty()) {
+    return ret;
+  }
+
+  // Calculate the missing digests with a single read, and store them together
+  const auto digests = hash::Hash::calculate_digests(path, missing_algorithms);
+  if (!digests) {
+    return ret;
+  }
+  PhotoMetadata::store_digests(
+      m_file_element, missing_algorithms, *digests, *fingerprint);
+
+  auto digest = digests->begin();
+  for (auto& hash : ret) {
+    if (!hash) {
+      hash = *digest;
+      ++digest;
+    }
+  }
+  return ret;
+}
 auto Photo::is_image_hash_in_cache(ImageHashAlgorithm algorithm) const -> bool {
   return PhotoMetadata::has_hash_stored(m_file_element, algorithm);
 }
@@ -7,6 +7,9 @@
 
 #include <optional>
 #include <string>
+#include <vector>
+
+#include <boost/core/span.hpp>
 
 #include <opencv2/core/mat.hpp>
 
@@ -36,6 +39,28 @@ public:
   /// \return cv::Mat with hash
   auto get_image_hash(ImageHashAlgorithm algorithm) -> std::optional<cv::Mat>;
 
+  /// Returns the specified image hashes. Stored hashes are read at once, and
+  /// the missing ones are calculated from a single load of the image and
+  /// stored together.
+  /// \param algorithms
+  /// \return cv::Mat with the hash of each algorithm, in order
+  auto get_image_hashes(boost::span<const ImageHashAlgorithm> algorithms)
+      -> std::vector<std::optional<cv::Mat>>;
+
+  /// Returns the digest of the contents of the file. Digests are stored, and
+  /// the stored one is returned while the size and modification time of the
+  /// file don't change, without reading the file.
+  /// \param algorithm
+  /// \return Digest, or None if the file couldn't be read
+  auto get_hash(HashAlgorithm algorithm) -> std::optional<std::string>;
+
+  /// Returns several digests of the contents of the file. The ones that
+  /// aren't stored are calculated with a single read of the file.
+  /// \param algorithms
+  /// \return Digest of each algorithm, in order
+  auto get_hashes(boost::span<const HashAlgorithm> algorithms)
+      -> std::vector<std::optional<std::string>>;
+
   /// Returns True if the given hash is stored in the cache.
   /// \return true if hash in cache.
   auto is_image_hash_in_cache(ImageHashAlgorithm algorithm) const -> bool;
@@ -2,10 +2,14 @@
 // Created by jorelmb on 29/09/24.
 //
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <optional>
 #include <string>
-#include <utility>
-#include <variant>
+#include <vector>
 
 #include "photo_metadata.h"
 
@@ -14,63 +18,129 @@
 #include <opencv2/core/mat.hpp>
 
 #include "album/image.h"
+#include "files/attribute_columns.h"
+#include "files/attribute_map.h"
+#include "files/common.h"
+#include "files/content_digest.h"
 #include "files/tree.h"
+#include "helper/cv_mat_operations.h"
 
 namespace album_architect::album {
-using namespace std::string_literals;
-
-auto PhotoMetadata::get_hash_key(ImageHashAlgorithm algorithm) -> std::string {
-  return fmt::format("_HASH_{}_", magic_enum::enum_name(algorithm));
+auto PhotoMetadata::get_hash_column(ImageHashAlgorithm algorithm)
+    -> files::HashColumn {
+  switch (algorithm) {
+    case ImageHashAlgorithm::average_hash:
+      return files::HashColumn::average_hash;
+    case ImageHashAlgorithm::p_hash:
+      return files::HashColumn::p_hash;
+  }
+  return files::HashColumn::average_hash;
 }
 auto PhotoMetadata::has_hash_stored(const files::Element& file_element,
                                     ImageHashAlgorithm algorithm) -> bool {
-  // TODO: Add a function to only check if exists, so a copy is avoided on
-  // get_metadata
-  const auto hash_value =
-      file_element.get_metadata(PhotoMetadata::get_hash_key(algorithm));
-  return hash_value && std::holds_alternative<cv::Mat>(*hash_value);
+  return get_stored_hash(file_element, algorithm).has_value();
 }
 auto PhotoMetadata::get_stored_hash(const files::Element& file_element,
                                     ImageHashAlgorithm algorithm)
     -> std::optional<cv::Mat> {
-  auto hash_value =
-      file_element.get_metadata(PhotoMetadata::get_hash_key(algorithm));
-  if (!hash_value || !std::holds_alternative<cv::Mat>(*hash_value)) {
-    return {};
+  if (const auto hash = file_element.get_hash(get_hash_column(algorithm))) {
+    return cvmat::uint64_to_mat(*hash);
   }
-
-  return {std::move(std::get<cv::Mat>(*hash_value))};
+  return {};
 }
 void PhotoMetadata::store_hash(files::Element& file_element,
                                ImageHashAlgorithm algorithm,
                                cv::Mat hash) {
-  const auto hash_key = PhotoMetadata::get_hash_key(algorithm);
-  file_element.set_metadata(hash_key, hash);
+  const auto column = get_hash_column(algorithm);
+  const auto value = cvmat::mat_to_uint64(hash);
+  file_element.set_hashes({&column, 1}, {&value, 1}, {});
 }
-auto PhotoMetadata::get_photo_state(const files::Element& file_element)
-    -> PhotoState {
-  const auto state_key = get_photo_state_key();
-  const auto stored_state = file_element.get_metadata(state_key);
-  if (!stored_state || !std::holds_alternative<std::string>(*stored_state)) {
-    return PhotoState::no_info;
-  }
+auto PhotoMetadata::get_stored_hashes(
+    const files::Element& file_element,
+    boost::span<const ImageHashAlgorithm> algorithms)
+    -> std::vector<std::optional<cv::Mat>> {
+  auto columns = std::vector<files::HashColumn> {};
+  columns.reserve(algorithms.size());
+  std::ranges::transform(
+      algorithms, std::back_inserter(columns), &get_hash_column);
 
-  // Try to parse stored state
-  const auto state =
-      magic_enum::enum_cast<PhotoState>(std::get<std::string>(*stored_state));
-  if (!state.has_value()) {
-    return PhotoState::no_info;
+  const auto hashes = file_element.get_hashes(columns);
+  auto ret = std::vector<std::optional<cv::Mat>>(algorithms.size());
+  for (auto index = std::size_t {0}; index < hashes.size(); ++index) {
+    if (hashes[index]) {
+      ret[index] = cvmat::uint64_to_mat(*hashes[index]);
+    }
+  }
+  return ret;
+}
+void PhotoMetadata::store_hashes(
+    files::Element& file_element,
+    boost::span<const ImageHashAlgorithm> algorithms,
+    boost::span<const cv::Mat> hashes,
+    PhotoState state) {
+  auto columns = std::vector<files::HashColumn> {};
+  auto values = std::vector<std::uint64_t> {};
+  columns.reserve(algorithms.size());
+  values.reserve(algorithms.size());
+  for (auto index = std::size_t {0}; index < algorithms.size(); ++index) {
+    columns.push_back(get_hash_column(algorithms[index]));
+    values.push_back(cvmat::mat_to_uint64(hashes[index]));
   }
+  file_element.set_hashes(columns, values, static_cast<std::uint8_t>(state));
+}
+auto PhotoMetadata::get_digest_key(HashAlgorithm algorithm)
+    -> files::AttributeKey {
+  static const auto digest_keys = []
+  {
+    auto ret = std::array<files::AttributeKey,
+                          magic_enum::enum_count<HashAlgorithm>()> {};
+    for (auto index = std::size_t {0}; index < ret.size(); ++index) {
+      ret[index] = files::AttributeKeys::intern(fmt::format(
+          "_DIGEST_{}_",
+          magic_enum::enum_name(static_cast<HashAlgorithm>(index))));
+    }
+    return ret;
+  }();
+  return digest_keys[static_cast<std::size_t>(algorithm)];
+}
+auto PhotoMetadata::get_stored_digests(
+    const files::Element& file_element,
+    boost::span<const HashAlgorithm> algorithms,
+    const files::FileFingerprint& fingerprint)
+    -> std::vector<std::optional<std::string>> {
+  auto keys = std::vector<files::AttributeKey> {};
+  keys.reserve(algorithms.size());
+  std::ranges::transform(
+      algorithms, std::back_inserter(keys), &get_digest_key);
 
-  return state.value();
+  const auto values = file_element.get_metadata(keys);
+  auto ret = std::vector<std::optional<std::string>> {};
+  ret.reserve(values.size());
+  for (const auto& value : values) {
+    ret.push_back(files::ContentDigest::from_attribute(value, fingerprint));
+  }
+  return ret;
+}
+void PhotoMetadata::store_digests(files::Element& file_element,
+                                  boost::span<const HashAlgorithm> algorithms,
+                                  boost::span<const std::string> digests,
+                                  const files::FileFingerprint& fingerprint) {
+  auto entries = std::vector<files::MetadataEntry> {};
+  entries.reserve(algorithms.size());
+  for (auto index = std::size_t {0}; index < algorithms.size(); ++index) {
+    entries.push_back(
+        {get_digest_key(algorithms[index]),
+         files::ContentDigest::to_attribute(fingerprint, digests[index])});
+  }
+  file_element.set_metadata(entries);
+}
+auto PhotoMetadata::get_photo_state(const files::Element& file_element)
+    -> PhotoState {
+  return magic_enum::enum_cast<PhotoState>(file_element.get_state())
+      .value_or(PhotoState::no_info);
 }
 void PhotoMetadata::set_photo_state(files::Element& file_element,
                                     PhotoState state) {
-  const auto state_key = get_photo_state_key();
-  file_element.set_metadata(state_key,
-                            std::string {magic_enum::enum_name(state)});
-}
-auto PhotoMetadata::get_photo_state_key() -> std::string {
-  return "_PHOTO_STATE_"s;
+  file_element.set_state(static_cast<std::uint8_t>(state));
 }
 }  // namespace album_architect::album
\ No newline at end of file
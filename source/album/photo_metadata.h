@@ -7,8 +7,14 @@
 
 #include <optional>
 #include <string>
+#include <vector>
+
+#include <boost/core/span.hpp>
 
 #include <album/image.h>
+#include <files/attribute_columns.h>
+#include <files/attribute_map.h>
+#include <files/common.h>
 #include <files/tree.h>
 #include <opencv2/core/mat.hpp>
 
@@ -22,7 +28,9 @@ enum class PhotoState : std::uint8_t {
 };
 
 /// Helps to manage the metadata of a Photo that is stored in the File
-/// element
+/// element. Hashes and the state are kept in the attribute columns of the
+/// tree. FileGraph moves the values that older versions stored in the
+/// metadata into the columns when a cache is loaded.
 class PhotoMetadata {
 public:
   /// Checks if the given hash is stored in metadata of the Photo
@@ -48,6 +56,53 @@ public:
                          ImageHashAlgorithm algorithm,
                          cv::Mat hash);
 
+  /// Returns the stored hashes of the photo, reading them all at once
+  /// @param file_element
+  /// @param algorithms
+  /// @return Stored hash of each algorithm, in order
+  static auto get_stored_hashes(
+      const files::Element& file_element,
+      boost::span<const ImageHashAlgorithm> algorithms)
+      -> std::vector<std::optional<cv::Mat>>;
+
+  /// Stores the given hashes together with the PhotoState, writing them all
+  /// at once
+  /// @param file_element
+  /// @param algorithms
+  /// @param hashes Hash of each algorithm
+  /// @param state
+  static void store_hashes(files::Element& file_element,
+                           boost::span<const ImageHashAlgorithm> algorithms,
+                           boost::span<const cv::Mat> hashes,
+                           PhotoState state);
+
+  /// Returns the stored digests of the contents of the file. Digests are
+  /// only returned if they were calculated when the file had the same size
+  /// and modification time as in the given fingerprint.
+  /// @param file_element
+  /// @param algorithms
+  /// @param fingerprint Current fingerprint of the file
+  /// @return Stored digest of each algorithm, in order
+  static auto get_stored_digests(const files::Element& file_element,
+                                 boost::span<const HashAlgorithm> algorithms,
+                                 const files::FileFingerprint& fingerprint)
+      -> std::vector<std::optional<std::string>>;
+
+  /// Stores the digests of the contents of the file, writing them all at once
+  /// @param file_element
+  /// @param algorithms
+  /// @param digests Digest of each algorithm
+  /// @param fingerprint Fingerprint of the file when it was read
+  static void store_digests(files::Element& file_element,
+                            boost::span<const HashAlgorithm> algorithms,
+                            boost::span<const std::string> digests,
+                            const files::FileFingerprint& fingerprint);
+
+  /// Returns the key that stores the digest of the given algorithm
+  /// @param algorithm
+  /// @return
+  static auto get_digest_key(HashAlgorithm algorithm) -> files::AttributeKey;
+
   /// Returns the current PhotoState for the file element
   /// @param file_element
   /// @return
@@ -59,14 +114,11 @@ public:
   static void set_photo_state(files::Element& file_element, PhotoState state);
 
 private:
-  /// Returns the hash key for the given hash algorithm
-  /// \param algorithm Algorithm to check
-  /// \return String with the hash value
-  static auto get_hash_key(ImageHashAlgorithm algorithm) -> std::string;
-
-  /// Returns the hash key for the PhotoState metadata
-  /// @return
-  static auto get_photo_state_key() -> std::string;
+  /// Returns the column that stores the hash of the given algorithm
+  /// \param algorithm
+  /// \return
+  static auto get_hash_column(ImageHashAlgorithm algorithm)
+      -> files::HashColumn;
 };
 
 }  // namespace album_architect::album
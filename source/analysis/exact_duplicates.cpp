@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <numeric>
+#include <optional>
+#include <ranges>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "exact_duplicates.h"
+
+#include <boost/core/span.hpp>
+#include <spdlog/spdlog.h>
+#include <tbb/parallel_for.h>
+
+#include "album/hash.h"
+#include "album/image.h"
+#include "album/photo_metadata.h"
+#include "files/attribute_map.h"
+#include "files/common.h"
+#include "files/content_digest.h"
+#include "files/helper.h"
+#include "files/tree.h"
+
+namespace album_architect::analysis {
+
+namespace rng = std::ranges;
+
+struct ExactDuplicates::HelperFunctions {
+  /// Indices of candidates that could have the same contents
+  using Group = std::vector<std::size_t>;
+
+  /// Returns the key of the digest of the first and last blocks of a file
+  /// @return
+  static auto get_edge_digest_key() -> files::AttributeKey {
+    static const auto key =
+        files::AttributeKeys::intern("_EDGE_DIGEST_xxh3_128_");
+    return key;
+  }
+
+  /// Returns the key of the digest of the whole contents of a file, the same
+  /// one that photos use for their digest
+  /// @return
+  static auto get_digest_key() -> files::AttributeKey {
+    return album::PhotoMetadata::get_digest_key(album::HashAlgorithm::xxh3_128);
+  }
+
+  /// Returns the size of the file as recorded when it was scanned. Caches
+  /// from older versions don't have it, so it is read from the disk instead.
+  /// @param element
+  /// @return Size of the file, or None if it can't be known or it is empty
+  static auto get_size(const files::Element& element)
+      -> std::optional<std::uint64_t> {
+    auto size = element.get_fingerprint().size;
+    if (size == 0) {
+      auto error = std::error_code {};
+      size = std::filesystem::file_size(element.get_path(), error);
+      if (error) {
+        return {};
+      }
+    }
+    if (size == 0) {
+      return {};
+    }
+    return size;
+  }
+
+  /// Splits every group by the keys of its candidates. Candidates without a
+  /// key, or left alone with theirs, are dropped.
+  /// @tparam Key
+  /// @param groups
+  /// @param keys Key of each candidate
+  /// @return
+  template<class Key>
+  static auto split_groups(const std::vector<Group>& groups,
+                           const std::vector<std::optional<Key>>& keys)
+      -> std::vector<Group> {
+    auto ret = std::vector<Group> {};
+    for (auto group : groups) {
+      std::erase_if(group, [&keys](std::size_t index) { return !keys[index]; });
+      rng::sort(group,
+                {},
+                [&keys](std::size_t index) -> const Key&
+                { return *keys[index]; });
+
+      for (auto begin = group.begin(); begin != group.end();) {
+        const auto& key = *keys[*begin];
+        const auto end =
+            std::find_if(begin,
+                         group.end(),
+                         [&keys, &key](std::size_t index)
+                         { return *keys[index] != key; });
+        if (end - begin > 1) {
+          ret.emplace_back(begin, end);
+        }
+        begin = end;
+      }
+    }
+    return ret;
+  }
+
+  /// Returns the number of candidates in the groups
+  /// @param groups
+  /// @return
+  static auto count_candidates(const std::vector<Group>& groups)
+      -> std::size_t {
+    return std::accumulate(groups.begin(),
+                           groups.end(),
+                           std::size_t {0},
+                           [](std::size_t count, const Group& group)
+                           { return count + group.size(); });
+  }
+
+  /// Returns the digests of the candidates in the groups. Digests stored in
+  /// the tree are used while their files don't change, and the missing ones
+  /// are calculated in parallel and stored.
+  /// @tparam Calculate Calculates the digest of a candidate from its index
+  /// @param tree
+  /// @param candidates
+  /// @param fingerprints Current fingerprint of each candidate in the groups
+  /// @param groups
+  /// @param key Key of the digest in the metadata
+  /// @param calculate
+  /// @return Digest of each candidate, None for the ones outside of the
+  /// groups or that don't exist anymore
+  template<class Calculate>
+  static auto get_digests(
+      files::FileTree& tree,
+      const std::vector<files::Element>& candidates,
+      const std::vector<std::optional<files::FileFingerprint>>& fingerprints,
+      const std::vector<Group>& groups,
+      files::AttributeKey key,
+      const Calculate& calculate) -> std::vector<std::optional<std::string>> {
+    auto indices = std::vector<std::size_t> {};
+    auto elements = std::vector<files::Element> {};
+    for (const auto& group : groups) {
+      for (const auto index : group) {
+        indices.push_back(index);
+        elements.push_back(candidates[index]);
+      }
+    }
+
+    auto ret = std::vector<std::optional<std::string>>(candidates.size());
+    auto missing = std::vector<std::size_t> {};
+    const auto stored = tree.get_metadata_batch(elements, key);
+    for (auto position = std::size_t {0}; position < stored.size(); ++position)
+    {
+      const auto& fingerprint = fingerprints[indices[position]];
+      if (!fingerprint) {
+        continue;
+      }
+      auto& digest = ret[indices[position]];
+      digest =
+          files::ContentDigest::from_attribute(stored[position], *fingerprint);
+      if (!digest) {
+        missing.push_back(position);
+      }
+    }
+
+    tbb::parallel_for(std::size_t {0},
+                      missing.size(),
+                      [&](std::size_t missing_index)
+                      {
+                        const auto index = indices[missing[missing_index]];
+                        ret[index] = calculate(index);
+                      });
+
+    auto writes = std::vector<files::MetadataWrite> {};
+    for (const auto position : missing) {
+      const auto index = indices[position];
+      if (const auto& digest = ret[index]) {
+        auto attribute =
+            files::ContentDigest::to_attribute(*fingerprints[index], *digest);
+        writes.push_back({&elements[position], key, std::move(attribute)});
+      }
+    }
+    tree.set_metadata_batch(writes);
+    return ret;
+  }
+};
+
+auto ExactDuplicates::find(files::FileTree& tree,
+                           boost::span<const files::Element> elements,
+                           ExactDuplicatesSummary* summary)
+    -> std::vector<std::vector<files::Element>> {
+  auto candidates = std::vector<files::Element> {};
+  for (const auto& element : elements) {
+    if (element.get_type() == files::PathType::file) {
+      candidates.push_back(element);
+    }
+  }
+
+  // Sizes come from the scan, so this doesn't read any file
+  auto sizes = std::vector<std::optional<std::uint64_t>>(candidates.size());
+  tbb::parallel_for(
+      std::size_t {0},
+      candidates.size(),
+      [&candidates, &sizes](std::size_t index)
+      { sizes[index] = HelperFunctions::get_size(candidates[index]); });
+  auto all_candidates = HelperFunctions::Group(candidates.size());
+  std::iota(all_candidates.begin(), all_candidates.end(), std::size_t {0});
+  auto groups = HelperFunctions::split_groups(
+      std::vector<HelperFunctions::Group> {std::move(all_candidates)}, sizes);
+  const auto same_size = HelperFunctions::count_candidates(groups);
+
+  // Stored digests are checked against the current state of the files, which
+  // only takes a stat
+  auto fingerprints =
+      std::vector<std::optional<files::FileFingerprint>>(candidates.size());
+  auto same_size_candidates = HelperFunctions::Group {};
+  for (const auto& group : groups) {
+    same_size_candidates.insert(
+        same_size_candidates.end(), group.begin(), group.end());
+  }
+  tbb::parallel_for(
+      std::size_t {0},
+      same_size_candidates.size(),
+      [&candidates, &fingerprints, &same_size_candidates](std::size_t position)
+      {
+        const auto index = same_size_candidates[position];
+        fingerprints[index] =
+            files::get_file_fingerprint(candidates[index].get_path());
+      });
+
+  // Files with the same size are compared by their first and last blocks
+  auto files_read = std::atomic<std::size_t> {0};
+  const auto edge_digests = HelperFunctions::get_digests(
+      tree,
+      candidates,
+      fingerprints,
+      groups,
+      HelperFunctions::get_edge_digest_key(),
+      [&candidates, &files_read](std::size_t index)
+      {
+        ++files_read;
+        return hash::Hash::calculate_partial_xxh3_128(
+            candidates[index].get_path(), edge_block_size);
+      });
+  groups = HelperFunctions::split_groups(groups, edge_digests);
+  const auto same_edges = HelperFunctions::count_candidates(groups);
+
+  // Only the files that are still together are read whole. The edges of the
+  // small files already covered all their contents, as long as they are
+  // still small: files can grow after the scan.
+  const auto digests = HelperFunctions::get_digests(
+      tree,
+      candidates,
+      fingerprints,
+      groups,
+      HelperFunctions::get_digest_key(),
+      [&candidates, &fingerprints, &edge_digests, &files_read](
+          std::size_t index)
+      {
+        if (fingerprints[index]->size <= 2 * edge_block_size) {
+          return edge_digests[index];
+        }
+        ++files_read;
+        return hash::Hash::calculate_xxh3_128(candidates[index].get_path());
+      });
+  groups = HelperFunctions::split_groups(groups, digests);
+
+  auto ret = std::vector<std::vector<files::Element>> {};
+  ret.reserve(groups.size());
+  for (const auto& group : groups) {
+    auto& duplicates = ret.emplace_back();
+    for (const auto index : group) {
+      duplicates.push_back(candidates[index]);
+    }
+    rng::sort(duplicates, {}, &files::Element::get_path);
+  }
+  rng::sort(ret,
+            {},
+            [](const std::vector<files::Element>& duplicates)
+            { return duplicates.front().get_path(); });
+
+  if (summary != nullptr) {
+    *summary = ExactDuplicatesSummary {.files = candidates.size(),
+                                       .same_size = same_size,
+                                       .same_edges = same_edges,
+                                       .files_read = files_read};
+  }
+  spdlog::debug("Compared {} files, {} had the same size and {} the same edges",
+                candidates.size(),
+                same_size,
+                same_edges);
+  return ret;
+}
+
+}  // namespace album_architect::analysis
@@ -0,0 +1,53 @@
+#ifndef ALBUMARCHITECT_EXACT_DUPLICATES_H
+#define ALBUMARCHITECT_EXACT_DUPLICATES_H
+
+#include <cstddef>
+#include <vector>
+
+#include <boost/core/span.hpp>
+
+#include "files/tree.h"
+
+namespace album_architect::analysis {
+
+/// Work done while finding the exact duplicates
+struct ExactDuplicatesSummary {
+  std::size_t files = 0;  // Files compared
+  std::size_t same_size = 0;  // Files that share their size with another
+  std::size_t same_edges = 0;  // Of those, files that share first and last
+                               // blocks with another
+  std::size_t files_read = 0;  // Files read, partially or whole
+};
+
+/// Finds the files whose contents are the same, byte by byte, reading as
+/// little as possible. Files are grouped by the size recorded when the tree
+/// was scanned, the files that share a size are grouped by a digest of their
+/// first and last blocks, and only the files that are still together have
+/// their whole contents hashed. Works for any type of file, nothing is
+/// decoded. Digests are stored in the metadata of the tree, so files aren't
+/// read again while their size and modification time stay the same.
+class ExactDuplicates {
+public:
+  /// Size of the blocks read from the start and the end of the files
+  static constexpr auto edge_block_size = std::size_t {16} << 10U;
+
+  /// Finds the groups of files with the same contents. Empty files are
+  /// ignored, as well as directories.
+  /// @param tree Tree of the elements, where the digests are stored
+  /// @param elements Elements to compare
+  /// @param summary Set to the work done, if given
+  /// @return Groups of two or more elements with the same contents, each one
+  /// sorted by path
+  static auto find(files::FileTree& tree,
+                   boost::span<const files::Element> elements,
+                   ExactDuplicatesSummary* summary = nullptr)
+      -> std::vector<std::vector<files::Element>>;
+
+private:
+  /// Contains internal helper functions
+  struct HelperFunctions;
+};
+
+}  // namespace album_architect::analysis
+
+#endif  // ALBUMARCHITECT_EXACT_DUPLICATES_H
@@ -3,6 +3,7 @@
 //
 
 #include <algorithm>
+#include <array>
 #include <cstdint>
 #include <iterator>
 #include <limits>
@@ -76,14 +77,13 @@ SimilaritySearchBuilder::SimilaritySearchBuilder()
     : m_similarity_index(std::make_unique<SimilarityIndex>()) {}
 SimilaritySearchBuilder::~SimilaritySearchBuilder() = default;
 auto SimilaritySearchBuilder::add_photo(album::Photo& photo) -> PhotoId {
-  // Add to the indices
-  auto photo_id = m_current_id;
-  ++m_current_id;
-
-  // Add pHash
-  const auto p_hash = photo.get_image_hash(album::ImageHashAlgorithm::p_hash);
-  const auto average_hash =
-      photo.get_image_hash(album::ImageHashAlgorithm::average_hash);
+  // Get both hashes at once
+  constexpr auto algorithms =
+      std::array {album::ImageHashAlgorithm::p_hash,
+                  album::ImageHashAlgorithm::average_hash};
+  const auto hashes = photo.get_image_hashes(algorithms);
+  const auto& p_hash = hashes[0];
+  const auto& average_hash = hashes[1];
 
   // Couldn't calculate hash
   if (!p_hash || !average_hash) {
@@ -92,15 +92,25 @@ auto SimilaritySearchBuilder::add_photo(album::Photo& photo) -> PhotoId {
     return std::numeric_limits<PhotoId>::max();
   }
 
-  {
-    auto guard = std::scoped_lock(m_add_mutex);
-    m_similarity_index->p_hash_index.add_item(photo_id, p_hash->data);
-
-    // Add average hash
-    m_similarity_index->average_index.emplace_back(
-        cvmat::mat_to_uint64(*average_hash), photo_id);
+  return add_hashes(cvmat::mat_to_uint64(*p_hash),
+                    cvmat::mat_to_uint64(*average_hash));
+}
+auto SimilaritySearchBuilder::add_hashes(std::uint64_t p_hash,
+                                         std::uint64_t average_hash)
+    -> PhotoId {
+  // Annoy takes the pHash as bytes, in the same order as the hash matrix
+  auto p_hash_data = std::array<uchar, sizeof(std::uint64_t)> {};
+  for (auto i = 0U; i < p_hash_data.size(); ++i) {
+    // NOLINTNEXTLINE(*-magic-numbers)
+    p_hash_data[i] = static_cast<uchar>(p_hash >> (8U * (7U - i)));
   }
 
+  auto guard = std::scoped_lock(m_add_mutex);
+  const auto photo_id = m_current_id;
+  ++m_current_id;
+
+  m_similarity_index->p_hash_index.add_item(photo_id, p_hash_data.data());
+  m_similarity_index->average_index.emplace_back(average_hash, photo_id);
   return photo_id;
 }
 auto SimilaritySearchBuilder::build_search() -> SimilaritySearch {
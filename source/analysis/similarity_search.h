@@ -5,6 +5,7 @@
 #ifndef ALBUMARCHITECT_SIMILARITY_SEARCH_H
 #define ALBUMARCHITECT_SIMILARITY_SEARCH_H
 #include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <mutex>
@@ -101,6 +102,14 @@ public:
   /// @return
   auto add_photo(album::Photo& photo) -> PhotoId;
 
+  /// Adds the hashes of a photo that were already calculated, as stored in
+  /// the cache. Thread safe.
+  /// @param p_hash
+  /// @param average_hash
+  /// @return
+  auto add_hashes(std::uint64_t p_hash, std::uint64_t average_hash)
+      -> PhotoId;
+
   auto build_search() -> SimilaritySearch;
 
 private:
@@ -3,6 +3,10 @@
 //
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <csignal>
 #include <execution>
 #include <filesystem>
 #include <fstream>
@@ -12,6 +16,8 @@
 #include <optional>
 #include <ranges>
 #include <string>
+#include <system_error>
+#include <utility>
 #include <vector>
 
 #include "commands.h"
@@ -22,15 +28,24 @@
 #include <spdlog/spdlog.h>
 
 #include "album/photo.h"
+#include "analysis/exact_duplicates.h"
 #include "analysis/similarity_search.h"
+#include "files/checkpointer.h"
+#include "files/mapped_tree.h"
 #include "files/tree.h"
+#include "files/watcher.h"
+
+#ifdef __linux__
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
 
 namespace album_architect::commands {
 
 namespace rng = std::ranges;
 
 namespace {
-auto get_baseline(const CommonParameters& parameters)
+auto get_baseline(const CommonParameters& parameters, bool rescan)
     -> std::optional<files::FileTree> {
   auto file_tree = std::optional<files::FileTree> {};
 
@@ -44,17 +59,36 @@ auto get_baseline(const CommonParameters& parameters)
     if (!file_tree) {
       spdlog::error("Couldn't load cache from {}",
                     parameters.cache_path.string());
-    } else if (file_tree
-               && file_tree->get_root_element().get_path()
-                   != parameters.photos_base_path)
+    } else if (const auto previous_path =
+                   file_tree->get_root_element().get_path();
+               previous_path != parameters.photos_base_path)
     {
-      // Check if base path has changed
-      spdlog::warn(
-          "A different root path was provided. Recreating cache. Previous "
-          "path: {}, new path: {}",
-          file_tree->get_root_element().get_path().string(),
-          parameters.photos_base_path.string());
-      file_tree = {};
+      // Check if base path has changed, keeping the cache if it was moved
+      if (parameters.rebase && file_tree->rebase(parameters.photos_base_path)) {
+        spdlog::info("Moved cache from {} to {}",
+                     previous_path.string(),
+                     parameters.photos_base_path.string());
+      } else {
+        spdlog::warn(
+            "A different root path was provided. Recreating cache. Previous "
+            "path: {}, new path: {}",
+            previous_path.string(),
+            parameters.photos_base_path.string());
+        file_tree = {};
+      }
+    }
+
+    if (file_tree && rescan) {
+      // Only apply the differences with the disk
+      spdlog::info("Rescanning {}", parameters.photos_base_path.string());
+      const auto summary = file_tree->refresh(parameters.scan_threads);
+      spdlog::info(
+          "Rescan found {} new, {} removed and {} modified entries. {} files "
+          "were moved and kept their hashes",
+          summary.added,
+          summary.removed,
+          summary.modified,
+          summary.moved);
     }
   }
 
@@ -62,7 +96,8 @@ auto get_baseline(const CommonParameters& parameters)
   if (!file_tree) {
     spdlog::info("Creating new cache path at {}",
                  parameters.cache_path.string());
-    file_tree = files::FileTree::build(parameters.photos_base_path);
+    file_tree = files::FileTree::build(parameters.photos_base_path,
+                                       parameters.scan_threads);
     if (!file_tree) {
       spdlog::error("Couldn't open photo base path: {}",
                     parameters.photos_base_path.string());
@@ -72,36 +107,299 @@ auto get_baseline(const CommonParameters& parameters)
 
   return file_tree;
 }
+
+/// Returns the absolute path, without dot components or a trailing
+/// separator, so paths given in different ways can be compared
+/// \param path
+/// \return
+auto get_normalized_path(const std::filesystem::path& path)
+    -> std::filesystem::path {
+  auto ret = std::filesystem::absolute(path).lexically_normal();
+  if (!ret.has_filename() && ret.has_relative_path()) {
+    ret = ret.parent_path();
+  }
+  return ret;
+}
+
+/// Returns the path of the mapped copy of the cache
+/// \param parameters
+/// \return
+auto get_mapped_cache_path(const CommonParameters& parameters)
+    -> std::filesystem::path {
+  auto ret = parameters.cache_path;
+  ret += ".map";
+  return ret;
+}
+
+/// Flushes a file or directory to the disk, so it survives a power loss
+/// \param path
+/// \param is_directory
+/// \return True if it was flushed
+auto sync_to_disk([[maybe_unused]] const std::filesystem::path& path,
+                  [[maybe_unused]] bool is_directory) -> bool {
+#ifdef __linux__
+  const auto flags = O_RDONLY | O_CLOEXEC | (is_directory ? O_DIRECTORY : 0);
+  const auto descriptor = ::open(path.c_str(), flags);
+  if (descriptor < 0) {
+    return false;
+  }
+  const auto is_synced = ::fsync(descriptor) == 0;
+  ::close(descriptor);
+  return is_synced;
+#else
+  return true;
+#endif
+}
+
+/// Writes a file through a temporary file next to it, which then replaces
+/// it. The temporary file is flushed to the disk before the rename, and the
+/// directory after it, so neither a crash nor a power loss leave a
+/// truncated file.
+/// \param path
+/// \param write Writes the file to the given path, returns false on error
+/// \return
+template<class Function>
+auto write_atomically(const std::filesystem::path& path, Function&& write)
+    -> bool {
+  auto temporary_path = path;
+  temporary_path += ".tmp";
+  if (!std::forward<Function>(write)(temporary_path)) {
+    std::filesystem::remove(temporary_path);
+    return false;
+  }
+  if (!sync_to_disk(temporary_path, false)) {
+    spdlog::error("Couldn't flush {} to disk", temporary_path.string());
+    std::filesystem::remove(temporary_path);
+    return false;
+  }
+
+  auto error = std::error_code {};
+  std::filesystem::rename(temporary_path, path, error);
+  if (error) {
+    spdlog::error("Couldn't replace {}. Error: {}", path.string(),
+                  error.message());
+    std::filesystem::remove(temporary_path);
+    return false;
+  }
+
+  // The rename is only durable once its directory is flushed
+  auto directory = path.parent_path();
+  if (directory.empty()) {
+    directory = ".";
+  }
+  if (!sync_to_disk(directory, true)) {
+    spdlog::warn("Couldn't flush directory {} to disk", directory.string());
+  }
+  return true;
+}
+
+/// Writes the tree to the cache file, and its mapped copy next to it
+/// \param parameters
+/// \param file_tree
+void write_cache(const CommonParameters& parameters,
+                 const files::FileTree& file_tree) {
+  spdlog::info("Writing to cache file: {}", parameters.cache_path.string());
+  const auto is_written = write_atomically(
+      parameters.cache_path,
+      [&parameters, &file_tree](const auto& path)
+      {
+        auto output_file = std::ofstream(path, std::ios::binary);
+        file_tree.to_stream(output_file,
+                            parameters.compress_cache
+                                ? files::StreamCompression::zstd
+                                : files::StreamCompression::none);
+        output_file.flush();
+        return static_cast<bool>(output_file);
+      });
+  if (!is_written) {
+    spdlog::error("Couldn't write cache file: {}",
+                  parameters.cache_path.string());
+  }
+
+  const auto mapped_path = get_mapped_cache_path(parameters);
+  if (!write_atomically(mapped_path,
+                        [&file_tree](const auto& path)
+                        { return file_tree.write_mapped(path); }))
+  {
+    spdlog::error("Couldn't write mapped cache file: {}",
+                  mapped_path.string());
+  }
+}
+
+/// Adds the photos hashed in the mapped cache to the builder, without reading
+/// any photo
+/// \param parameters
+/// \param scope Directory whose photos are added, absolute or relative to the
+/// photos folder. Only its part of the file is read.
+/// \param similarity_builder
+/// \return The path of each added photo
+auto add_mapped_photos(const CommonParameters& parameters,
+                       const std::filesystem::path& scope,
+                       analysis::SimilaritySearchBuilder& similarity_builder)
+    -> std::map<analysis::PhotoId, std::filesystem::path> {
+  const auto mapped_path = get_mapped_cache_path(parameters);
+  spdlog::info("Mapping cache from {}", mapped_path.string());
+  const auto mapped_tree = files::MappedFileTree::open(mapped_path);
+  if (!mapped_tree) {
+    throw CLI::ValidationError(
+        fmt::format("Couldn't map cache file {}", mapped_path.string()));
+  }
+  const auto root_path = get_normalized_path(parameters.photos_base_path);
+  if (get_normalized_path(mapped_tree->get_root_path()) != root_path) {
+    throw CLI::ValidationError(fmt::format(
+        "The mapped cache was written for another path: {}",
+        mapped_tree->get_root_path().string()));
+  }
+
+  // The mapped copy is written with the cache, so it is only older if that
+  // write failed
+  auto error = std::error_code {};
+  const auto cache_time =
+      std::filesystem::last_write_time(parameters.cache_path, error);
+  if (!error && cache_time > std::filesystem::last_write_time(mapped_path)) {
+    spdlog::warn("The mapped cache is older than the cache file {}",
+                 parameters.cache_path.string());
+  }
+
+  // The scope is looked up relative to the same root that was checked
+  const auto relative_scope =
+      get_normalized_path(root_path / scope).lexically_relative(root_path);
+  const auto scope_node =
+      relative_scope.empty() || *relative_scope.begin() == ".."
+      ? std::nullopt
+      : mapped_tree->get_node(relative_scope);
+  if (!scope_node) {
+    throw CLI::ValidationError(
+        fmt::format("{} is not in the cache", scope.string()));
+  }
+
+  // The subtree of the scope is a contiguous range of nodes
+  auto ret = std::map<analysis::PhotoId, std::filesystem::path> {};
+  const auto scope_end = mapped_tree->get_subtree_end(*scope_node);
+  for (auto node = *scope_node; node < scope_end; ++node) {
+    if (mapped_tree->get_node_type(node) != files::NodeType::file) {
+      continue;
+    }
+
+    const auto p_hash =
+        mapped_tree->get_hash(files::HashColumn::p_hash, node);
+    const auto average_hash =
+        mapped_tree->get_hash(files::HashColumn::average_hash, node);
+    if (p_hash && average_hash) {
+      ret.emplace(similarity_builder.add_hashes(*p_hash, *average_hash),
+                  mapped_tree->get_node_path(node));
+    }
+  }
+
+  return ret;
+}
+
+/// Computes and caches the hashes of the given files, if they are photos
+/// \param file_tree
+/// \param paths
+void hash_photos(files::FileTree& file_tree,
+                 const std::vector<std::filesystem::path>& paths) {
+  std::for_each(std::execution::par,
+                paths.begin(),
+                paths.end(),
+                [&file_tree](const auto& path)
+                {
+                  auto element = file_tree.get_element(path);
+                  if (!element) {
+                    return;
+                  }
+                  if (auto photo = album::Photo::load(*element)) {
+                    constexpr auto algorithms =
+                        std::array {album::ImageHashAlgorithm::average_hash,
+                                    album::ImageHashAlgorithm::p_hash};
+                    photo->get_image_hashes(algorithms);
+                  }
+                });
+}
+
+/// Set when the watch should stop
+std::atomic<bool> stop_requested = false;  // NOLINT(*-global-variables)
+
+extern "C" void request_stop(int /*signal*/) {
+  stop_requested = true;
+}
 }  // unnamed namespace
 
 void perform_analysis(const CommonParameters& common,
                       const AnalysisParameters& analysis) {
-  auto file_tree = get_baseline(common);
-  if (!file_tree) {
-    throw CLI::ValidationError("Error while creating file tree");
-  }
+  auto file_tree = std::optional<files::FileTree> {};
+  auto id_photo_map = std::map<analysis::PhotoId, std::filesystem::path> {};
+  auto similarity_builder = analysis::SimilaritySearchBuilder {};
+  auto scope_files = std::vector<files::Element> {};
+  // Relative scopes are resolved against the root of the tree, and no scope
+  // is the root itself
+  const auto scope = analysis.scope.value_or(std::filesystem::path {});
 
-  // Get the files list and create analysis object
-  auto id_photo_map = std::map<analysis::PhotoId, files::Element> {};
-  auto id_photo_map_mutex = std::mutex {};
+  if (analysis.read_only) {
+    // Query the hashes in place, without loading the cache into memory
+    spdlog::info("Gathering information for similarity index");
+    id_photo_map = add_mapped_photos(common, scope, similarity_builder);
+  } else {
+    file_tree = get_baseline(common, analysis.rescan);
+    if (!file_tree) {
+      throw CLI::ValidationError("Error while creating file tree");
+    }
 
-  spdlog::info("Gathering information for similarity index");
-  auto similarity_builder = analysis::SimilaritySearchBuilder {};
-  auto files =
-      std::vector<files::Element> {file_tree->begin(), file_tree->end()};
-  std::for_each(
-      std::execution::par_unseq,
-      files.begin(),
-      files.end(),
-      [&id_photo_map, &similarity_builder, &id_photo_map_mutex](auto& element)
-      {
-        if (auto photo = album::Photo::load(element)) {
-          auto photo_id = similarity_builder.add_photo(*photo);
+    // Get the files list and create analysis object
+    auto id_photo_map_mutex = std::mutex {};
 
-          auto guard = std::lock_guard(id_photo_map_mutex);
-          id_photo_map.emplace(photo_id, element);
-        }
-      });
+    const auto scope_element = analysis.scope
+        ? file_tree->get_element(*analysis.scope)
+        : file_tree->get_root_element();
+    if (!scope_element) {
+      throw CLI::ValidationError(fmt::format("{} is not in the photos folder",
+                                             analysis.scope->string()));
+    }
+
+    scope_files.assign(files::FileTreeIterator {*scope_element},
+                       files::FileTreeIterator {});
+
+    // Finding files with the same contents doesn't need to decode them, so
+    // photos are only loaded and hashed when something else needs them
+    const auto is_similarity_needed = !analysis.analyze_exact_duplicates
+        || analysis.analyze_duplicates
+        || !analysis.similar_photos_to_check.empty();
+    if (is_similarity_needed) {
+      spdlog::info("Gathering information for similarity index");
+      auto checkpointer = files::Checkpointer {
+          std::chrono::seconds {analysis.checkpoint_interval},
+          [&common, &file_tree]
+          {
+            spdlog::info("Writing checkpoint");
+            write_cache(common, *file_tree);
+          }};
+      std::for_each(
+          std::execution::par_unseq,
+          scope_files.begin(),
+          scope_files.end(),
+          [&id_photo_map,
+           &similarity_builder,
+           &id_photo_map_mutex,
+           &checkpointer](auto& element)
+          {
+            if (auto photo = album::Photo::load(element)) {
+              // Only photos that are hashed now change the tree
+              const auto is_hashed =
+                  photo->is_image_hash_in_cache(
+                      album::ImageHashAlgorithm::average_hash)
+                  && photo->is_image_hash_in_cache(
+                      album::ImageHashAlgorithm::p_hash);
+              auto photo_id = similarity_builder.add_photo(*photo);
+              if (!is_hashed) {
+                checkpointer.add_change();
+              }
+
+              auto guard = std::lock_guard(id_photo_map_mutex);
+              id_photo_map.emplace(photo_id, element.get_path());
+            }
+          });
+    }
+  }
 
   // Make an analysis object
   spdlog::debug("Building similarity index");
@@ -123,13 +421,38 @@ void perform_analysis(const CommonParameters& common,
       rng::transform(current,
                      std::back_inserter(group),
                      [&id_photo_map](const auto& photo_id)
-                     { return id_photo_map.at(photo_id).get_path().string(); });
+                     { return id_photo_map.at(photo_id).string(); });
 
       report_duplicates.emplace_back(std::move(group));
     }
     report["duplicates"] = report_duplicates;
   }
 
+  // Files with the same contents
+  if (analysis.analyze_exact_duplicates && file_tree) {
+    spdlog::info("Performing exact duplicates analysis");
+    auto summary = analysis::ExactDuplicatesSummary {};
+    const auto exact_duplicates =
+        analysis::ExactDuplicates::find(*file_tree, scope_files, &summary);
+    spdlog::info(
+        "Found {} groups of files with the same contents. {} of {} files had "
+        "to be read.",
+        exact_duplicates.size(),
+        summary.files_read,
+        summary.files);
+
+    auto report_exact_duplicates = nlohmann::json::array();
+    for (const auto& current : exact_duplicates) {
+      auto group = nlohmann::json::array();
+      rng::transform(current,
+                     std::back_inserter(group),
+                     [](const files::Element& element)
+                     { return element.get_path().string(); });
+      report_exact_duplicates.emplace_back(std::move(group));
+    }
+    report["exact_duplicates"] = report_exact_duplicates;
+  }
+
   spdlog::info("Performing similar photo analysis with {} photos.",
                analysis.similar_photos_to_check.size());
   auto report_similars = nlohmann::json::object();
@@ -151,7 +474,7 @@ void perform_analysis(const CommonParameters& common,
         {
           auto result = fmt::format(
               R"({{"path": "{}", "similarity" : {} }})",
-              id_photo_map.at(id_similarity_pair.first).get_path().string(),
+              id_photo_map.at(id_similarity_pair.first).string(),
               id_similarity_pair.second);
           return nlohmann::json::parse(result);
         });
@@ -160,9 +483,8 @@ void perform_analysis(const CommonParameters& common,
   report["similars"] = report_similars;
 
   // Store the final baseline
-  if (auto output_file = std::ofstream(common.cache_path)) {
-    spdlog::info("Writing to cache file: {}", common.cache_path.string());
-    file_tree->to_stream(output_file);
+  if (file_tree) {
+    write_cache(common, *file_tree);
   }
 
   // Write the report
@@ -175,4 +497,84 @@ void perform_analysis(const CommonParameters& common,
     output_file << report.dump();
   }
 }
+
+void perform_watch(const CommonParameters& common,
+                   const WatchParameters& watch) {
+  // Bring the cache up to date before listening for changes
+  auto file_tree = get_baseline(common, true);
+  if (!file_tree) {
+    throw CLI::ValidationError("Error while creating file tree");
+  }
+
+  auto watcher = files::FileWatcher::create(
+      file_tree->get_root_element().get_path());
+  if (!watcher) {
+    throw CLI::ValidationError("Couldn't watch the photos folder");
+  }
+
+  // Files that are not hashed yet, like the ones found during the rescan
+  const auto get_pending_files = [&file_tree]()
+  {
+    auto pending = std::vector<std::filesystem::path> {};
+    for (const auto& element : *file_tree) {
+      if (auto photo = album::Photo::load(element);
+          photo
+          && !photo->is_image_hash_in_cache(album::ImageHashAlgorithm::p_hash))
+      {
+        pending.push_back(element.get_path());
+      }
+    }
+    return pending;
+  };
+  hash_photos(*file_tree, get_pending_files());
+
+  stop_requested = false;
+  std::signal(SIGINT, request_stop);
+  std::signal(SIGTERM, request_stop);
+
+  spdlog::info("Watching {} for changes",
+               file_tree->get_root_element().get_path().string());
+  const auto flush_interval = std::chrono::seconds(watch.flush_interval);
+  auto last_flush = std::chrono::steady_clock::now();
+  auto is_dirty = false;
+  while (!stop_requested) {
+    using namespace std::chrono_literals;
+    const auto events = watcher->wait_events(500ms);
+
+    if (!events.empty()) {
+      const auto overflowed = rng::any_of(
+          events,
+          [](const auto& event)
+          { return event.type == files::FileEventType::overflow; });
+
+      auto changed = std::vector<std::filesystem::path> {};
+      if (overflowed) {
+        // Some events were lost, so the disk is the only source of truth
+        spdlog::warn("Events were lost, rescanning the photos folder");
+        file_tree->refresh(common.scan_threads);
+        changed = get_pending_files();
+      } else {
+        changed = file_tree->apply_events(events);
+      }
+
+      spdlog::info("Applied {} changes, hashing {} files",
+                   events.size(),
+                   changed.size());
+      hash_photos(*file_tree, changed);
+      is_dirty = true;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (is_dirty && now - last_flush >= flush_interval) {
+      write_cache(common, *file_tree);
+      last_flush = now;
+      is_dirty = false;
+    }
+  }
+
+  spdlog::info("Stopping watch");
+  std::signal(SIGINT, SIG_DFL);
+  std::signal(SIGTERM, SIG_DFL);
+  write_cache(common, *file_tree);
+}
 }  // namespace album_architect::commands
\ No newline at end of file
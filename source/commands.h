@@ -5,6 +5,7 @@
 #ifndef COMMANDS_H
 #define COMMANDS_H
 
+#include <cstddef>
 #include <cstdint>
 #include <filesystem>
 #include <optional>
@@ -17,12 +18,31 @@ namespace album_architect::commands {
 struct CommonParameters {
   std::filesystem::path photos_base_path;
   std::filesystem::path cache_path;
+  std::size_t scan_threads = 0;  // Threads for scanning, 0 for all cores
+  bool compress_cache = false;  // Write the cache compressed
+  bool rebase = false;  // Keep a cache written for another photos path
 };
 
 /// Parameters for performing analysis
 struct AnalysisParameters {
+  // Walk the disk again to pick up changes since the cache was written
+  bool rescan = false;
+
+  // Query the mapped cache in place instead of loading it. Photos are not
+  // read, and the cache is not written.
+  bool read_only = false;
+
+  // Directory, absolute or relative to the photos folder, whose photos are
+  // analyzed. Defaults to the whole folder.
+  std::optional<std::filesystem::path> scope;
+
+  // Seconds between writes of the cache while photos are hashed, 0 to only
+  // write it at the end
+  std::size_t checkpoint_interval = 300;
+
   // Duplicates
   bool analyze_duplicates = false;
+  bool analyze_exact_duplicates = false;  // Same contents, byte by byte
   // std::filesystem::path duplicates_start_path;  // Initial path to review
 
   // Similarities
@@ -32,12 +52,25 @@ struct AnalysisParameters {
   std::optional<std::filesystem::path> output_path;
 };
 
+/// Parameters for watching the photos folder
+struct WatchParameters {
+  // Seconds between writes of the cache file
+  std::size_t flush_interval = 60;
+};
+
 /// Analyzes the photos according to the parameters given
 /// @param common
 /// @param analysis
 void perform_analysis(const CommonParameters& common,
                       const AnalysisParameters& analysis);
 
+/// Keeps watching the photos folder, applying the changes to the cache and
+/// hashing new photos as they arrive. Runs until interrupted.
+/// @param common
+/// @param watch
+void perform_watch(const CommonParameters& common,
+                   const WatchParameters& watch);
+
 }  // namespace album_architect::commands
 
 #endif  // COMMANDS_H
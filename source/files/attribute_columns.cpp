@@ -0,0 +1,80 @@
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#include "attribute_columns.h"
+
+#include <boost/core/span.hpp>
+
+namespace album_architect::files {
+
+void AttributeColumns::resize(std::size_t count) {
+  const auto words = (count + bits_per_word - 1) / bits_per_word;
+  for (auto index = std::size_t {0}; index < hash_column_count; ++index) {
+    m_hashes[index].resize(count);
+    m_presence[index].resize(words);
+  }
+
+  // Shrinking can leave bits of removed nodes in the last word
+  if (const auto extra_bits = count % bits_per_word; extra_bits != 0) {
+    const auto mask = (std::uint64_t {1} << extra_bits) - 1;
+    for (auto& presence : m_presence) {
+      presence.back() &= mask;
+    }
+  }
+  m_states.resize(count);
+}
+auto AttributeColumns::get_hash(HashColumn column, NodeId node) const
+    -> std::optional<std::uint64_t> {
+  const auto index = static_cast<std::size_t>(column);
+
+  // Nodes in the same word can be written by other threads
+  auto& word = const_cast<std::uint64_t&>(  // NOLINT(*-const-cast)
+      m_presence[index][node / bits_per_word]);
+  const auto bit = std::uint64_t {1} << (node % bits_per_word);
+  if ((std::atomic_ref(word).load(std::memory_order_relaxed) & bit) == 0) {
+    return {};
+  }
+  return m_hashes[index][node];
+}
+void AttributeColumns::set_hash(HashColumn column,
+                                NodeId node,
+                                std::uint64_t value) {
+  const auto index = static_cast<std::size_t>(column);
+  m_hashes[index][node] = value;
+  std::atomic_ref(m_presence[index][node / bits_per_word])
+      .fetch_or(std::uint64_t {1} << (node % bits_per_word),
+                std::memory_order_relaxed);
+}
+void AttributeColumns::remove_hash(HashColumn column, NodeId node) {
+  const auto index = static_cast<std::size_t>(column);
+  std::atomic_ref(m_presence[index][node / bits_per_word])
+      .fetch_and(~(std::uint64_t {1} << (node % bits_per_word)),
+                 std::memory_order_relaxed);
+  m_hashes[index][node] = 0;
+}
+void AttributeColumns::clear(NodeId node) {
+  for (auto index = std::size_t {0}; index < hash_column_count; ++index) {
+    remove_hash(static_cast<HashColumn>(index), node);
+  }
+  m_states[node] = 0;
+}
+auto AttributeColumns::select(boost::span<const NodeId> nodes) const
+    -> AttributeColumns {
+  auto ret = AttributeColumns {};
+  ret.resize(nodes.size());
+  for (auto new_node = std::size_t {0}; new_node < nodes.size(); ++new_node) {
+    const auto node = nodes[new_node];
+    for (auto index = std::size_t {0}; index < hash_column_count; ++index) {
+      const auto column = static_cast<HashColumn>(index);
+      if (const auto hash = get_hash(column, node)) {
+        ret.set_hash(column, new_node, *hash);
+      }
+    }
+    ret.m_states[new_node] = m_states[node];
+  }
+  return ret;
+}
+
+}  // namespace album_architect::files
@@ -0,0 +1,115 @@
+#ifndef ALBUMARCHITECT_FILES_ATTRIBUTE_COLUMNS_H
+#define ALBUMARCHITECT_FILES_ATTRIBUTE_COLUMNS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <boost/core/span.hpp>
+#include <boost/serialization/vector.hpp>
+
+namespace album_architect::files {
+
+/// Well-known hashes that are stored as a 64-bit word per node
+enum class HashColumn : std::uint8_t {
+  average_hash,
+  p_hash,
+};
+
+/// Stores well-known attributes of the nodes in dense columns indexed by
+/// NodeId, instead of in the metadata map of each vertex. Every hash column
+/// has a presence bitmap, and the state column uses 0 as no value.
+///
+/// Values of different nodes can be written concurrently, as long as each
+/// node is only written by one thread at a time. Changing the size is not
+/// thread-safe.
+class AttributeColumns {
+public:
+  using NodeId = std::size_t;
+
+  /// Number of hash columns
+  static constexpr auto hash_column_count = std::size_t {2};
+
+  /// Returns the number of nodes in the columns
+  /// \return
+  auto size() const -> std::size_t { return m_states.size(); }
+
+  /// Changes the number of nodes. New nodes have no values.
+  /// \param count
+  void resize(std::size_t count);
+
+  /// Returns the hash of the node, if stored
+  /// \param column
+  /// \param node
+  /// \return
+  auto get_hash(HashColumn column, NodeId node) const
+      -> std::optional<std::uint64_t>;
+
+  /// Stores the hash of the node
+  /// \param column
+  /// \param node
+  /// \param value
+  void set_hash(HashColumn column, NodeId node, std::uint64_t value);
+
+  /// Removes the hash of the node
+  /// \param column
+  /// \param node
+  void remove_hash(HashColumn column, NodeId node);
+
+  /// Returns the hashes of all the nodes. Only the values whose presence bit
+  /// is set are meaningful.
+  /// \param column
+  /// \return
+  auto get_hashes(HashColumn column) const -> boost::span<const std::uint64_t> {
+    return m_hashes[static_cast<std::size_t>(column)];
+  }
+
+  /// Returns the state of the node, 0 if not stored
+  /// \param node
+  /// \return
+  auto get_state(NodeId node) const -> std::uint8_t { return m_states[node]; }
+
+  /// Stores the state of the node, 0 removes it
+  /// \param node
+  /// \param state
+  void set_state(NodeId node, std::uint8_t state) { m_states[node] = state; }
+
+  /// Removes every value of the node
+  /// \param node
+  void clear(NodeId node);
+
+  /// Returns new columns with the values of the given nodes. Node i of the
+  /// result has the values of nodes[i].
+  /// \param nodes
+  /// \return
+  auto select(boost::span<const NodeId> nodes) const -> AttributeColumns;
+
+  /// Serialize object
+  template<class Archive>
+  void serialize(Archive& archive, const unsigned int /*version*/) {
+    for (auto index = std::size_t {0}; index < hash_column_count; ++index) {
+      archive & m_hashes[index];
+      archive & m_presence[index];
+    }
+    archive & m_states;
+  }
+
+private:
+  /// Bits in each word of a presence bitmap
+  static constexpr auto bits_per_word = std::size_t {64};
+
+  /// Value of each hash column by node
+  std::array<std::vector<std::uint64_t>, hash_column_count> m_hashes;
+
+  /// Bitmap of the nodes that have a value, for each hash column
+  std::array<std::vector<std::uint64_t>, hash_column_count> m_presence;
+
+  /// State of each node
+  std::vector<std::uint8_t> m_states;
+};
+
+}  // namespace album_architect::files
+
+#endif  // ALBUMARCHITECT_FILES_ATTRIBUTE_COLUMNS_H
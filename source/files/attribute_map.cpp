@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "attribute_map.h"
+
+#include <boost/core/span.hpp>
+
+#include "files/name_pool.h"
+
+namespace album_architect::files {
+
+namespace {
+/// Names of the keys of the process
+struct KeyRegistry {
+  std::shared_mutex mutex;
+  NamePool names;
+};
+
+auto get_key_registry() -> KeyRegistry& {
+  static auto registry = KeyRegistry {};
+  return registry;
+}
+}  // namespace
+
+auto AttributeKeys::intern(std::string_view name) -> AttributeKey {
+  auto& registry = get_key_registry();
+  {
+    auto guard = std::shared_lock(registry.mutex);
+    if (const auto name_id = registry.names.find(name)) {
+      return AttributeKey {*name_id};
+    }
+  }
+
+  auto guard = std::scoped_lock(registry.mutex);
+  return AttributeKey {registry.names.intern(name)};
+}
+auto AttributeKeys::find(std::string_view name) -> std::optional<AttributeKey> {
+  auto& registry = get_key_registry();
+  auto guard = std::shared_lock(registry.mutex);
+  if (const auto name_id = registry.names.find(name)) {
+    return AttributeKey {*name_id};
+  }
+  return {};
+}
+auto AttributeKeys::get_name(AttributeKey key) -> std::string_view {
+  auto& registry = get_key_registry();
+  auto guard = std::shared_lock(registry.mutex);
+  return registry.names.get(key.id);
+}
+auto AttributeKeys::get_names() -> std::vector<std::string> {
+  auto& registry = get_key_registry();
+  auto guard = std::shared_lock(registry.mutex);
+  auto ret = std::vector<std::string> {};
+  ret.reserve(registry.names.size());
+  for (auto name_id = NamePool::NameId {0}; name_id < registry.names.size();
+       ++name_id)
+  {
+    ret.emplace_back(registry.names.get(name_id));
+  }
+  return ret;
+}
+
+auto AttributeMap::lower_bound(AttributeKey key) const
+    -> std::vector<Entry>::const_iterator {
+  return std::lower_bound(m_entries.begin(),
+                          m_entries.end(),
+                          key,
+                          [](const Entry& entry, AttributeKey value)
+                          { return entry.first < value; });
+}
+auto AttributeMap::find(AttributeKey key) const -> const VertexAttribute* {
+  const auto position = lower_bound(key);
+  if (position == m_entries.end() || position->first != key) {
+    return nullptr;
+  }
+  return &position->second;
+}
+auto AttributeMap::insert_or_assign(AttributeKey key,
+                                    VertexAttribute attribute)
+    -> std::optional<VertexAttribute> {
+  const auto offset = lower_bound(key) - m_entries.begin();
+  const auto position = m_entries.begin() + offset;
+  if (position == m_entries.end() || position->first != key) {
+    m_entries.emplace(position, key, std::move(attribute));
+    return {};
+  }
+
+  return std::exchange(position->second, std::move(attribute));
+}
+auto AttributeMap::erase(AttributeKey key) -> std::optional<VertexAttribute> {
+  const auto offset = lower_bound(key) - m_entries.begin();
+  const auto position = m_entries.begin() + offset;
+  if (position == m_entries.end() || position->first != key) {
+    return {};
+  }
+
+  auto previous = std::make_optional(std::move(position->second));
+  m_entries.erase(position);
+  return previous;
+}
+void AttributeMap::remap_keys(boost::span<const AttributeKey> keys) {
+  for (auto& entry : m_entries) {
+    entry.first = keys[entry.first.id];
+  }
+  std::sort(m_entries.begin(),
+            m_entries.end(),
+            [](const Entry& lhs, const Entry& rhs)
+            { return lhs.first < rhs.first; });
+}
+
+}  // namespace album_architect::files
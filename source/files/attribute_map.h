@@ -0,0 +1,122 @@
+#ifndef ALBUMARCHITECT_FILES_ATTRIBUTE_MAP_H
+#define ALBUMARCHITECT_FILES_ATTRIBUTE_MAP_H
+
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <boost/core/span.hpp>
+#include <boost/serialization/utility.hpp>
+#include <boost/serialization/variant.hpp>
+#include <boost/serialization/vector.hpp>
+#include <helper/boost_serialization_cvmat.h>
+
+#include "files/common.h"
+
+namespace album_architect::files {
+
+/// Identifies the key of an attribute. Ids are handed out by AttributeKeys
+/// and are the same for every tree in the process.
+struct AttributeKey {
+  std::uint32_t id = 0;
+
+  auto operator<=>(const AttributeKey& rhs) const = default;
+
+  /// Serialize object
+  template<class Archive>
+  void serialize(Archive& archive, const unsigned int /*version*/) {
+    archive & id;
+  }
+};
+
+/// Registry of the attribute keys of the process. Every distinct key name is
+/// stored once, and its id can be kept to avoid finding the name again.
+/// Thread-safe.
+class AttributeKeys {
+public:
+  /// Returns the key with the given name, registering it if it is new
+  /// \param name
+  /// \return
+  static auto intern(std::string_view name) -> AttributeKey;
+
+  /// Returns the key with the given name, if it was registered. Doesn't
+  /// allocate.
+  /// \param name
+  /// \return
+  static auto find(std::string_view name) -> std::optional<AttributeKey>;
+
+  /// Returns the name of the key. Valid for the whole process.
+  /// \param key
+  /// \return
+  static auto get_name(AttributeKey key) -> std::string_view;
+
+  /// Returns the names of all the keys, in id order
+  /// \return
+  static auto get_names() -> std::vector<std::string>;
+};
+
+/// Attributes of a vertex, in a vector sorted by key. Vertices usually have
+/// only a few attributes, so a binary search over contiguous entries is
+/// faster and much smaller than a tree of nodes.
+class AttributeMap {
+public:
+  using Entry = std::pair<AttributeKey, VertexAttribute>;
+
+  /// Returns the attribute with the given key, or null
+  /// \param key
+  /// \return
+  auto find(AttributeKey key) const -> const VertexAttribute*;
+
+  /// Stores the attribute with the given key
+  /// \param key
+  /// \param attribute
+  /// \return Previous attribute if any
+  auto insert_or_assign(AttributeKey key, VertexAttribute attribute)
+      -> std::optional<VertexAttribute>;
+
+  /// Removes the attribute with the given key
+  /// \param key
+  /// \return The removed attribute
+  auto erase(AttributeKey key) -> std::optional<VertexAttribute>;
+
+  /// Removes all the attributes
+  void clear() { m_entries.clear(); }
+
+  /// Returns the number of attributes
+  /// \return
+  auto size() const -> std::size_t { return m_entries.size(); }
+
+  /// Returns true if there are no attributes
+  /// \return
+  auto empty() const -> bool { return m_entries.empty(); }
+
+  // Iteration, sorted by key
+  auto begin() const { return m_entries.begin(); }
+  auto end() const { return m_entries.end(); }
+
+  /// Replaces every key k with keys[k.id], as read from another process
+  /// \param keys Must have an entry for the id of every key in the map
+  void remap_keys(boost::span<const AttributeKey> keys);
+
+  /// Serialize object
+  template<class Archive>
+  void serialize(Archive& archive, const unsigned int /*version*/) {
+    archive & m_entries;
+  }
+
+private:
+  /// Returns the first entry whose key is not less than the given one
+  auto lower_bound(AttributeKey key) const
+      -> std::vector<Entry>::const_iterator;
+
+  std::vector<Entry> m_entries;
+};
+
+}  // namespace album_architect::files
+
+#endif  // ALBUMARCHITECT_FILES_ATTRIBUTE_MAP_H
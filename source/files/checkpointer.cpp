@@ -0,0 +1,40 @@
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <utility>
+
+#include "checkpointer.h"
+
+namespace album_architect::files {
+
+Checkpointer::Checkpointer(std::chrono::milliseconds interval,
+                           std::function<void()> write)
+    : m_write(std::move(write)) {
+  if (interval.count() == 0) {
+    return;
+  }
+
+  m_thread = std::jthread(
+      [this, interval](const std::stop_token& stop_token)
+      {
+        auto mutex = std::mutex {};
+        auto condition = std::condition_variable_any {};
+        auto lock = std::unique_lock(mutex);
+        // Only a stop request ends the wait before the interval
+        while (!condition.wait_for(lock,
+                                   stop_token,
+                                   interval,
+                                   [&stop_token]
+                                   { return stop_token.stop_requested(); }))
+        {
+          if (m_pending_changes.exchange(0) > 0) {
+            m_write();
+          }
+        }
+      });
+}
+
+}  // namespace album_architect::files
@@ -0,0 +1,35 @@
+#ifndef ALBUMARCHITECT_FILES_CHECKPOINTER_H
+#define ALBUMARCHITECT_FILES_CHECKPOINTER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <thread>
+
+namespace album_architect::files {
+
+/// Writes the cache periodically while it is being filled, so a long run
+/// that is interrupted keeps most of its work. A checkpoint is only written
+/// if there were changes since the last one. Stops when destroyed, without
+/// waiting for the rest of the interval.
+class Checkpointer {
+public:
+  /// Starts writing checkpoints
+  /// \param interval Time between checkpoints. Zero disables them.
+  /// \param write Writes a checkpoint, from a background thread
+  Checkpointer(std::chrono::milliseconds interval,
+               std::function<void()> write);
+
+  /// Notifies that the tree changed since the last checkpoint
+  void add_change() { m_pending_changes.fetch_add(1); }
+
+private:
+  std::function<void()> m_write;
+  std::atomic<std::size_t> m_pending_changes = 0;
+  std::jthread m_thread;  // Last, so it stops before the rest is destroyed
+};
+
+}  // namespace album_architect::files
+
+#endif  // ALBUMARCHITECT_FILES_CHECKPOINTER_H
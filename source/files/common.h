@@ -1,6 +1,8 @@
 #ifndef ALBUMARCHITECT_FILES_COMMON_H
 #define ALBUMARCHITECT_FILES_COMMON_H
 
+#include <cstdint>
+#include <filesystem>
 #include <ostream>
 #include <variant>
 #include <opencv2/core/mat.hpp>
@@ -25,6 +27,46 @@ enum class NodeType : std::uint8_t {
 /// \return
 auto operator<<(std::ostream& ostream, const NodeType& node) -> std::ostream&;
 
+/// Identifies the state of a file on disk, allowing to detect changes without
+/// reading its contents. An empty fingerprint means that it is unknown.
+struct FileFingerprint {
+  std::uint64_t size = 0;
+  std::int64_t mtime_ns = 0;
+  std::uint64_t inode = 0;
+
+  /// Returns true if the fingerprint was never recorded
+  auto is_empty() const -> bool {
+    return size == 0 && mtime_ns == 0 && inode == 0;
+  }
+
+  auto operator==(const FileFingerprint& rhs) const -> bool = default;
+
+  /// Serialize object
+  template<class Archive>
+  void serialize(Archive& archive, const unsigned int /*version*/) {
+    archive & size;
+    archive & mtime_ns;
+    archive & inode;
+  }
+};
+
+/// Represents the type of change reported for a path in the filesystem
+enum class FileEventType : std::uint8_t {
+  created,
+  removed,
+  modified,
+  moved,
+  overflow,  // Events were lost, the tree should be refreshed
+};
+
+/// Represents a single change in the filesystem
+struct FileEvent {
+  FileEventType type = FileEventType::modified;
+  std::filesystem::path path;
+  std::filesystem::path new_path;  // Only set for moved events
+  bool is_directory = false;
+};
+
 /// Represents a vertex attribute that can be stored along with each vertex
 using VertexAttribute = std::variant<std::string, cv::Mat>;
 using PathAttribute = VertexAttribute;
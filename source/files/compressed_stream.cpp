@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <numeric>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "compressed_stream.h"
+
+#include <spdlog/spdlog.h>
+#include <tbb/parallel_for.h>
+#include <zstd.h>
+
+namespace album_architect::files {
+
+namespace {
+/// Identifies the container. The serialization archives start with the size
+/// of their signature, so the first character is enough to tell them apart.
+constexpr auto container_magic =
+    std::array<char, 8> {'A', 'A', 'C', 'A', 'C', 'H', 'E', 'Z'};
+
+/// Changes every time the layout changes
+constexpr auto container_version = std::uint32_t {1};
+
+/// Written as is, so a container from a machine with another byte order is
+/// rejected
+constexpr auto byte_order_mark = std::uint32_t {0x01020304};
+
+/// Larger blocks are taken as corrupt, to avoid huge allocations
+constexpr auto max_block_size = std::size_t {1} << 26U;
+
+/// The compressed blocks are read in chunks of this size, so the memory
+/// allocated grows with the data that is actually in the input
+constexpr auto read_chunk_size = std::size_t {1} << 20U;
+
+constexpr auto compression_level = ZSTD_CLEVEL_DEFAULT;
+
+/// First bytes of the container
+struct ContainerHeader {
+  std::array<char, 8> magic = container_magic;
+  std::uint32_t version = container_version;
+  std::uint32_t byte_order = byte_order_mark;
+  std::uint64_t uncompressed_size = 0;
+  std::uint64_t block_size = 0;
+  std::uint64_t block_count = 0;
+};
+
+static_assert(std::is_trivially_copyable_v<ContainerHeader>);
+}  // namespace
+
+auto CompressedStream::write(std::string_view data,
+                             std::ostream& output,
+                             std::size_t block_size) -> bool {
+  const auto block_count = (data.size() + block_size - 1) / block_size;
+  auto blocks = std::vector<std::string>(block_count);
+  auto is_compressed = std::atomic<bool> {true};
+  tbb::parallel_for(
+      std::size_t {0},
+      block_count,
+      [&](std::size_t block)
+      {
+        const auto input = data.substr(block * block_size, block_size);
+        auto& compressed = blocks[block];
+        compressed.resize(ZSTD_compressBound(input.size()));
+        const auto size = ZSTD_compress(compressed.data(),
+                                        compressed.size(),
+                                        input.data(),
+                                        input.size(),
+                                        compression_level);
+        if (ZSTD_isError(size) != 0) {
+          spdlog::error("Couldn't compress block. Error: {}",
+                        ZSTD_getErrorName(size));
+          is_compressed = false;
+          return;
+        }
+        compressed.resize(size);
+      });
+  if (!is_compressed) {
+    output.setstate(std::ios::failbit);
+    return false;
+  }
+
+  auto header = ContainerHeader {};
+  header.uncompressed_size = data.size();
+  header.block_size = block_size;
+  header.block_count = block_count;
+  auto sizes = std::vector<std::uint64_t> {};
+  sizes.reserve(block_count);
+  for (const auto& compressed : blocks) {
+    sizes.push_back(compressed.size());
+  }
+
+  // NOLINTBEGIN(*-reinterpret-cast)
+  output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  output.write(reinterpret_cast<const char*>(sizes.data()),
+               static_cast<std::streamsize>(sizes.size() * sizeof(sizes[0])));
+  // NOLINTEND(*-reinterpret-cast)
+  for (const auto& compressed : blocks) {
+    output.write(compressed.data(),
+                 static_cast<std::streamsize>(compressed.size()));
+  }
+  return static_cast<bool>(output);
+}
+auto CompressedStream::is_compressed(std::istream& input) -> bool {
+  return input.peek() == container_magic[0];
+}
+auto CompressedStream::read(std::istream& input) -> std::optional<std::string> {
+  auto header = ContainerHeader {};
+  // NOLINTNEXTLINE(*-reinterpret-cast)
+  input.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!input || header.magic != container_magic
+      || header.version != container_version
+      || header.byte_order != byte_order_mark)
+  {
+    spdlog::error("Compressed cache has an unknown format");
+    return {};
+  }
+  if (header.block_size == 0 || header.block_size > max_block_size
+      || header.block_count
+          != (header.uncompressed_size + header.block_size - 1)
+              / header.block_size)
+  {
+    spdlog::error("Compressed cache is corrupt");
+    return {};
+  }
+
+  // Read every block before decompressing them in parallel
+  const auto block_count = static_cast<std::size_t>(header.block_count);
+  auto sizes = std::vector<std::uint64_t> {};
+  for (auto block = std::size_t {0}; block < block_count && input; ++block) {
+    // One at a time, so a corrupt count can't allocate more than the input
+    auto size = std::uint64_t {0};
+    // NOLINTNEXTLINE(*-reinterpret-cast)
+    input.read(reinterpret_cast<char*>(&size), sizeof(size));
+    sizes.push_back(size);
+  }
+  const auto max_compressed_size =
+      ZSTD_compressBound(static_cast<std::size_t>(header.block_size));
+  if (!input
+      || std::any_of(sizes.begin(),
+                     sizes.end(),
+                     [max_compressed_size](std::uint64_t size)
+                     { return size == 0 || size > max_compressed_size; }))
+  {
+    spdlog::error("Compressed cache is corrupt");
+    return {};
+  }
+
+  auto offsets = std::vector<std::size_t>(block_count + 1);
+  std::inclusive_scan(sizes.begin(), sizes.end(), offsets.begin() + 1);
+  auto compressed = std::string {};
+  while (input && compressed.size() < offsets.back()) {
+    const auto position = compressed.size();
+    const auto chunk = std::min(read_chunk_size, offsets.back() - position);
+    compressed.resize(position + chunk);
+    input.read(compressed.data() + position,
+               static_cast<std::streamsize>(chunk));
+  }
+  if (!input) {
+    spdlog::error("Compressed cache is truncated");
+    return {};
+  }
+
+  // Every block has to be a whole frame that declares the size of its part
+  // of the data, before the data is allocated
+  const auto block_size = static_cast<std::size_t>(header.block_size);
+  const auto uncompressed_size =
+      static_cast<std::size_t>(header.uncompressed_size);
+  for (auto block = std::size_t {0}; block < block_count; ++block) {
+    const auto* frame = compressed.data() + offsets[block];
+    const auto expected_size =
+        std::min(block_size, uncompressed_size - (block * block_size));
+    if (ZSTD_findFrameCompressedSize(frame, sizes[block]) != sizes[block]
+        || ZSTD_getFrameContentSize(frame, sizes[block]) != expected_size)
+    {
+      spdlog::error("Compressed cache is corrupt");
+      return {};
+    }
+  }
+
+  auto ret = std::string(uncompressed_size, '\0');
+  auto is_valid = std::atomic<bool> {true};
+  tbb::parallel_for(
+      std::size_t {0},
+      block_count,
+      [&](std::size_t block)
+      {
+        const auto start = block * block_size;
+        const auto expected_size = std::min(block_size, ret.size() - start);
+        const auto size = ZSTD_decompress(ret.data() + start,
+                                          expected_size,
+                                          compressed.data() + offsets[block],
+                                          sizes[block]);
+        if (ZSTD_isError(size) != 0 || size != expected_size) {
+          is_valid = false;
+        }
+      });
+  if (!is_valid) {
+    spdlog::error("Compressed cache is corrupt");
+    return {};
+  }
+  return ret;
+}
+
+}  // namespace album_architect::files
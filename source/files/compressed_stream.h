@@ -0,0 +1,52 @@
+#ifndef ALBUMARCHITECT_FILES_COMPRESSED_STREAM_H
+#define ALBUMARCHITECT_FILES_COMPRESSED_STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace album_architect::files {
+
+/// Compression of the cache streams
+enum class StreamCompression : std::uint8_t {
+  none,
+  zstd
+};
+
+/// Container of zstd blocks that are compressed independently, so they are
+/// compressed and decompressed in parallel. The container starts with a
+/// header and the compressed size of every block, followed by the blocks.
+class CompressedStream {
+public:
+  /// Uncompressed size of every block but the last one
+  static constexpr auto default_block_size = std::size_t {1} << 20U;
+
+  /// Writes the data as a container
+  /// \param data
+  /// \param output
+  /// \param block_size
+  /// \return False if the data couldn't be compressed or written. The failbit
+  /// of the output is set too.
+  static auto write(std::string_view data,
+                    std::ostream& output,
+                    std::size_t block_size = default_block_size) -> bool;
+
+  /// Returns true if the stream starts with a container. Only peeks at the
+  /// next character, so nothing is consumed.
+  /// \param input
+  /// \return
+  static auto is_compressed(std::istream& input) -> bool;
+
+  /// Reads a container
+  /// \param input
+  /// \return The uncompressed data, or None if the container is corrupt
+  static auto read(std::istream& input) -> std::optional<std::string>;
+};
+
+}  // namespace album_architect::files
+
+#endif  // ALBUMARCHITECT_FILES_COMPRESSED_STREAM_H
@@ -0,0 +1,61 @@
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <variant>
+
+#include "content_digest.h"
+
+#include <fmt/format.h>
+
+#include "files/common.h"
+
+namespace album_architect::files {
+
+namespace {
+/// Reads a number followed by the separator from the start of the value
+/// \tparam T
+/// \param value Consumed up to the separator
+/// \return
+template<class T>
+auto read_field(std::string_view& value) -> std::optional<T> {
+  auto field = T {};
+  const auto [end, error] =
+      std::from_chars(value.data(), value.data() + value.size(), field);
+  if (error != std::errc {} || end == value.data() + value.size()
+      || *end != ':')
+  {
+    return {};
+  }
+  value.remove_prefix(static_cast<std::size_t>(end - value.data()) + 1);
+  return field;
+}
+}  // namespace
+
+auto ContentDigest::to_attribute(const FileFingerprint& fingerprint,
+                                 std::string_view digest) -> PathAttribute {
+  return fmt::format(
+      "{}:{}:{}", fingerprint.size, fingerprint.mtime_ns, digest);
+}
+auto ContentDigest::from_attribute(
+    const std::optional<PathAttribute>& attribute,
+    const FileFingerprint& fingerprint) -> std::optional<std::string> {
+  if (!attribute || !std::holds_alternative<std::string>(*attribute)) {
+    return {};
+  }
+
+  auto value = std::string_view {std::get<std::string>(*attribute)};
+  const auto size = read_field<std::uint64_t>(value);
+  const auto mtime_ns = read_field<std::int64_t>(value);
+  if (!size || !mtime_ns || *size != fingerprint.size
+      || *mtime_ns != fingerprint.mtime_ns || value.empty())
+  {
+    return {};
+  }
+  return std::string {value};
+}
+
+}  // namespace album_architect::files
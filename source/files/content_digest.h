@@ -0,0 +1,37 @@
+#ifndef ALBUMARCHITECT_FILES_CONTENT_DIGEST_H
+#define ALBUMARCHITECT_FILES_CONTENT_DIGEST_H
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "files/common.h"
+
+namespace album_architect::files {
+
+/// Digests of the contents of files are stored in the metadata together with
+/// the size and modification time the file had when it was read, so a digest
+/// is only used while the file is unchanged. The inode is left out, so files
+/// that are moved keep their digests.
+class ContentDigest {
+public:
+  /// Returns the attribute that stores the digest
+  /// \param fingerprint Fingerprint of the file when the digest was calculated
+  /// \param digest
+  /// \return
+  static auto to_attribute(const FileFingerprint& fingerprint,
+                           std::string_view digest) -> PathAttribute;
+
+  /// Returns the digest stored in the attribute, if it was calculated for a
+  /// file with the same size and modification time
+  /// \param attribute
+  /// \param fingerprint Current fingerprint of the file
+  /// \return
+  static auto from_attribute(const std::optional<PathAttribute>& attribute,
+                             const FileFingerprint& fingerprint)
+      -> std::optional<std::string>;
+};
+
+}  // namespace album_architect::files
+
+#endif  // ALBUMARCHITECT_FILES_CONTENT_DIGEST_H
@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "frozen_graph.h"
+
+#include <boost/core/span.hpp>
+#include <boost/graph/adjacency_list.hpp>
+
+namespace album_architect::files {
+
+auto FrozenFileGraph::get_node(boost::span<const std::string> path_list) const
+    -> std::optional<NodeId> {
+  if (m_parents.empty()) {
+    return {};
+  }
+
+  auto current_node = get_root_node();
+  for (const auto& current_path : path_list) {
+    // A name that is not in the pool can't be the name of any child
+    const auto name_id = m_names.find(current_path);
+    if (!name_id) {
+      return {};
+    }
+
+    const auto children = get_node_children(current_node);
+    const auto position = std::lower_bound(
+        children.begin(),
+        children.end(),
+        *name_id,
+        [this](NodeId child, NamePool::NameId value)
+        { return m_name_ids[child] < value; });
+    if (position == children.end() || m_name_ids[*position] != *name_id) {
+      return {};
+    }
+    current_node = *position;
+  }
+
+  return current_node;
+}
+auto FrozenFileGraph::get_node_name(NodeId node) const -> std::string_view {
+  if (node == get_root_node()) {
+    return {};
+  }
+  return m_names.get(m_name_ids[node]);
+}
+auto FrozenFileGraph::get_node_parent(NodeId node) const
+    -> std::optional<NodeId> {
+  if (node == get_root_node()) {
+    return {};
+  }
+  return m_parents[node];
+}
+auto FrozenFileGraph::get_node_path(NodeId node) const
+    -> std::vector<std::string> {
+  auto ret = std::vector<std::string> {};
+  for (auto current_node = node; current_node != get_root_node();
+       current_node = m_parents[current_node])
+  {
+    ret.emplace_back(m_names.get(m_name_ids[current_node]));
+  }
+
+  // Reverse the path so it starts at the root
+  std::reverse(ret.begin(), ret.end());
+  return ret;
+}
+auto FrozenFileGraph::get_node_metadata(NodeId node, AttributeKey key) const
+    -> std::optional<VertexAttribute> {
+  const auto* attribute = m_data[node].attributes.find(key);
+  if (attribute == nullptr) {
+    return {};
+  }
+  return *attribute;
+}
+auto FrozenFileGraph::get_node_metadata(NodeId node,
+                                        const std::string& key) const
+    -> std::optional<VertexAttribute> {
+  const auto attribute_key = AttributeKeys::find(key);
+  if (!attribute_key) {
+    return {};
+  }
+  return get_node_metadata(node, *attribute_key);
+}
+auto FrozenFileGraph::thaw() const -> FileGraph {
+  auto graph = FileGraph {};
+  graph.m_names = m_names;
+
+  // Nodes keep their ids, and the children of each node their order
+  for (const auto& data : m_data) {
+    boost::add_vertex(data, graph.m_graph);
+  }
+  for (auto node = NodeId {1}; node < m_parents.size(); ++node) {
+    boost::add_edge(m_parents[node],
+                    node,
+                    EdgeData {m_name_ids[node]},
+                    graph.m_graph);
+  }
+
+  graph.m_root_node = get_root_node();
+  graph.m_columns = m_columns;
+  graph.rebuild_child_index();
+  return graph;
+}
+
+}  // namespace album_architect::files
@@ -0,0 +1,144 @@
+#ifndef ALBUMARCHITECT_FILES_FROZEN_GRAPH_H
+#define ALBUMARCHITECT_FILES_FROZEN_GRAPH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/core/span.hpp>
+
+#include "files/attribute_columns.h"
+#include "files/attribute_map.h"
+#include "files/common.h"
+#include "files/graph.h"
+#include "files/name_pool.h"
+
+namespace album_architect::files {
+
+class MappedFileTree;
+
+/// Read-only version of a FileGraph, laid out in contiguous arrays.
+///
+/// Nodes are numbered in depth-first order starting with the root, so every
+/// subtree is a contiguous range of ids and walking the whole tree is a linear
+/// scan. The children of each node are stored together, sorted by name id,
+/// in a compressed sparse row layout. Created with FileGraph::freeze, and
+/// converted back with thaw when the graph needs to change.
+class FrozenFileGraph {
+public:
+  using NodeId = std::uint32_t;
+
+  /// Creates an empty graph, without root
+  FrozenFileGraph() = default;
+
+  /// Returns the number of nodes, including the root
+  /// \return
+  auto size() const -> std::size_t { return m_parents.size(); }
+
+  /// Returns the root node
+  /// \return
+  static constexpr auto get_root_node() -> NodeId { return 0; }
+
+  /// Returns the ID of the node in the given path
+  /// \param path_list
+  /// \return
+  auto get_node(boost::span<const std::string> path_list) const
+      -> std::optional<NodeId>;
+
+  /// Returns the type of the node
+  /// \param node
+  /// \return
+  auto get_node_type(NodeId node) const -> NodeType {
+    return m_data[node].type;
+  }
+
+  /// Returns the name of the node. The root has an empty name.
+  /// \param node
+  /// \return
+  auto get_node_name(NodeId node) const -> std::string_view;
+
+  /// Returns the parent of the node, if it is not the root
+  /// \param node
+  /// \return
+  auto get_node_parent(NodeId node) const -> std::optional<NodeId>;
+
+  /// Returns the children of the node, sorted by name id
+  /// \param node
+  /// \return
+  auto get_node_children(NodeId node) const -> boost::span<const NodeId> {
+    return {m_children.data() + m_child_offsets[node],
+            m_children.data() + m_child_offsets[node + 1]};
+  }
+
+  /// Returns the end of the subtree of the node. The node and all the nodes
+  /// under it are the ids in [node, end).
+  /// \param node
+  /// \return
+  auto get_subtree_end(NodeId node) const -> NodeId {
+    return m_subtree_ends[node];
+  }
+
+  /// Returns the path from the root to the node
+  /// \param node
+  /// \return
+  auto get_node_path(NodeId node) const -> std::vector<std::string>;
+
+  /// Returns the metadata for the given node, if any
+  /// \param node
+  /// \param key Key to get the value from
+  /// \return Optional with a copy of the attribute
+  auto get_node_metadata(NodeId node, AttributeKey key) const
+      -> std::optional<VertexAttribute>;
+  auto get_node_metadata(NodeId node, const std::string& key) const
+      -> std::optional<VertexAttribute>;
+
+  /// Returns the columns with the well-known attributes of every node
+  /// \return
+  auto get_columns() const -> const AttributeColumns& { return m_columns; }
+
+  /// Returns the fingerprint of the file represented by the node
+  /// \param node
+  /// \return
+  auto get_node_fingerprint(NodeId node) const -> FileFingerprint {
+    return m_data[node].fingerprint;
+  }
+
+  /// Creates a mutable graph with the same content. The NodeId of each node in
+  /// the new graph is the same as in the frozen one.
+  /// \return
+  auto thaw() const -> FileGraph;
+
+private:
+  friend class FileGraph;
+  friend class MappedFileTree;
+
+  /// Names of all the nodes
+  NamePool m_names;
+
+  /// Parent of each node, the root is its own parent
+  std::vector<NodeId> m_parents;
+
+  /// Name of each node
+  std::vector<NamePool::NameId> m_name_ids;
+
+  /// End of the subtree of each node
+  std::vector<NodeId> m_subtree_ends;
+
+  /// Children of node n are m_children[m_child_offsets[n]] up to
+  /// m_children[m_child_offsets[n + 1]]
+  std::vector<std::uint32_t> m_child_offsets;
+  std::vector<NodeId> m_children;
+
+  /// Type, metadata and fingerprint of each node
+  std::vector<VertexData> m_data;
+
+  /// Well-known attributes of each node
+  AttributeColumns m_columns;
+};
+
+}  // namespace album_architect::files
+
+#endif  // ALBUMARCHITECT_FILES_FROZEN_GRAPH_H
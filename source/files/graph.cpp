@@ -3,32 +3,66 @@
 //
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <iterator>
+#include <limits>
+#include <numeric>
 #include <optional>
 #include <ostream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <utility>
+#include <variant>
 #include <vector>
 
 #include "graph.h"
 
-#include <boost/container_hash/hash.hpp>
+#include <boost/archive/archive_exception.hpp>
 #include <boost/core/span.hpp>
 #include <boost/graph/adjacency_list.hpp>
 #include <boost/graph/graphviz.hpp>
 #include <magic_enum/magic_enum.hpp>
 #include <spdlog/spdlog.h>
 
+#include "files/frozen_graph.h"
+#include "helper/cv_mat_operations.h"
+
 namespace album_architect::files {
-FileGraph::FileGraph(bool create_root) {
+namespace {
+/// Source of generations, shared by all the graphs so they never repeat
+std::atomic<std::uint64_t> last_generation = 0;  // NOLINT(*-global-variables)
+
+/// Attributes that stored each hash before the columns
+constexpr auto legacy_hash_names =
+    std::array<std::pair<HashColumn, std::string_view>,
+               AttributeColumns::hash_column_count> {
+        {{HashColumn::average_hash, "_HASH_average_hash_"},
+         {HashColumn::p_hash, "_HASH_p_hash_"}}};
+
+/// Attribute that stored the photo state before the columns
+constexpr auto legacy_state_name = std::string_view {"_PHOTO_STATE_"};
+
+/// Names of the photo states in that attribute, by their value in the column
+constexpr auto legacy_state_values =
+    std::array<std::string_view, 3> {"no_info", "ok", "error"};
+}  // namespace
+
+FileGraph::FileGraph(bool create_root)
+    : m_generation(++last_generation) {
   if (create_root) {
     m_root_node = boost::add_vertex(VertexData {NodeType::directory}, m_graph);
+    m_child_index.resize(boost::num_vertices(m_graph));
+    m_columns.resize(boost::num_vertices(m_graph));
   }
 }
-void FileGraph::add_node(boost::span<std::string> path_list, NodeType type) {
+auto FileGraph::add_node(boost::span<std::string> path_list, NodeType type)
+    -> NodeId {
   // If the path list is empty do not create a new NodeId
   if (path_list.empty()) {
-    return;
+    return m_root_node;
   }
 
   // Try to find the previous NodeId in the cache
@@ -40,8 +74,242 @@ void FileGraph::add_node(boost::span<std::string> path_list, NodeType type) {
 
   // Create the new NodeId
   // TODO: Check if NodeId already exists
+  return create_child(previous_node, path_list.back(), type);
+}
+auto FileGraph::add_children(
+    NodeId parent, boost::span<const std::pair<std::string, NodeType>> children)
+    -> std::vector<NodeId> {
+  auto ret = std::vector<NodeId> {};
+  ret.reserve(children.size());
+
+  m_child_index[parent].reserve(m_child_index[parent].size()
+                                + children.size());
+  for (const auto& [name, type] : children) {
+    ret.push_back(create_child(parent, name, type));
+  }
+
+  return ret;
+}
+auto FileGraph::create_child(NodeId parent,
+                             const std::string& name,
+                             NodeType type) -> NodeId {
+  const auto name_id = m_names.intern(name);
   const auto new_node = boost::add_vertex(VertexData {type}, m_graph);
-  boost::add_edge(previous_node, new_node, EdgeData(path_list.back()), m_graph);
+  boost::add_edge(parent, new_node, EdgeData {name_id}, m_graph);
+
+  // Keep the first node when names are repeated, as a scan of the edges would
+  m_child_index.resize(boost::num_vertices(m_graph));
+  m_child_index[parent].try_emplace(name_id, new_node);
+  m_columns.resize(boost::num_vertices(m_graph));
+  return new_node;
+}
+auto FileGraph::find_child(NodeId parent, const std::string& name) const
+    -> std::optional<NodeId> {
+  // A name that is not in the pool can't be the name of any child
+  const auto name_id = m_names.find(name);
+  if (!name_id) {
+    return {};
+  }
+
+  const auto& children = m_child_index[parent];
+  const auto position = children.find(*name_id);
+  if (position == children.end()) {
+    return {};
+  }
+  return position->second;
+}
+void FileGraph::load_legacy_graph(LegacyGraphType& legacy_graph) {
+  m_graph = GraphType {};
+  m_names = NamePool {};
+  for (auto [vertex, vertex_end] = boost::vertices(legacy_graph);
+       vertex != vertex_end;
+       ++vertex)
+  {
+    boost::add_vertex(std::move(legacy_graph[*vertex]), m_graph);
+  }
+
+  // Keep the order of the children of each node
+  for (auto [vertex, vertex_end] = boost::vertices(legacy_graph);
+       vertex != vertex_end;
+       ++vertex)
+  {
+    for (auto [edge, edge_end] = boost::out_edges(*vertex, legacy_graph);
+         edge != edge_end;
+         ++edge)
+    {
+      boost::add_edge(*vertex,
+                      boost::target(*edge, legacy_graph),
+                      EdgeData {m_names.intern(legacy_graph[*edge].name)},
+                      m_graph);
+    }
+  }
+}
+void FileGraph::move_legacy_attributes() {
+  // Keys that were never registered can't be in any vertex
+  auto hash_keys = std::vector<std::pair<HashColumn, AttributeKey>> {};
+  for (const auto& [column, name] : legacy_hash_names) {
+    if (const auto key = AttributeKeys::find(name)) {
+      hash_keys.emplace_back(column, *key);
+    }
+  }
+  const auto state_key = AttributeKeys::find(legacy_state_name);
+  if (hash_keys.empty() && !state_key) {
+    return;
+  }
+
+  constexpr auto hash_size = std::size_t {8};
+  for (auto [vertex, vertex_end] = boost::vertices(m_graph);
+       vertex != vertex_end;
+       ++vertex)
+  {
+    auto& attributes = m_graph[*vertex].attributes;
+    for (const auto& [column, key] : hash_keys) {
+      const auto value = attributes.erase(key);
+      if (!value || !std::holds_alternative<cv::Mat>(*value)) {
+        continue;
+      }
+      const auto& hash = std::get<cv::Mat>(*value);
+      if (hash.total() == hash_size && hash.type() == CV_8UC1
+          && !m_columns.get_hash(column, *vertex))
+      {
+        m_columns.set_hash(column, *vertex, cvmat::mat_to_uint64(hash));
+      }
+    }
+
+    if (!state_key) {
+      continue;
+    }
+    const auto value = attributes.erase(*state_key);
+    if (!value || !std::holds_alternative<std::string>(*value)
+        || m_columns.get_state(*vertex) != 0)
+    {
+      continue;
+    }
+    const auto position = std::ranges::find(legacy_state_values,
+                                            std::get<std::string>(*value));
+    if (position != legacy_state_values.end()) {
+      m_columns.set_state(*vertex,
+                          static_cast<std::uint8_t>(std::distance(
+                              legacy_state_values.begin(), position)));
+    }
+  }
+}
+void FileGraph::remap_attribute_keys(
+    boost::span<const std::string> key_names) {
+  auto keys = std::vector<AttributeKey> {};
+  keys.reserve(key_names.size());
+  for (const auto& name : key_names) {
+    keys.push_back(AttributeKeys::intern(name));
+  }
+
+  for (auto [vertex, vertex_end] = boost::vertices(m_graph);
+       vertex != vertex_end;
+       ++vertex)
+  {
+    // A corrupt archive can refer to keys that are not in its table
+    auto& attributes = m_graph[*vertex].attributes;
+    if (std::ranges::any_of(attributes,
+                            [&keys](const auto& entry)
+                            { return entry.first.id >= keys.size(); }))
+    {
+      throw boost::archive::archive_exception(
+          boost::archive::archive_exception::input_stream_error);
+    }
+    attributes.remap_keys(keys);
+  }
+}
+void FileGraph::rebuild_child_index() {
+  m_child_index.clear();
+  m_child_index.resize(boost::num_vertices(m_graph));
+  for (auto [edge, edge_end] = boost::edges(m_graph); edge != edge_end; ++edge)
+  {
+    m_child_index[boost::source(*edge, m_graph)].try_emplace(
+        m_graph[*edge].name_id, boost::target(*edge, m_graph));
+  }
+}
+auto FileGraph::freeze() const -> FrozenFileGraph {
+  using FrozenId = FrozenFileGraph::NodeId;
+  if (boost::num_vertices(m_graph) > std::numeric_limits<FrozenId>::max()) {
+    throw std::length_error("The graph is too big to be frozen");
+  }
+
+  auto frozen = FrozenFileGraph {};
+  frozen.m_names = m_names;
+  frozen.m_parents.reserve(boost::num_vertices(m_graph));
+  frozen.m_name_ids.reserve(boost::num_vertices(m_graph));
+  frozen.m_data.reserve(boost::num_vertices(m_graph));
+
+  // Number the nodes in depth-first order, visiting the children sorted by
+  // name id, so the children of each node get increasing ids
+  auto new_ids = std::vector<FrozenId>(boost::num_vertices(m_graph));
+  auto order = std::vector<NodeId> {};
+  order.reserve(boost::num_vertices(m_graph));
+  auto pending = std::vector<NodeId> {m_root_node};
+  auto children = std::vector<std::pair<NamePool::NameId, NodeId>> {};
+  while (!pending.empty()) {
+    const auto current = pending.back();
+    pending.pop_back();
+
+    const auto new_id = static_cast<FrozenId>(frozen.m_parents.size());
+    new_ids[current] = new_id;
+    if (current == m_root_node) {
+      frozen.m_parents.push_back(new_id);
+      frozen.m_name_ids.push_back(0);
+    } else {
+      const auto edge = *boost::in_edges(current, m_graph).first;
+      frozen.m_parents.push_back(new_ids[boost::source(edge, m_graph)]);
+      frozen.m_name_ids.push_back(m_graph[edge].name_id);
+    }
+    frozen.m_data.push_back(m_graph[current]);
+    order.push_back(current);
+
+    children.clear();
+    for (auto [edge, edge_end] = boost::out_edges(current, m_graph);
+         edge != edge_end;
+         ++edge)
+    {
+      children.emplace_back(m_graph[*edge].name_id,
+                            boost::target(*edge, m_graph));
+    }
+    std::sort(children.begin(), children.end());
+    std::transform(children.rbegin(),
+                   children.rend(),
+                   std::back_inserter(pending),
+                   [](const auto& child) { return child.second; });
+  }
+
+  frozen.m_columns = m_columns.select(order);
+
+  // Every subtree ends where the subtree of its last child ends
+  const auto count = frozen.m_parents.size();
+  frozen.m_subtree_ends.resize(count);
+  for (auto node = count; node-- > 0;) {
+    frozen.m_subtree_ends[node] =
+        std::max(frozen.m_subtree_ends[node], static_cast<FrozenId>(node + 1));
+    if (node > 0) {
+      auto& parent_end = frozen.m_subtree_ends[frozen.m_parents[node]];
+      parent_end = std::max(parent_end, frozen.m_subtree_ends[node]);
+    }
+  }
+
+  // Group the children by parent. Going through the nodes in order keeps them
+  // sorted by name id.
+  frozen.m_child_offsets.assign(count + 1, 0);
+  for (auto node = std::size_t {1}; node < count; ++node) {
+    ++frozen.m_child_offsets[frozen.m_parents[node] + 1];
+  }
+  std::partial_sum(frozen.m_child_offsets.begin(),
+                   frozen.m_child_offsets.end(),
+                   frozen.m_child_offsets.begin());
+  frozen.m_children.resize(count > 0 ? count - 1 : 0);
+  auto positions = std::vector<std::uint32_t>(frozen.m_child_offsets.begin(),
+                                              frozen.m_child_offsets.end() - 1);
+  for (auto node = std::size_t {1}; node < count; ++node) {
+    frozen.m_children[positions[frozen.m_parents[node]]++] =
+        static_cast<FrozenId>(node);
+  }
+
+  return frozen;
 }
 void FileGraph::to_graphviz(std::ostream& ostream) const {
   boost::write_graphviz(
@@ -52,13 +320,10 @@ void FileGraph::to_graphviz(std::ostream& ostream) const {
                            magic_enum::enum_name(m_graph[vertex].type));
       },
       [this](std::ostream& out, const auto& edge)
-      { out << fmt::format(" \"{}\"", m_graph[edge].name); });
+      { out << fmt::format(" \"{}\"", m_names.get(m_graph[edge].name_id)); });
 }
 auto FileGraph::rename_node(boost::span<std::string> path_list,
                             const std::string& new_name) -> bool {
-  // TODO: Fix cache, but clear for the time being
-  m_vertex_cache.clear();
-
   // Root NodeId cannot be renamed
   if (path_list.empty()) {
     spdlog::error("Cannot rename root NodeId");
@@ -72,7 +337,86 @@ auto FileGraph::rename_node(boost::span<std::string> path_list,
   }
 
   auto [edge, node] = *node_data;
-  m_graph[edge].name = new_name;
+  const auto new_name_id = m_names.intern(new_name);
+  if (m_graph[edge].name_id == new_name_id) {
+    return true;
+  }
+
+  // Names must be unique among siblings
+  auto& siblings = m_child_index[boost::source(edge, m_graph)];
+  if (siblings.contains(new_name_id)) {
+    spdlog::error("Cannot rename to {}, the name is already in use", new_name);
+    return false;
+  }
+
+  siblings.erase(m_graph[edge].name_id);
+  siblings.emplace(new_name_id, node);
+  m_graph[edge].name_id = new_name_id;
+
+  auto new_path = std::vector<std::string>(path_list.begin(), path_list.end());
+  new_path.back() = new_name;
+  rebase_cache(path_list, new_path);
+  return true;
+}
+auto FileGraph::detach_node(NodeId node) -> bool {
+  if (node == m_root_node) {
+    return false;
+  }
+
+  auto [edges_b, edges_e] = boost::in_edges(node, m_graph);
+  if (edges_b == edges_e) {
+    return false;
+  }
+
+  evict_from_cache(get_node_path(node));
+  m_child_index[boost::source(*edges_b, m_graph)].erase(
+      m_graph[*edges_b].name_id);
+  boost::remove_edge(*edges_b, m_graph);
+  return true;
+}
+auto FileGraph::move_node(boost::span<std::string> old_path,
+                          boost::span<std::string> new_path,
+                          bool force) -> bool {
+  // Root NodeId cannot be moved
+  if (old_path.empty() || new_path.empty()) {
+    spdlog::error("Cannot move root NodeId");
+    return false;
+  }
+
+  // A node cannot be moved inside itself
+  if (new_path.size() >= old_path.size()
+      && std::equal(old_path.begin(), old_path.end(), new_path.begin()))
+  {
+    return false;
+  }
+
+  if (!get_node_data(old_path)) {
+    return false;
+  }
+
+  // Check the destination
+  if (auto destination = get_node_data(new_path)) {
+    if (!force) {
+      return false;
+    }
+    const auto destination_node = destination->second;
+    remove_nodes({&destination_node, 1});
+  }
+
+  // Get the data again, as the removal could have changed the NodeId
+  auto [edge, node] = get_node_data(old_path).value();
+  auto edge_data = m_graph[edge];
+  edge_data.name_id = m_names.intern(new_path.back());
+
+  const auto new_parent = new_path.size() > 1
+      ? get_or_create_nodes(new_path.subspan(0, new_path.size() - 1))
+      : m_root_node;
+  m_child_index[boost::source(edge, m_graph)].erase(m_graph[edge].name_id);
+  m_child_index[new_parent].try_emplace(edge_data.name_id, node);
+  boost::remove_edge(edge, m_graph);
+  boost::add_edge(new_parent, node, std::move(edge_data), m_graph);
+
+  rebase_cache(old_path, new_path);
   return true;
 }
 auto FileGraph::get_node_data(boost::span<const std::string> path_list)
@@ -83,81 +427,100 @@ auto FileGraph::get_node_data(boost::span<const std::string> path_list)
   auto current_edge = GraphType::edge_descriptor {};
 
   for (const auto& current_path : path_list) {
-    auto [start, end] = boost::out_edges(current_node, m_graph);
-    auto edge_iter = std::find_if(start,
-                                  end,
-                                  [this, &current_path](auto iter) {
-                                    return m_graph[iter].name == current_path;
-                                  });
-
-    if (edge_iter == end) {
+    const auto child = find_child(current_node, current_path);
+    if (!child) {
       // The path was not found
       return {};
     }
 
-    // Get the current info
-    current_edge = *edge_iter;
-    current_node = boost::target(*edge_iter, m_graph);
+    // Get the current info, every node but the root has a single in-edge
+    current_node = *child;
+    current_edge = *boost::in_edges(current_node, m_graph).first;
   }
 
   return std::make_pair(current_edge, current_node);
 }
-auto FileGraph::get_node_from_cache(boost::span<const std::string> path_list)
-    -> std::optional<GraphType::vertex_descriptor> {
-  const auto hash = boost::hash_value(path_list);
-  const auto cache_iterator = m_vertex_cache.find(hash);
-  if (cache_iterator != m_vertex_cache.end()) {
-    return std::make_optional(cache_iterator->second);
+auto FileGraph::make_cache_key(boost::span<const std::string> path_list)
+    -> std::string {
+  auto key = std::string {};
+  for (const auto& name : path_list) {
+    if (!key.empty()) {
+      key.push_back(cache_key_separator);
+    }
+    key.append(name);
   }
-  return {};
+  return key;
 }
-void FileGraph::add_node_to_cache(boost::span<const std::string> path_list,
-                                  GraphType::vertex_descriptor vertex) {
-  auto hash = boost::hash_value(path_list);
-  m_vertex_cache[hash] = vertex;
+auto FileGraph::evict_from_cache(boost::span<const std::string> path_list)
+    -> std::vector<std::pair<std::string, NodeId>> {
+  const auto key = make_cache_key(path_list);
+  const auto is_in_subtree = [&key](const std::string& cached_key)
+  {
+    return cached_key.starts_with(key)
+        && (cached_key.size() == key.size()
+            || cached_key[key.size()] == cache_key_separator);
+  };
+
+  // The separator sorts before any other character, so the whole subtree is
+  // right after the key itself
+  auto ret = std::vector<std::pair<std::string, NodeId>> {};
+  auto position = m_vertex_cache.lower_bound(key);
+  while (position != m_vertex_cache.end() && is_in_subtree(position->first)) {
+    ret.emplace_back(position->first, position->second);
+    position = m_vertex_cache.erase(position);
+  }
+  return ret;
+}
+void FileGraph::rebase_cache(boost::span<const std::string> old_path,
+                             boost::span<const std::string> new_path) {
+  const auto old_key_size = make_cache_key(old_path).size();
+  const auto new_key = make_cache_key(new_path);
+  for (auto& [key, node] : evict_from_cache(old_path)) {
+    m_vertex_cache.insert_or_assign(new_key + key.substr(old_key_size), node);
+  }
 }
 auto FileGraph::get_or_create_nodes(boost::span<const std::string> path_list)
     -> GraphType::vertex_descriptor {
   // Try to find in the cache
-  const auto cached_node = get_node_from_cache(path_list);
-  if (cached_node) {
-    return cached_node.value();
+  const auto key = make_cache_key(path_list);
+  if (const auto cached = m_vertex_cache.find(key);
+      cached != m_vertex_cache.end())
+  {
+    return cached->second;
   }
 
   // Iterate through the graph to find the NodeId, and create any intermediary
   // nodes as directories
   auto current_node = m_root_node;
+  auto prefix = std::string {};
+  prefix.reserve(key.size());
   bool last_was_created =
       false;  // Set to true on the first edge that is created. Afterward every
               // edge should be created.
 
   // Iterate through every member of the path list
   for (const auto& current_path : path_list) {
+    if (!prefix.empty()) {
+      prefix.push_back(cache_key_separator);
+    }
+    prefix.append(current_path);
+
     if (!last_was_created) {
       // Find among the nodes
-      auto [start, end] = boost::out_edges(current_node, m_graph);
-      auto found_edge =
-          std::find_if(start,
-                       end,
-                       [this, &current_path](auto iter)
-                       { return m_graph[iter].name == current_path; });
-
-      if (found_edge == end) {
-        last_was_created = true;
-      } else {
-        current_node = boost::target(*found_edge, m_graph);
+      if (const auto child = find_child(current_node, current_path)) {
+        current_node = *child;
+        m_vertex_cache.insert_or_assign(prefix, current_node);
         continue;
       }
+      last_was_created = true;
     }
 
     // Create the new NodeId
-    const auto new_node =
-        boost::add_vertex(VertexData {NodeType::directory}, m_graph);
-    boost::add_edge(current_node, new_node, EdgeData {current_path}, m_graph);
-    current_node = new_node;
+    current_node =
+        create_child(current_node, current_path, NodeType::directory);
 
-    // Add the NodeId to the cache
-    add_node_to_cache(path_list, current_node);
+    // Add every prefix to the cache
+    m_vertex_cache.insert_or_assign(prefix, current_node);
   }
 
   return current_node;
@@ -222,6 +585,104 @@ auto FileGraph::get_node_children(FileGraph::NodeId node_id)
 
   return ret;
 }
+auto FileGraph::get_node_parent(FileGraph::NodeId node_id) const
+    -> std::optional<NodeId> {
+  auto [edges_b, edges_e] = boost::in_edges(node_id, m_graph);
+  if (edges_b == edges_e) {
+    return {};
+  }
+  return boost::source(*edges_b, m_graph);
+}
+void FileGraph::renew_generation() {
+  m_generation = ++last_generation;
+}
+auto FileGraph::get_node_name(FileGraph::NodeId node_id) const -> std::string {
+  auto [edges_b, edges_e] = boost::in_edges(node_id, m_graph);
+  if (edges_b == edges_e) {
+    return {};
+  }
+  return std::string {m_names.get(m_graph[*edges_b].name_id)};
+}
+void FileGraph::remove_nodes(boost::span<const NodeId> nodes) {
+  // Mark the nodes along with all their descendants
+  auto removed = std::vector<bool>(boost::num_vertices(m_graph), false);
+  auto pending = std::vector<NodeId>(nodes.begin(), nodes.end());
+  while (!pending.empty()) {
+    const auto current = pending.back();
+    pending.pop_back();
+    if (current == m_root_node || removed[current]) {
+      continue;
+    }
+
+    removed[current] = true;
+    auto [begin, end] = boost::out_edges(current, m_graph);
+    std::transform(begin,
+                   end,
+                   std::back_inserter(pending),
+                   [this](auto edge) { return boost::target(edge, m_graph); });
+  }
+
+  // Removing vertices one by one renumbers the graph on each removal, so
+  // instead rebuild it with the remaining vertices in their current order
+  auto new_graph = GraphType {};
+  auto new_ids = std::vector<NodeId>(boost::num_vertices(m_graph));
+  auto kept = std::vector<NodeId> {};
+  for (auto [vertex, vertex_end] = boost::vertices(m_graph);
+       vertex != vertex_end;
+       ++vertex)
+  {
+    if (!removed[*vertex]) {
+      new_ids[*vertex] =
+          boost::add_vertex(std::move(m_graph[*vertex]), new_graph);
+      kept.push_back(*vertex);
+    }
+  }
+
+  // The pool is rebuilt with the names of the remaining nodes, so names of
+  // removed and renamed nodes don't accumulate
+  auto new_names = NamePool {};
+  for (auto [vertex, vertex_end] = boost::vertices(m_graph);
+       vertex != vertex_end;
+       ++vertex)
+  {
+    if (removed[*vertex]) {
+      continue;
+    }
+
+    for (auto [edge, edge_end] = boost::out_edges(*vertex, m_graph);
+         edge != edge_end;
+         ++edge)
+    {
+      const auto target = boost::target(*edge, m_graph);
+      if (!removed[target]) {
+        boost::add_edge(
+            new_ids[*vertex],
+            new_ids[target],
+            EdgeData {new_names.intern(m_names.get(m_graph[*edge].name_id))},
+            new_graph);
+      }
+    }
+  }
+
+  m_root_node = new_ids[m_root_node];
+  m_graph = std::move(new_graph);
+  m_names = std::move(new_names);
+  m_columns = m_columns.select(kept);
+  rebuild_child_index();
+  renew_generation();
+
+  // Keep the cached paths of the remaining nodes
+  for (auto position = m_vertex_cache.begin();
+       position != m_vertex_cache.end();)
+  {
+    if (removed[position->second]) {
+      position = m_vertex_cache.erase(position);
+    } else {
+      position->second = new_ids[position->second];
+      ++position;
+    }
+  }
+}
 auto FileGraph::get_node_path(FileGraph::NodeId node_id)
     -> std::vector<std::string> {
   auto ret = std::vector<std::string> {};
@@ -240,7 +701,7 @@ auto FileGraph::get_node_path(FileGraph::NodeId node_id)
     }
 
     auto edge = *edges_b;
-    ret.push_back(m_graph[edge].name);
+    ret.emplace_back(m_names.get(m_graph[edge].name_id));
     current_node = boost::source(edge, m_graph);
   }
 
@@ -249,37 +710,83 @@ auto FileGraph::get_node_path(FileGraph::NodeId node_id)
 
   return ret;
 }
+auto FileGraph::set_node_metadata(FileGraph::NodeId node,
+                                  AttributeKey key,
+                                  const VertexAttribute& attribute)
+    -> std::optional<VertexAttribute> {
+  return m_graph[node].attributes.insert_or_assign(key, attribute);
+}
 auto FileGraph::set_node_metadata(FileGraph::NodeId node,
                                   const std::string& key,
                                   const VertexAttribute& attribute)
     -> std::optional<VertexAttribute> {
-  // Try removing first
-  auto previous = remove_node_metadata(node, key);
-
-  // Add new key
-  m_graph[node].attributes[key] = attribute;
-  return previous;
+  return set_node_metadata(node, AttributeKeys::intern(key), attribute);
 }
 auto FileGraph::get_node_metadata(FileGraph::NodeId node,
-                                  const std::string& key)
+                                  AttributeKey key) const
     -> std::optional<VertexAttribute> {
-  auto position = m_graph[node].attributes.find(key);
-  if (position == m_graph[node].attributes.end()) {
+  const auto* attribute = m_graph[node].attributes.find(key);
+  if (attribute == nullptr) {
     return {};
   }
-  return position->second;
+  return *attribute;
+}
+auto FileGraph::get_node_metadata(FileGraph::NodeId node,
+                                  const std::string& key) const
+    -> std::optional<VertexAttribute> {
+  // A key that was never registered can't be in any node
+  const auto attribute_key = AttributeKeys::find(key);
+  if (!attribute_key) {
+    return {};
+  }
+  return get_node_metadata(node, *attribute_key);
+}
+auto FileGraph::remove_node_metadata(FileGraph::NodeId node, AttributeKey key)
+    -> std::optional<VertexAttribute> {
+  return m_graph[node].attributes.erase(key);
 }
 auto FileGraph::remove_node_metadata(FileGraph::NodeId node,
                                      const std::string& key)
     -> std::optional<VertexAttribute> {
-  auto position = m_graph[node].attributes.find(key);
-  if (position == m_graph[node].attributes.end()) {
+  const auto attribute_key = AttributeKeys::find(key);
+  if (!attribute_key) {
     return {};
   }
-
-  auto previous_element = std::make_optional(std::move(position->second));
-  m_graph[node].attributes.erase(position);
-  return previous_element;
+  return remove_node_metadata(node, *attribute_key);
+}
+void FileGraph::clear_node_metadata(FileGraph::NodeId node) {
+  m_graph[node].attributes.clear();
+  m_columns.clear(node);
+}
+auto FileGraph::take_node_metadata(FileGraph::NodeId node) -> NodeMetadata {
+  auto ret = NodeMetadata {};
+  ret.attributes = std::exchange(m_graph[node].attributes, {});
+  for (auto index = std::size_t {0}; index < ret.hashes.size(); ++index) {
+    ret.hashes[index] =
+        m_columns.get_hash(static_cast<HashColumn>(index), node);
+  }
+  ret.state = m_columns.get_state(node);
+  m_columns.clear(node);
+  return ret;
+}
+void FileGraph::restore_node_metadata(FileGraph::NodeId node,
+                                      NodeMetadata metadata) {
+  m_graph[node].attributes = std::move(metadata.attributes);
+  m_columns.clear(node);
+  for (auto index = std::size_t {0}; index < metadata.hashes.size(); ++index) {
+    if (const auto& hash = metadata.hashes[index]) {
+      m_columns.set_hash(static_cast<HashColumn>(index), node, *hash);
+    }
+  }
+  m_columns.set_state(node, metadata.state);
+}
+void FileGraph::set_node_fingerprint(FileGraph::NodeId node,
+                                     const FileFingerprint& fingerprint) {
+  m_graph[node].fingerprint = fingerprint;
+}
+auto FileGraph::get_node_fingerprint(FileGraph::NodeId node) const
+    -> FileFingerprint {
+  return m_graph[node].fingerprint;
 }
 
 auto operator<<(std::ostream& ostream, const NodeType& node) -> std::ostream& {
@@ -294,8 +801,13 @@ auto operator<<(std::ostream& ostream, const NodeType& node) -> std::ostream& {
 
   return ostream;
 }
-EdgeData::EdgeData(std::string name)
-    : name(std::move(name)) {}
+EdgeData::EdgeData(NamePool::NameId name_id)
+    : name_id(name_id) {}
+auto NodeMetadata::empty() const -> bool {
+  return attributes.empty() && state == 0
+      && std::ranges::none_of(
+             hashes, [](const auto& hash) { return hash.has_value(); });
+}
 auto VertexData::operator==(const VertexData& rhs) const -> bool {
   //  return type == rhs.type && attributes == rhs.attributes;
   return type == rhs.type;
@@ -5,25 +5,33 @@
 #ifndef ALBUMARCHITECT_GRAPH_H
 #define ALBUMARCHITECT_GRAPH_H
 
+#include <array>
 #include <cstddef>
 #include <cstdint>
 #include <optional>
 #include <ostream>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include <absl/container/btree_map.h>
+#include <absl/container/flat_hash_map.h>
 #include <boost/core/span.hpp>
 #include <boost/graph/adj_list_serialize.hpp>
 #include <boost/graph/adjacency_list.hpp>
 #include <boost/graph/graph_selectors.hpp>
 #include <boost/serialization/map.hpp>
+#include <boost/serialization/split_member.hpp>
 #include <boost/serialization/string.hpp>
 #include <boost/serialization/variant.hpp>
+#include <boost/serialization/version.hpp>
 #include <helper/boost_serialization_cvmat.h>
 #include <opencv2/core.hpp>
 
+#include "files/attribute_columns.h"
+#include "files/attribute_map.h"
 #include "files/common.h"
+#include "files/name_pool.h"
 
 namespace album_architect::files {
 
@@ -32,8 +40,7 @@ namespace album_architect::files {
 class VertexData {
 public:
   /// Initialization constructor
-  explicit VertexData(NodeType type,
-                      std::map<std::string, VertexAttribute> attributes = {})
+  explicit VertexData(NodeType type, AttributeMap attributes = {})
       : type(type)
       , attributes(std::move(attributes)) {}
 
@@ -41,15 +48,40 @@ public:
   VertexData() = default;
 
   NodeType type = NodeType::directory;
-  std::map<std::string, VertexAttribute> attributes;
+  AttributeMap attributes;
+  FileFingerprint fingerprint;
 
-  /// Serialize object
+  /// Serialize object. The keys of the attributes are written as ids, which
+  /// FileGraph maps back with the key table.
   template<class Archive>
-  void serialize(Archive& archive, const unsigned int /*version*/) {
+  void save(Archive& archive, const unsigned int /*version*/) const {
     archive & type;
     archive & attributes;
+    archive & fingerprint;
+  }
+
+  /// Deserialize object. Versions before 2 stored the name of every key.
+  template<class Archive>
+  void load(Archive& archive, const unsigned int version) {
+    archive & type;
+    if (version > 1) {
+      archive & attributes;
+    } else {
+      auto named_attributes = std::map<std::string, VertexAttribute> {};
+      archive & named_attributes;
+      attributes.clear();
+      for (auto& [name, attribute] : named_attributes) {
+        attributes.insert_or_assign(AttributeKeys::intern(name),
+                                    std::move(attribute));
+      }
+    }
+    if (version > 0) {
+      archive & fingerprint;
+    }
   }
 
+  BOOST_SERIALIZATION_SPLIT_MEMBER()
+
   auto operator==(const VertexData& rhs) const -> bool;
   auto operator!=(const VertexData& rhs) const -> bool;
 };
@@ -57,14 +89,28 @@ public:
 /// Represents elements associated to edges
 class EdgeData {
 public:
-  std::string name;
+  /// Name of the target node, in the NamePool of the graph
+  NamePool::NameId name_id = 0;
 
   /// Initialization constructor
-  explicit EdgeData(std::string name);
+  explicit EdgeData(NamePool::NameId name_id);
 
   /// Default constructor
   EdgeData() = default;
 
+  /// Serialize object
+  template<class Archive>
+  void serialize(Archive& archive, const unsigned int /*version*/) {
+    archive & name_id;
+  }
+};
+
+/// Edge data as stored before names were interned. Only used for reading old
+/// archives.
+class LegacyEdgeData {
+public:
+  std::string name;
+
   /// Serialize object
   template<class Archive>
   void serialize(Archive& archive, const unsigned int /*version*/) {
@@ -72,6 +118,20 @@ public:
   }
 };
 
+/// All the metadata of a node, taken out of the graph
+struct NodeMetadata {
+  AttributeMap attributes;
+  std::array<std::optional<std::uint64_t>, AttributeColumns::hash_column_count>
+      hashes;
+  std::uint8_t state = 0;
+
+  /// Returns true if there is no metadata
+  /// \return
+  auto empty() const -> bool;
+};
+
+class FrozenFileGraph;
+
 // Type used for representing the internal graph
 using GraphType = boost::adjacency_list<boost::vecS,
                                         boost::vecS,
@@ -79,10 +139,16 @@ using GraphType = boost::adjacency_list<boost::vecS,
                                         VertexData,
                                         EdgeData>;
 
+// Type of the graph in old archives
+using LegacyGraphType = boost::adjacency_list<boost::vecS,
+                                              boost::vecS,
+                                              boost::bidirectionalS,
+                                              VertexData,
+                                              LegacyEdgeData>;
+
 /// Represent a filesystem with graphs
 class FileGraph {
 public:
-  using PathHash = std::size_t;
   using NodeId = GraphType::vertex_descriptor;
 
   /// Creates the root NodeId of the FileGraph
@@ -90,7 +156,18 @@ public:
 
   /// Creates a new NodeId with all the intermediate representations
   /// \param path_list
-  void add_node(boost::span<std::string> path_list, NodeType type);
+  /// \return The new NodeId, or the root if the path list is empty
+  auto add_node(boost::span<std::string> path_list, NodeType type) -> NodeId;
+
+  /// Adds all the given children directly under an existing node. This allows
+  /// splicing a whole directory listing in a single operation.
+  /// \param parent Node that will contain the children
+  /// \param children Name and type of each child
+  /// \return The NodeId of each child, in the same order as given
+  auto add_children(
+      NodeId parent,
+      boost::span<const std::pair<std::string, NodeType>> children)
+      -> std::vector<NodeId>;
 
   /// Returns the type of the NodeId if it exists.
   /// \param path_list
@@ -108,6 +185,10 @@ public:
   /// \param key Key to store the attribute with
   /// \param attribute Attribute to add to the node
   /// \return Previous attribute if any
+  auto set_node_metadata(FileGraph::NodeId node,
+                         AttributeKey key,
+                         const VertexAttribute& attribute)
+      -> std::optional<VertexAttribute>;
   auto set_node_metadata(FileGraph::NodeId node,
                          const std::string& key,
                          const VertexAttribute& attribute)
@@ -117,21 +198,75 @@ public:
   /// \param node
   /// \param key Key to get the value from
   /// \return Optional with a copy of the attribute
-  auto get_node_metadata(FileGraph::NodeId node, const std::string& key)
+  auto get_node_metadata(FileGraph::NodeId node, AttributeKey key) const
+      -> std::optional<VertexAttribute>;
+  auto get_node_metadata(FileGraph::NodeId node, const std::string& key) const
       -> std::optional<VertexAttribute>;
 
   /// Removes the metadata from the node with the given key
   /// \param node
   /// \param key Key to get the value from
   /// \return Optional with the removed attribute
+  auto remove_node_metadata(FileGraph::NodeId node, AttributeKey key)
+      -> std::optional<VertexAttribute>;
   auto remove_node_metadata(FileGraph::NodeId node, const std::string& key)
       -> std::optional<VertexAttribute>;
 
+  /// Removes all the metadata from the node, including its column values
+  /// \param node
+  void clear_node_metadata(FileGraph::NodeId node);
+
+  /// Moves all the metadata out of the node, including its column values
+  /// \param node
+  /// \return
+  auto take_node_metadata(FileGraph::NodeId node) -> NodeMetadata;
+
+  /// Replaces all the metadata of the node
+  /// \param node
+  /// \param metadata
+  void restore_node_metadata(FileGraph::NodeId node, NodeMetadata metadata);
+
+  /// Returns the names of the nodes
+  /// \return
+  auto get_names() const -> const NamePool& { return m_names; }
+
+  /// Returns the columns with the well-known attributes of every node
+  /// \return
+  auto get_columns() -> AttributeColumns& { return m_columns; }
+  auto get_columns() const -> const AttributeColumns& { return m_columns; }
+
+  /// Sets the fingerprint of the file represented by the node
+  /// \param node
+  /// \param fingerprint
+  void set_node_fingerprint(FileGraph::NodeId node,
+                            const FileFingerprint& fingerprint);
+
+  /// Returns the fingerprint of the file represented by the node
+  /// \param node
+  /// \return
+  auto get_node_fingerprint(FileGraph::NodeId node) const -> FileFingerprint;
+
   /// Returns the children of the given node
   /// \param node_id
   /// \return
   auto get_node_children(NodeId node_id) -> std::vector<NodeId>;
 
+  /// Returns the parent of the given node
+  /// \param node_id
+  /// \return None for the root and detached nodes
+  auto get_node_parent(NodeId node_id) const -> std::optional<NodeId>;
+
+  /// Returns an identifier of the current numbering of the nodes. It changes
+  /// every time that previously returned NodeIds are invalidated, and is never
+  /// shared between different graphs.
+  /// \return
+  auto get_generation() const -> std::uint64_t { return m_generation; }
+
+  /// Returns the name of the given node. The root has an empty name.
+  /// \param node_id
+  /// \return
+  auto get_node_name(NodeId node_id) const -> std::string;
+
   /// Returns the path from a given node
   /// \param node_id
   /// \return
@@ -140,44 +275,162 @@ public:
   /// Changes the name of a NodeId with the new name
   /// \param path_list
   /// \param new_name
+  /// \return False if the node doesn't exist or a sibling has the new name
   auto rename_node(boost::span<std::string> path_list,
                    const std::string& new_name) -> bool;
 
-  /// Moves a NodeId to a new path, conserving all sub-nodes
-  /// TODO: Added at a later time, as it requires a merge operation
+  /// Removes the given nodes along with all their sub-nodes. The root cannot be
+  /// removed. All the removals are done in one pass, and every NodeId
+  /// previously returned is invalidated. Names that no remaining node uses
+  /// are dropped from the pool.
+  /// \param nodes
+  void remove_nodes(boost::span<const NodeId> nodes);
+
+  /// Detaches the node from its parent, so it can't be reached anymore. The
+  /// node and its sub-nodes keep their NodeId until they are removed with
+  /// remove_nodes, which allows detaching many nodes and removing them at once.
+  /// \param node
+  /// \return False for the root or nodes that were already detached
+  auto detach_node(NodeId node) -> bool;
+
+  /// Moves a NodeId to a new path, conserving all sub-nodes. Any missing
+  /// intermediate directories of the new path are created. Directories are not
+  /// merged: if the new path exists it is replaced when forced, which
+  /// invalidates every NodeId as in remove_nodes.
   /// \param old_path
   /// \param new_path
-  /// \param force
-  /// \return
+  /// \param force Replace the node in the new path if it exists
+  /// \return True if the node was moved
   auto move_node(boost::span<std::string> old_path,
                  boost::span<std::string> new_path,
                  bool force = false) -> bool;
 
+  /// Creates a read-only copy of the graph in a compact layout. Nodes that are
+  /// detached are not included. Needs files/frozen_graph.h.
+  /// \return
+  auto freeze() const -> FrozenFileGraph;
+
   /// Returns the GraphViz representation of the map. For debugging purposes.
   /// \return
   void to_graphviz(std::ostream& ostream) const;
 
-  /// Enable serialization for the graph
+  /// Enable serialization for the graph. Every name is written once.
   /// \tparam Archive
   /// \param archive
   /// \param version
   template<class Archive>
-  void serialize(Archive& archive, unsigned int /* version */) {
+  void save(Archive& archive, unsigned int /* version */) const {
+    const auto key_names = AttributeKeys::get_names();
+    archive & m_names;
+    archive & key_names;
     archive & m_graph;
     archive & m_root_node;
+    archive & m_columns;
+  }
+
+  /// Enable deserialization for the graph. Version 0 stored every name in
+  /// its edge, versions before 2 had no columns and versions before 3 stored
+  /// the name of every attribute key in its vertex. Hashes and states that
+  /// were stored as attributes are moved to the columns.
+  /// \tparam Archive
+  /// \param archive
+  /// \param version
+  template<class Archive>
+  void load(Archive& archive, unsigned int version) {
+    if (version == 0) {
+      auto legacy_graph = LegacyGraphType {};
+      archive & legacy_graph;
+      load_legacy_graph(legacy_graph);
+    } else if (version < 3) {
+      archive & m_names;
+      archive & m_graph;
+    } else {
+      auto key_names = std::vector<std::string> {};
+      archive & m_names;
+      archive & key_names;
+      archive & m_graph;
+      remap_attribute_keys(key_names);
+    }
+    archive & m_root_node;
+    m_columns = AttributeColumns {};
+    if (version > 1) {
+      archive & m_columns;
+    }
+    m_columns.resize(boost::num_vertices(m_graph));
+    move_legacy_attributes();
+
+    // The child index is not stored, as it can be derived from the graph
+    rebuild_child_index();
+    renew_generation();
   }
 
+  BOOST_SERIALIZATION_SPLIT_MEMBER()
+
   /// Comparison operators
   auto operator==(const FileGraph& rhs) const -> bool;
   auto operator!=(const FileGraph& rhs) const -> bool;
 
 private:
+  friend class FrozenFileGraph;
+
+  /// Names of all the nodes
+  NamePool m_names;
+
   /// Internal graph
   GraphType m_graph;
   GraphType::vertex_descriptor m_root_node;
 
-  /// Cache for efficient lookup
-  absl::btree_map<PathHash, GraphType::vertex_descriptor> m_vertex_cache;
+  /// Well-known attributes of every node, indexed by NodeId
+  AttributeColumns m_columns;
+
+  /// Identifies the current numbering of the nodes
+  std::uint64_t m_generation = 0;
+
+  /// Marks every NodeId previously returned as invalid
+  void renew_generation();
+
+  /// Separates the names in the keys of the cache. It can't be part of a name.
+  static constexpr auto cache_key_separator = '\0';
+
+  /// Cache for efficient lookup of directories, by their full path. Ordered so
+  /// the paths of a whole subtree can be updated together.
+  absl::btree_map<std::string, NodeId> m_vertex_cache;
+
+  /// Children of every node by name, indexed by NodeId. Allows finding a child
+  /// without going through all the out-edges of its parent.
+  std::vector<absl::flat_hash_map<NamePool::NameId, NodeId>> m_child_index;
+
+  /// Creates a new node under the given parent
+  /// \param parent
+  /// \param name
+  /// \param type
+  /// \return
+  auto create_child(NodeId parent, const std::string& name, NodeType type)
+      -> NodeId;
+
+  /// Returns the child of the node with the given name, if it exists
+  /// \param parent
+  /// \param name
+  /// \return
+  auto find_child(NodeId parent, const std::string& name) const
+      -> std::optional<NodeId>;
+
+  /// Replaces the graph with one read from an old archive
+  /// \param legacy_graph
+  void load_legacy_graph(LegacyGraphType& legacy_graph);
+
+  /// Creates the child index again from the edges of the graph
+  void rebuild_child_index();
+
+  /// Moves the hashes and photo states that caches written before the
+  /// columns kept in the attributes of the vertices into the columns
+  void move_legacy_attributes();
+
+  /// Changes the attribute keys read from an archive into the keys of the
+  /// process. Throws boost::archive::archive_exception if a vertex has a key
+  /// id that is not in the table.
+  /// \param key_names Name of each key id in the archive
+  void remap_attribute_keys(boost::span<const std::string> key_names);
 
   /// Returns a NodeId with the edge that goes into it, if it exists
   /// \param path_list
@@ -192,19 +445,31 @@ private:
   auto get_or_create_nodes(boost::span<const std::string> path_list)
       -> GraphType::vertex_descriptor;
 
-  /// Returns a NodeId from the cache if it exists
+  /// Returns the key used in the cache for the path list
   /// \param path_list
   /// \return
-  auto get_node_from_cache(boost::span<const std::string> path_list)
-      -> std::optional<GraphType::vertex_descriptor>;
+  static auto make_cache_key(boost::span<const std::string> path_list)
+      -> std::string;
 
-  /// Adds a NodeId to the cache
+  /// Removes the path list and everything under it from the cache
   /// \param path_list
-  /// \param vertex
-  void add_node_to_cache(boost::span<const std::string> path_list,
-                         GraphType::vertex_descriptor vertex);
+  /// \return The removed entries
+  auto evict_from_cache(boost::span<const std::string> path_list)
+      -> std::vector<std::pair<std::string, NodeId>>;
+
+  /// Updates the cached entries of a subtree that changed its path
+  /// \param old_path
+  /// \param new_path
+  void rebase_cache(boost::span<const std::string> old_path,
+                    boost::span<const std::string> new_path);
 };
 
 }  // namespace album_architect::files
 
+// Version 1 adds the file fingerprint, version 2 stores attribute key ids
+BOOST_CLASS_VERSION(album_architect::files::VertexData, 2)
+// Version 1 stores the names in a NamePool, version 2 adds the columns and
+// version 3 the attribute key table
+BOOST_CLASS_VERSION(album_architect::files::FileGraph, 3)
+
 #endif  // ALBUMARCHITECT_GRAPH_H
@@ -2,13 +2,21 @@
 // Created by Jorge on 14/05/2024.
 //
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <filesystem>
+#include <optional>
 
 #include "helper.h"
 
 #include <boost/filesystem/operations.hpp>
 #include <spdlog/spdlog.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#  include <sys/stat.h>
+#endif
+
 namespace album_architect::files {
 
 namespace fs = std::filesystem;
@@ -60,4 +68,82 @@ TemporaryFile::~TemporaryFile() {
 auto TemporaryFile::get_path() const -> std::filesystem::path {
   return m_path;
 }
+TemporaryDirectory::TemporaryDirectory() {
+  auto path = boost::filesystem::unique_path();
+  m_path = std::filesystem::temp_directory_path() / path.string();
+  std::filesystem::create_directories(m_path);
+}
+TemporaryDirectory::~TemporaryDirectory() {
+  if (m_path.empty()) {
+    return;
+  }
+
+  auto has_error = std::error_code {};
+  std::filesystem::remove_all(m_path, has_error);
+  if (has_error) {
+    spdlog::error("Couldn't delete temporary directory: {}. Error: {}",
+                  m_path.string(),
+                  has_error.message());
+  }
+}
+auto TemporaryDirectory::get_path() const -> std::filesystem::path {
+  return m_path;
+}
+auto rebase_path(const std::filesystem::path& path,
+                 const std::filesystem::path& old_base,
+                 const std::filesystem::path& new_base)
+    -> std::optional<std::filesystem::path> {
+  auto [base_end, path_end] =
+      std::mismatch(old_base.begin(), old_base.end(), path.begin(), path.end());
+  if (base_end != old_base.end()) {
+    return {};
+  }
+
+  auto rebased = new_base;
+  for (; path_end != path.end(); ++path_end) {
+    rebased /= *path_end;
+  }
+  return rebased;
+}
+auto get_file_fingerprint(const std::filesystem::path& path)
+    -> std::optional<FileFingerprint> {
+#if defined(__unix__) || defined(__APPLE__)
+  struct stat status {};
+  if (::stat(path.c_str(), &status) != 0) {
+    return {};
+  }
+
+  constexpr auto nanoseconds_per_second = std::int64_t {1'000'000'000};
+#  if defined(__APPLE__)
+  const auto& modification_time = status.st_mtimespec;
+#  else
+  const auto& modification_time = status.st_mtim;
+#  endif
+  return FileFingerprint {
+      .size = static_cast<std::uint64_t>(status.st_size),
+      .mtime_ns = static_cast<std::int64_t>(modification_time.tv_sec)
+              * nanoseconds_per_second
+          + static_cast<std::int64_t>(modification_time.tv_nsec),
+      .inode = static_cast<std::uint64_t>(status.st_ino),
+  };
+#else
+  auto has_error = std::error_code {};
+  const auto size = fs::file_size(path, has_error);
+  if (has_error) {
+    return {};
+  }
+  const auto modification_time = fs::last_write_time(path, has_error);
+  if (has_error) {
+    return {};
+  }
+
+  return FileFingerprint {
+      .size = static_cast<std::uint64_t>(size),
+      .mtime_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      modification_time.time_since_epoch())
+                      .count(),
+      .inode = 0,
+  };
+#endif
+}
 }  // namespace album_architect::files
\ No newline at end of file
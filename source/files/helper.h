@@ -6,14 +6,19 @@
 #define ALBUMARCHITECT_FILES_HELPER_H
 
 #include <filesystem>
+#include <optional>
 #include <string>
 
 #include <boost/serialization/optional.hpp>
 
+#include "files/common.h"
+
 namespace album_architect::files {
 
 /// This class helps to set the current directory for a temporary value. Once
-/// the class is deleted the previous directory is restored
+/// the class is deleted the previous directory is restored. The current
+/// directory is process-wide, so this should not be used while other threads
+/// resolve relative paths.
 class TempCurrentDir {
 public:
   /// Sets the current directory to the given value, restoring on delete.
@@ -60,6 +65,50 @@ private:
   std::filesystem::path m_path;
 };
 
+/// Creates a temporary directory that will be deleted, along with all its
+/// contents, once the class is deleted
+class TemporaryDirectory {
+public:
+  /// Creates a new empty temporary directory
+  TemporaryDirectory();
+
+  /// Deletes the directory and its contents
+  ~TemporaryDirectory();
+
+  /// Deleted operators
+  TemporaryDirectory(const TemporaryDirectory& other) = delete;
+  auto operator=(const TemporaryDirectory& other) = delete;
+
+  /// Default operators
+  TemporaryDirectory(TemporaryDirectory&& other) = default;
+  auto operator=(TemporaryDirectory&& other) -> TemporaryDirectory& = default;
+
+  /// Returns the associated path
+  /// \return
+  auto get_path() const -> std::filesystem::path;
+
+private:
+  std::filesystem::path m_path;
+};
+
+/// Returns the equivalent of a path when one of its parents changes location
+/// \param path Path to rebase
+/// \param old_base Previous location of the parent
+/// \param new_base New location of the parent
+/// \return The rebased path, or None if the path is not under the old base
+auto rebase_path(const std::filesystem::path& path,
+                 const std::filesystem::path& old_base,
+                 const std::filesystem::path& new_base)
+    -> std::optional<std::filesystem::path>;
+
+/// Reads the fingerprint (size, modification time and inode) of the given file
+/// with a single stat call. The inode is zero on platforms that don't
+/// provide it.
+/// \param path
+/// \return Fingerprint, or None if the file couldn't be read
+auto get_file_fingerprint(const std::filesystem::path& path)
+    -> std::optional<FileFingerprint>;
+
 }  // namespace album_architect::files
 
 #endif  // ALBUMARCHITECT_FILES_HELPER_H
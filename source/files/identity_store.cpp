@@ -0,0 +1,34 @@
+#include <cstddef>
+#include <optional>
+#include <utility>
+
+#include "identity_store.h"
+
+#include <absl/hash/hash.h>
+
+#include "files/common.h"
+#include "files/graph.h"
+
+namespace album_architect::files {
+
+auto IdentityStore::IdentityHash::operator()(
+    const FileFingerprint& identity) const -> std::size_t {
+  return absl::HashOf(identity.size, identity.mtime_ns, identity.inode);
+}
+void IdentityStore::insert(const FileFingerprint& identity,
+                           NodeMetadata metadata) {
+  if (identity.is_empty() || identity.inode == 0 || metadata.empty()) {
+    return;
+  }
+  m_entries.insert_or_assign(identity, std::move(metadata));
+}
+auto IdentityStore::extract(const FileFingerprint& identity)
+    -> std::optional<NodeMetadata> {
+  auto node = m_entries.extract(identity);
+  if (node.empty()) {
+    return {};
+  }
+  return std::move(node.mapped());
+}
+
+}  // namespace album_architect::files
@@ -0,0 +1,51 @@
+#ifndef ALBUMARCHITECT_FILES_IDENTITY_STORE_H
+#define ALBUMARCHITECT_FILES_IDENTITY_STORE_H
+
+#include <cstddef>
+#include <optional>
+
+#include <absl/container/flat_hash_map.h>
+
+#include "files/common.h"
+#include "files/graph.h"
+
+namespace album_architect::files {
+
+/// Metadata of files that left the tree, found by the identity of the file.
+/// A file keeps its inode, size and modification time when it is moved or
+/// renamed within its filesystem, so its metadata can be given back to it at
+/// the new path instead of being computed again.
+class IdentityStore {
+public:
+  /// Keeps the metadata of a file. Files without an inode, or with a
+  /// fingerprint that was never recorded, can't be identified and are ignored,
+  /// as are files without metadata.
+  /// \param identity Fingerprint of the file
+  /// \param metadata
+  void insert(const FileFingerprint& identity, NodeMetadata metadata);
+
+  /// Takes the metadata of the file with the given identity out of the store
+  /// \param identity
+  /// \return
+  auto extract(const FileFingerprint& identity) -> std::optional<NodeMetadata>;
+
+  /// Returns the number of files in the store
+  /// \return
+  auto size() const -> std::size_t { return m_entries.size(); }
+
+  /// Returns true if there are no files in the store
+  /// \return
+  auto empty() const -> bool { return m_entries.empty(); }
+
+private:
+  /// Hashes every field of the fingerprint
+  struct IdentityHash {
+    auto operator()(const FileFingerprint& identity) const -> std::size_t;
+  };
+
+  absl::flat_hash_map<FileFingerprint, NodeMetadata, IdentityHash> m_entries;
+};
+
+}  // namespace album_architect::files
+
+#endif  // ALBUMARCHITECT_FILES_IDENTITY_STORE_H
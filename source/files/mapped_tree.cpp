@@ -0,0 +1,489 @@
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "mapped_tree.h"
+
+#include <boost/core/span.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <spdlog/spdlog.h>
+
+#include "files/attribute_columns.h"
+#include "files/common.h"
+#include "files/frozen_graph.h"
+
+namespace fs = std::filesystem;
+namespace bip = boost::interprocess;
+
+namespace album_architect::files {
+
+namespace {
+/// Identifies the file format
+constexpr auto file_magic =
+    std::array<char, 8> {'A', 'A', 'T', 'R', 'E', 'E', 'M', 'P'};
+
+/// Changes every time the layout changes
+constexpr auto file_version = std::uint32_t {2};
+
+/// Written as is, so a file from a machine with another byte order is
+/// rejected
+constexpr auto byte_order_mark = std::uint32_t {0x01020304};
+
+/// Alignment of every section from the start of the file
+constexpr auto section_alignment = std::size_t {8};
+
+/// Sections of the file, in the order they are written
+enum class Section : std::uint8_t {
+  root_path,
+  parents,
+  name_ids,
+  subtree_ends,
+  child_offsets,
+  children,
+  types,
+  fingerprints,
+  name_offsets,
+  name_chars,
+  states,
+  hashes,  // One section per hash column, followed by their presence bitmaps
+};
+constexpr auto section_count = static_cast<std::size_t>(Section::hashes)
+    + 2 * AttributeColumns::hash_column_count;
+
+/// Position of a section in the file
+struct SectionRange {
+  std::uint64_t offset = 0;
+  std::uint64_t size = 0;  // In bytes
+};
+
+/// First bytes of the file
+struct FileHeader {
+  std::array<char, 8> magic = file_magic;
+  std::uint32_t version = file_version;
+  std::uint32_t byte_order = byte_order_mark;
+  std::uint64_t node_count = 0;
+  std::uint64_t name_count = 0;
+  std::array<SectionRange, section_count> sections {};
+};
+
+static_assert(std::is_trivially_copyable_v<FileHeader>);
+static_assert(std::is_trivially_copyable_v<FileFingerprint>);
+static_assert(sizeof(FileFingerprint) == 3 * sizeof(std::uint64_t));
+
+auto get_hash_section(std::size_t column) -> std::size_t {
+  return static_cast<std::size_t>(Section::hashes) + column;
+}
+auto get_presence_section(std::size_t column) -> std::size_t {
+  return get_hash_section(AttributeColumns::hash_column_count + column);
+}
+}  // namespace
+
+struct MappedFileTree::HelperFunctions {
+  /// Writes the sections of a file, keeping their positions for the header
+  class SectionWriter {
+  public:
+    explicit SectionWriter(std::ofstream& output)
+        : m_output(output) {
+      // The header is written at the end, once the sections are known
+      const auto placeholder = std::array<char, sizeof(FileHeader)> {};
+      m_output.write(placeholder.data(), placeholder.size());
+      m_position = placeholder.size();
+    }
+
+    /// Writes a section with the given values
+    template<class Value>
+    void write(std::size_t section, boost::span<const Value> values) {
+      pad();
+      const auto size = values.size() * sizeof(Value);
+      m_header.sections[section] = {m_position, size};
+      // NOLINTNEXTLINE(*-reinterpret-cast)
+      m_output.write(reinterpret_cast<const char*>(values.data()),
+                     static_cast<std::streamsize>(size));
+      m_position += size;
+    }
+    template<class Value>
+    void write(Section section, boost::span<const Value> values) {
+      write(static_cast<std::size_t>(section), values);
+    }
+
+    /// Writes the header at the start of the file
+    void finish(std::uint64_t node_count, std::uint64_t name_count) {
+      pad();
+      m_header.node_count = node_count;
+      m_header.name_count = name_count;
+      m_output.seekp(0);
+      // NOLINTNEXTLINE(*-reinterpret-cast)
+      m_output.write(reinterpret_cast<const char*>(&m_header),
+                     sizeof(m_header));
+    }
+
+  private:
+    /// Aligns the next section
+    void pad() {
+      constexpr auto padding = std::array<char, section_alignment> {};
+      const auto extra = m_position % section_alignment;
+      if (extra != 0) {
+        m_output.write(padding.data(),
+                       static_cast<std::streamsize>(section_alignment - extra));
+        m_position += section_alignment - extra;
+      }
+    }
+
+    std::ofstream& m_output;
+    FileHeader m_header;
+    std::uint64_t m_position = 0;
+  };
+
+  /// Returns the values of a section, or None if it is outside the file or
+  /// doesn't contain the expected number of values
+  template<class Value>
+  static auto get_section(const bip::mapped_region& region,
+                          const FileHeader& header,
+                          std::size_t section,
+                          std::size_t count)
+      -> std::optional<boost::span<const Value>> {
+    const auto& range = header.sections[section];
+    if (range.offset % alignof(Value) != 0 || range.offset > region.get_size()
+        || range.size > region.get_size() - range.offset
+        || range.size != count * sizeof(Value))
+    {
+      return {};
+    }
+
+    const auto* data = static_cast<const char*>(region.get_address());
+    // NOLINTNEXTLINE(*-reinterpret-cast)
+    return boost::span<const Value> {
+        reinterpret_cast<const Value*>(data + range.offset), count};
+  }
+  template<class Value>
+  static auto get_section(const bip::mapped_region& region,
+                          const FileHeader& header,
+                          Section section,
+                          std::size_t count)
+      -> std::optional<boost::span<const Value>> {
+    return get_section<Value>(
+        region, header, static_cast<std::size_t>(section), count);
+  }
+
+  /// Checks that the arrays of the tree only refer to nodes and names that
+  /// exist, so a corrupt file can't make the queries read outside of it.
+  /// Parents come before their children in depth-first order, which also
+  /// rules out cycles.
+  /// \param tree
+  /// \param name_count
+  /// \return
+  static auto is_consistent(const MappedFileTree& tree, std::size_t name_count)
+      -> bool {
+    const auto node_count = tree.m_parents.size();
+    if (tree.m_name_offsets.front() != 0 || tree.m_child_offsets.front() != 0)
+    {
+      return false;
+    }
+    if (!std::is_sorted(tree.m_name_offsets.begin(), tree.m_name_offsets.end())
+        || !std::is_sorted(tree.m_child_offsets.begin(),
+                           tree.m_child_offsets.end()))
+    {
+      return false;
+    }
+    const auto is_child = [node_count](NodeId child)
+    { return child != get_root_node() && child < node_count; };
+    if (!std::all_of(tree.m_children.begin(), tree.m_children.end(), is_child))
+    {
+      return false;
+    }
+
+    for (auto node = std::size_t {0}; node < node_count; ++node) {
+      const auto subtree_end = tree.m_subtree_ends[node];
+      if (subtree_end <= node || subtree_end > node_count) {
+        return false;
+      }
+      if (node != get_root_node()
+          && (tree.m_parents[node] >= node
+              || tree.m_name_ids[node] >= name_count))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+auto MappedFileTree::write(const FrozenFileGraph& graph,
+                           const fs::path& root_path,
+                           const fs::path& path) -> bool {
+  auto output = std::ofstream(path, std::ios::binary | std::ios::trunc);
+  if (!output) {
+    spdlog::error("Couldn't write mapped cache file {}", path.string());
+    return false;
+  }
+
+  const auto node_count = graph.size();
+  auto writer = HelperFunctions::SectionWriter {output};
+  const auto root = root_path.string();
+  writer.write(Section::root_path, boost::span<const char> {root});
+  writer.write(Section::parents, boost::span<const NodeId> {graph.m_parents});
+
+  // Number the names in the order they are first used, so the names that
+  // only appear in a subtree are stored together. Repeated names are stored
+  // once, where they were first used.
+  constexpr auto no_name = std::numeric_limits<std::uint32_t>::max();
+  auto name_numbers = std::vector<std::uint32_t>(graph.m_names.size(), no_name);
+  auto name_ids = std::vector<std::uint32_t>(node_count);
+  auto name_offsets = std::vector<std::uint64_t> {0};
+  auto name_chars = std::string {};
+  for (auto node = std::size_t {1}; node < node_count; ++node) {
+    auto& number = name_numbers[graph.m_name_ids[node]];
+    if (number == no_name) {
+      number = static_cast<std::uint32_t>(name_offsets.size() - 1);
+      name_chars.append(graph.m_names.get(graph.m_name_ids[node]));
+      name_offsets.push_back(name_chars.size());
+    }
+    name_ids[node] = number;
+  }
+  writer.write(Section::name_ids, boost::span<const std::uint32_t> {name_ids});
+  writer.write(Section::subtree_ends,
+               boost::span<const NodeId> {graph.m_subtree_ends});
+  writer.write(Section::child_offsets,
+               boost::span<const std::uint32_t> {graph.m_child_offsets});
+
+  // Sort the children by their names, so paths are found by comparing the
+  // names in place
+  auto children = graph.m_children;
+  for (auto node = std::size_t {0}; node < node_count; ++node) {
+    std::sort(children.begin() + graph.m_child_offsets[node],
+              children.begin() + graph.m_child_offsets[node + 1],
+              [&graph](NodeId lhs, NodeId rhs)
+              { return graph.get_node_name(lhs) < graph.get_node_name(rhs); });
+  }
+  writer.write(Section::children, boost::span<const NodeId> {children});
+
+  auto types = std::vector<std::uint8_t> {};
+  auto fingerprints = std::vector<FileFingerprint> {};
+  types.reserve(node_count);
+  fingerprints.reserve(node_count);
+  for (const auto& data : graph.m_data) {
+    types.push_back(static_cast<std::uint8_t>(data.type));
+    fingerprints.push_back(data.fingerprint);
+  }
+  writer.write(Section::types, boost::span<const std::uint8_t> {types});
+  writer.write(Section::fingerprints,
+               boost::span<const FileFingerprint> {fingerprints});
+
+  const auto name_count = name_offsets.size() - 1;
+  writer.write(Section::name_offsets,
+               boost::span<const std::uint64_t> {name_offsets});
+  writer.write(Section::name_chars, boost::span<const char> {name_chars});
+
+  // Attribute columns, with the same numbering as the nodes
+  const auto& columns = graph.get_columns();
+  auto states = std::vector<std::uint8_t>(node_count);
+  auto hashes = std::vector<std::uint64_t>(node_count);
+  auto presence = std::vector<std::uint64_t>((node_count + 63) / 64);
+  for (auto node = std::size_t {0}; node < node_count; ++node) {
+    states[node] = columns.get_state(node);
+  }
+  writer.write(Section::states, boost::span<const std::uint8_t> {states});
+  for (auto index = std::size_t {0};
+       index < AttributeColumns::hash_column_count;
+       ++index)
+  {
+    std::fill(presence.begin(), presence.end(), 0);
+    for (auto node = std::size_t {0}; node < node_count; ++node) {
+      const auto hash = columns.get_hash(static_cast<HashColumn>(index), node);
+      hashes[node] = hash.value_or(0);
+      if (hash) {
+        presence[node / 64] |= std::uint64_t {1} << (node % 64);
+      }
+    }
+    writer.write(get_hash_section(index),
+                 boost::span<const std::uint64_t> {hashes});
+    writer.write(get_presence_section(index),
+                 boost::span<const std::uint64_t> {presence});
+  }
+
+  writer.finish(node_count, name_count);
+  output.flush();
+  if (!output) {
+    spdlog::error("Couldn't write mapped cache file {}", path.string());
+    return false;
+  }
+  return true;
+}
+auto MappedFileTree::open(const fs::path& path)
+    -> std::optional<MappedFileTree> {
+  auto ret = MappedFileTree {};
+  try {
+    ret.m_file = bip::file_mapping(path.c_str(), bip::read_only);
+    ret.m_region = bip::mapped_region(ret.m_file, bip::read_only);
+  } catch (const std::exception& e) {
+    spdlog::error(
+        "Couldn't map cache file {}. Error: {}", path.string(), e.what());
+    return {};
+  }
+
+  // Check that the file is of this version and machine
+  const auto& region = ret.m_region;
+  if (region.get_size() < sizeof(FileHeader)) {
+    spdlog::error("Mapped cache file {} is truncated", path.string());
+    return {};
+  }
+  const auto& header = *static_cast<const FileHeader*>(region.get_address());
+  if (header.magic != file_magic || header.version != file_version
+      || header.byte_order != byte_order_mark)
+  {
+    spdlog::error("Mapped cache file {} has an unknown format", path.string());
+    return {};
+  }
+
+  // Check that every section is within the file
+  const auto node_count = header.node_count;
+  const auto name_count = header.name_count;
+  const auto word_count = (node_count + 63) / 64;
+  auto is_valid = node_count > 0;
+  const auto get = [&](auto section, std::size_t count, auto& output)
+  {
+    using Value =
+        typename std::remove_reference_t<decltype(output)>::value_type;
+    const auto values =
+        HelperFunctions::get_section<Value>(region, header, section, count);
+    is_valid = is_valid && values.has_value();
+    if (values) {
+      output = *values;
+    }
+  };
+
+  auto root_path = boost::span<const char> {};
+  auto name_chars = boost::span<const char> {};
+  get(Section::root_path,
+      header.sections[static_cast<std::size_t>(Section::root_path)].size,
+      root_path);
+  get(Section::parents, node_count, ret.m_parents);
+  get(Section::name_ids, node_count, ret.m_name_ids);
+  get(Section::subtree_ends, node_count, ret.m_subtree_ends);
+  get(Section::child_offsets, node_count + 1, ret.m_child_offsets);
+  get(Section::children, node_count - 1, ret.m_children);
+  get(Section::types, node_count, ret.m_types);
+  get(Section::fingerprints, node_count, ret.m_fingerprints);
+  get(Section::name_offsets, name_count + 1, ret.m_name_offsets);
+  get(Section::name_chars,
+      header.sections[static_cast<std::size_t>(Section::name_chars)].size,
+      name_chars);
+  get(Section::states, node_count, ret.m_states);
+  for (auto index = std::size_t {0};
+       index < AttributeColumns::hash_column_count;
+       ++index)
+  {
+    get(get_hash_section(index), node_count, ret.m_hashes[index]);
+    get(get_presence_section(index), word_count, ret.m_presence[index]);
+  }
+  if (!is_valid || ret.m_name_offsets.back() != name_chars.size()
+      || ret.m_child_offsets.back() != ret.m_children.size()
+      || !HelperFunctions::is_consistent(ret, name_count))
+  {
+    spdlog::error("Mapped cache file {} is corrupt", path.string());
+    return {};
+  }
+
+  ret.m_root_path = std::string_view {root_path.data(), root_path.size()};
+  ret.m_name_chars = std::string_view {name_chars.data(), name_chars.size()};
+  return ret;
+}
+auto MappedFileTree::get_root_path() const -> fs::path {
+  return fs::path {m_root_path};
+}
+auto MappedFileTree::get_node(boost::span<const std::string> path_list) const
+    -> std::optional<NodeId> {
+  auto current_node = get_root_node();
+  for (const auto& current_path : path_list) {
+    const auto children = get_node_children(current_node);
+    const auto position = std::lower_bound(
+        children.begin(),
+        children.end(),
+        current_path,
+        [this](NodeId child, const std::string& value)
+        { return get_node_name(child) < value; });
+    if (position == children.end() || get_node_name(*position) != current_path)
+    {
+      return {};
+    }
+    current_node = *position;
+  }
+
+  return current_node;
+}
+auto MappedFileTree::get_node(const fs::path& path) const
+    -> std::optional<NodeId> {
+  auto relative_path = path.lexically_normal();
+  if (relative_path.is_absolute()) {
+    // Empty if the paths can't be related, like on another drive
+    relative_path = relative_path.lexically_relative(get_root_path());
+    if (relative_path.empty()) {
+      return {};
+    }
+  }
+
+  auto path_list = std::vector<std::string> {};
+  for (const auto& component : relative_path) {
+    if (component.empty() || component == ".") {
+      continue;
+    }
+    if (component == "..") {
+      return {};
+    }
+    path_list.push_back(component.string());
+  }
+  return get_node(path_list);
+}
+auto MappedFileTree::get_node_name(NodeId node) const -> std::string_view {
+  if (node == get_root_node()) {
+    return {};
+  }
+
+  const auto name_id = m_name_ids[node];
+  return m_name_chars.substr(
+      m_name_offsets[name_id],
+      m_name_offsets[name_id + 1] - m_name_offsets[name_id]);
+}
+auto MappedFileTree::get_node_parent(NodeId node) const
+    -> std::optional<NodeId> {
+  if (node == get_root_node()) {
+    return {};
+  }
+  return m_parents[node];
+}
+auto MappedFileTree::get_node_path(NodeId node) const -> fs::path {
+  auto names = std::vector<std::string_view> {};
+  for (auto current_node = node; current_node != get_root_node();
+       current_node = m_parents[current_node])
+  {
+    names.push_back(get_node_name(current_node));
+  }
+
+  auto ret = get_root_path();
+  std::for_each(names.rbegin(),
+                names.rend(),
+                [&ret](std::string_view name) { ret /= name; });
+  return ret;
+}
+auto MappedFileTree::get_hash(HashColumn column, NodeId node) const
+    -> std::optional<std::uint64_t> {
+  const auto index = static_cast<std::size_t>(column);
+  const auto bit = std::uint64_t {1} << (node % 64);
+  if ((m_presence[index][node / 64] & bit) == 0) {
+    return {};
+  }
+  return m_hashes[index][node];
+}
+
+}  // namespace album_architect::files
@@ -0,0 +1,172 @@
+#ifndef ALBUMARCHITECT_FILES_MAPPED_TREE_H
+#define ALBUMARCHITECT_FILES_MAPPED_TREE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <boost/core/span.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "files/attribute_columns.h"
+#include "files/common.h"
+#include "files/frozen_graph.h"
+
+namespace album_architect::files {
+
+/// Read-only FileTree that is queried in place from a memory-mapped file.
+///
+/// The file holds the arrays of a FrozenFileGraph, the names of the nodes and
+/// the attribute columns, each at an aligned offset from the start of the
+/// file. Opening it validates the header and the arrays that link the nodes
+/// and their names, while the hashes and the other columns are read from the
+/// disk the first time they are touched. The children of each node are
+/// sorted by name, which allows finding a path without building any index.
+/// The metadata map of the vertices is not included.
+///
+/// Nodes are numbered in depth-first order, so the sections indexed by node
+/// hold every subtree as a contiguous block. Names are stored once, in the
+/// order they are first used, so the names that only appear in a subtree are
+/// next to each other too. A name repeated in several directories stays with
+/// the first one that used it. Working with one directory mostly reads the
+/// pages of that directory, no matter the size of the whole tree.
+class MappedFileTree {
+public:
+  using NodeId = std::uint32_t;
+
+  /// Writes the graph in the mapped format
+  /// \param graph
+  /// \param root_path Path of the root of the tree
+  /// \param path File to write
+  /// \return False if the file couldn't be written
+  static auto write(const FrozenFileGraph& graph,
+                    const std::filesystem::path& root_path,
+                    const std::filesystem::path& path) -> bool;
+
+  /// Maps a file written with write
+  /// \param path
+  /// \return The tree, or None if the file is missing, from another version
+  /// or corrupt
+  static auto open(const std::filesystem::path& path)
+      -> std::optional<MappedFileTree>;
+
+  /// Returns the path of the root of the tree
+  /// \return
+  auto get_root_path() const -> std::filesystem::path;
+
+  /// Returns the number of nodes, including the root
+  /// \return
+  auto size() const -> std::size_t { return m_parents.size(); }
+
+  /// Returns the root node
+  /// \return
+  static constexpr auto get_root_node() -> NodeId { return 0; }
+
+  /// Returns the ID of the node in the given path
+  /// \param path_list Path relative to the root
+  /// \return
+  auto get_node(boost::span<const std::string> path_list) const
+      -> std::optional<NodeId>;
+
+  /// Returns the ID of the node in the given path. The path is matched
+  /// lexically, without touching the disk.
+  /// \param path Absolute, or relative to the root
+  /// \return
+  auto get_node(const std::filesystem::path& path) const
+      -> std::optional<NodeId>;
+
+  /// Returns the type of the node
+  /// \param node
+  /// \return
+  auto get_node_type(NodeId node) const -> NodeType {
+    return static_cast<NodeType>(m_types[node]);
+  }
+
+  /// Returns the name of the node. The root has an empty name.
+  /// \param node
+  /// \return
+  auto get_node_name(NodeId node) const -> std::string_view;
+
+  /// Returns the parent of the node, if it is not the root
+  /// \param node
+  /// \return
+  auto get_node_parent(NodeId node) const -> std::optional<NodeId>;
+
+  /// Returns the children of the node, sorted by name
+  /// \param node
+  /// \return
+  auto get_node_children(NodeId node) const -> boost::span<const NodeId> {
+    return m_children.subspan(m_child_offsets[node],
+                              m_child_offsets[node + 1]
+                                  - m_child_offsets[node]);
+  }
+
+  /// Returns the end of the subtree of the node. The node and all the nodes
+  /// under it are the ids in [node, end).
+  /// \param node
+  /// \return
+  auto get_subtree_end(NodeId node) const -> NodeId {
+    return m_subtree_ends[node];
+  }
+
+  /// Returns the absolute path of the node
+  /// \param node
+  /// \return
+  auto get_node_path(NodeId node) const -> std::filesystem::path;
+
+  /// Returns the fingerprint of the file represented by the node
+  /// \param node
+  /// \return
+  auto get_node_fingerprint(NodeId node) const -> FileFingerprint {
+    return m_fingerprints[node];
+  }
+
+  /// Returns the hash of the node, if stored
+  /// \param column
+  /// \param node
+  /// \return
+  auto get_hash(HashColumn column, NodeId node) const
+      -> std::optional<std::uint64_t>;
+
+  /// Returns the state of the node, 0 if not stored
+  /// \param node
+  /// \return
+  auto get_state(NodeId node) const -> std::uint8_t { return m_states[node]; }
+
+private:
+  MappedFileTree() = default;
+
+  boost::interprocess::file_mapping m_file;
+  boost::interprocess::mapped_region m_region;
+
+  // Views over the mapped file
+  std::string_view m_root_path;
+  boost::span<const NodeId> m_parents;
+  boost::span<const std::uint32_t> m_name_ids;
+  boost::span<const NodeId> m_subtree_ends;
+  boost::span<const std::uint32_t> m_child_offsets;
+  boost::span<const NodeId> m_children;
+  boost::span<const std::uint8_t> m_types;
+  boost::span<const FileFingerprint> m_fingerprints;
+  boost::span<const std::uint64_t> m_name_offsets;
+  std::string_view m_name_chars;
+  std::array<boost::span<const std::uint64_t>,
+             AttributeColumns::hash_column_count>
+      m_hashes;
+  std::array<boost::span<const std::uint64_t>,
+             AttributeColumns::hash_column_count>
+      m_presence;
+  boost::span<const std::uint8_t> m_states;
+
+  /// Contains internal helper functions
+  struct HelperFunctions;
+};
+
+}  // namespace album_architect::files
+
+#endif  // ALBUMARCHITECT_FILES_MAPPED_TREE_H
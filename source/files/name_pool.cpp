@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+#include "name_pool.h"
+
+namespace album_architect::files {
+
+namespace {
+/// Size of the first block of the arena. Later blocks grow geometrically.
+constexpr auto initial_arena_size = std::size_t {64 * 1024};
+}  // namespace
+
+NamePool::NamePool()
+    : m_arena(std::make_unique<std::pmr::monotonic_buffer_resource>(
+          initial_arena_size)) {}
+NamePool::NamePool(const NamePool& other)
+    : NamePool() {
+  m_names.reserve(other.m_names.size());
+  m_ids.reserve(other.m_names.size());
+  for (const auto name : other.m_names) {
+    intern(name);
+  }
+}
+auto NamePool::operator=(const NamePool& other) -> NamePool& {
+  if (this != &other) {
+    *this = NamePool {other};
+  }
+  return *this;
+}
+auto NamePool::intern(std::string_view name) -> NameId {
+  if (const auto position = m_ids.find(name); position != m_ids.end()) {
+    return position->second;
+  }
+
+  if (m_names.size() > std::numeric_limits<NameId>::max()) {
+    throw std::length_error("Too many names in the NamePool");
+  }
+
+  // Copy the characters into the arena, so the view outlives the argument
+  auto stored = std::string_view {};
+  if (!name.empty()) {
+    auto* data = static_cast<char*>(m_arena->allocate(name.size(), 1));
+    std::copy(name.begin(), name.end(), data);
+    stored = std::string_view {data, name.size()};
+  }
+
+  const auto name_id = static_cast<NameId>(m_names.size());
+  m_names.push_back(stored);
+  m_ids.emplace(stored, name_id);
+  return name_id;
+}
+auto NamePool::find(std::string_view name) const -> std::optional<NameId> {
+  if (const auto position = m_ids.find(name); position != m_ids.end()) {
+    return position->second;
+  }
+  return {};
+}
+
+}  // namespace album_architect::files
@@ -0,0 +1,100 @@
+#ifndef ALBUMARCHITECT_FILES_NAME_POOL_H
+#define ALBUMARCHITECT_FILES_NAME_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <absl/container/flat_hash_map.h>
+#include <boost/serialization/split_member.hpp>
+#include <boost/serialization/string.hpp>
+
+namespace album_architect::files {
+
+/// Stores each distinct name once and identifies it with a compact id. The
+/// characters of all the names live in a monotonic arena, so filling the pool
+/// and destroying it are a handful of bulk allocations.
+class NamePool {
+public:
+  using NameId = std::uint32_t;
+
+  NamePool();
+  ~NamePool() = default;
+
+  // Copies keep the same ids
+  NamePool(const NamePool& other);
+  auto operator=(const NamePool& other) -> NamePool&;
+
+  // Move operations
+  NamePool(NamePool&& other) noexcept = default;
+  auto operator=(NamePool&& other) noexcept -> NamePool& = default;
+
+  /// Returns the id of the name, adding it to the pool if it is new
+  /// \param name
+  /// \return
+  auto intern(std::string_view name) -> NameId;
+
+  /// Returns the id of the name if it is in the pool
+  /// \param name
+  /// \return
+  auto find(std::string_view name) const -> std::optional<NameId>;
+
+  /// Returns the name with the given id. Valid while the pool is alive.
+  /// \param name_id
+  /// \return
+  auto get(NameId name_id) const -> std::string_view {
+    return m_names[name_id];
+  }
+
+  /// Returns the number of names in the pool
+  /// \return
+  auto size() const -> std::size_t { return m_names.size(); }
+
+  /// Writes every name once, in id order
+  template<class Archive>
+  void save(Archive& archive, const unsigned int /*version*/) const {
+    const auto count = m_names.size();
+    archive & count;
+    for (const auto name : m_names) {
+      const auto value = std::string {name};
+      archive & value;
+    }
+  }
+
+  /// Reads the names back, which keeps their ids
+  template<class Archive>
+  void load(Archive& archive, const unsigned int /*version*/) {
+    *this = NamePool {};
+    auto count = std::size_t {0};
+    archive & count;
+    m_names.reserve(count);
+    m_ids.reserve(count);
+    for (auto index = std::size_t {0}; index < count; ++index) {
+      auto value = std::string {};
+      archive & value;
+      intern(value);
+    }
+  }
+
+  BOOST_SERIALIZATION_SPLIT_MEMBER()
+
+private:
+  /// Owns the characters of all the names. Behind a pointer so the names stay
+  /// in place when the pool is moved.
+  std::unique_ptr<std::pmr::monotonic_buffer_resource> m_arena;
+
+  /// Name of each id
+  std::vector<std::string_view> m_names;
+
+  /// Id of each name
+  absl::flat_hash_map<std::string_view, NameId> m_ids;
+};
+
+}  // namespace album_architect::files
+
+#endif  // ALBUMARCHITECT_FILES_NAME_POOL_H
@@ -3,12 +3,18 @@
 //
 
 #include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <filesystem>
 #include <iterator>
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <random>
+#include <set>
+#include <sstream>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -19,10 +25,16 @@
 #include <boost/archive/binary_oarchive.hpp>
 #include <fmt/format.h>
 #include <spdlog/spdlog.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_group.h>
 
 #include "files/common.h"
+#include "files/compressed_stream.h"
+#include "files/frozen_graph.h"
 #include "files/graph.h"
 #include "files/helper.h"
+#include "files/identity_store.h"
+#include "files/mapped_tree.h"
 
 namespace fs = std::filesystem;
 
@@ -31,6 +43,16 @@ Element::Element(PathType type, std::filesystem::path path, FileTree* parent)
     : m_type(type)
     , m_path(std::move(path))
     , m_parent(parent) {}
+Element::Element(PathType type,
+                 std::filesystem::path path,
+                 FileTree* parent,
+                 FileGraph::NodeId node,
+                 std::uint64_t generation)
+    : m_type(type)
+    , m_path(std::move(path))
+    , m_parent(parent)
+    , m_node(node)
+    , m_generation(generation) {}
 auto Element::get_type() const -> PathType {
   return m_type;
 }
@@ -45,18 +67,10 @@ auto Element::operator!=(const Element& rhs) const -> bool {
   return !(rhs == *this);
 }
 auto Element::get_children() const -> Element::ElementList {
-  auto elements = ElementList {};
-  m_parent->get_elements_under_path(get_path(), elements);
-  return elements;
+  return m_parent->get_children(*this);
 }
 auto Element::get_parent() const -> std::optional<Element> {
-  auto own_path = get_path();
-  if (!own_path.has_parent_path()) {
-    return {};
-  }
-
-  auto parent_path = own_path.parent_path();
-  return m_parent->get_element(parent_path);
+  return m_parent->get_parent(*this);
 }
 auto Element::get_siblings() const -> Element::ElementList {
   auto siblings = ElementList {};
@@ -82,15 +96,65 @@ auto Element::get_siblings() const -> Element::ElementList {
 auto Element::set_metadata(const std::string& key,
                            const PathAttribute& attribute)
     -> std::optional<PathAttribute> {
-  return m_parent->set_metadata(m_path, key, attribute);
+  return m_parent->set_metadata(*this, AttributeKeys::intern(key), attribute);
+}
+auto Element::set_metadata(AttributeKey key, const PathAttribute& attribute)
+    -> std::optional<PathAttribute> {
+  return m_parent->set_metadata(*this, key, attribute);
 }
 auto Element::get_metadata(const std::string& key) const
     -> std::optional<PathAttribute> {
-  return m_parent->get_metadata(m_path, key);
+  // A key that was never registered can't be in any element
+  const auto attribute_key = AttributeKeys::find(key);
+  if (!attribute_key) {
+    return {};
+  }
+  return m_parent->get_metadata(*this, *attribute_key);
+}
+auto Element::get_metadata(AttributeKey key) const
+    -> std::optional<PathAttribute> {
+  return m_parent->get_metadata(*this, key);
 }
 auto Element::remove_metadata(const std::string& key)
     -> std::optional<PathAttribute> {
-  return m_parent->remove_metadata(m_path, key);
+  const auto attribute_key = AttributeKeys::find(key);
+  if (!attribute_key) {
+    return {};
+  }
+  return m_parent->remove_metadata(*this, *attribute_key);
+}
+auto Element::remove_metadata(AttributeKey key)
+    -> std::optional<PathAttribute> {
+  return m_parent->remove_metadata(*this, key);
+}
+auto Element::set_metadata(boost::span<const MetadataEntry> entries) -> bool {
+  return m_parent->set_metadata(*this, entries);
+}
+auto Element::get_metadata(boost::span<const AttributeKey> keys) const
+    -> std::vector<std::optional<PathAttribute>> {
+  return m_parent->get_metadata(*this, keys);
+}
+auto Element::get_hash(HashColumn column) const
+    -> std::optional<std::uint64_t> {
+  return m_parent->get_hashes(*this, {&column, 1}).front();
+}
+auto Element::get_hashes(boost::span<const HashColumn> columns) const
+    -> std::vector<std::optional<std::uint64_t>> {
+  return m_parent->get_hashes(*this, columns);
+}
+auto Element::set_hashes(boost::span<const HashColumn> columns,
+                         boost::span<const std::uint64_t> hashes,
+                         std::optional<std::uint8_t> state) -> bool {
+  return m_parent->set_hashes(*this, columns, hashes, state);
+}
+auto Element::get_state() const -> std::uint8_t {
+  return m_parent->get_state(*this);
+}
+void Element::set_state(std::uint8_t state) {
+  m_parent->set_state(*this, state);
+}
+auto Element::get_fingerprint() const -> FileFingerprint {
+  return m_parent->get_fingerprint(*this);
 }
 auto from_node_type(const NodeType& path_type) -> PathType {
   switch (path_type) {
@@ -120,8 +184,8 @@ auto FileTree::operator=(FileTree&& other) noexcept -> FileTree& {
   }
   return *this;
 }
-auto FileTree::build(const std::filesystem::path& path)
-    -> std::optional<FileTree> {
+auto FileTree::build(const std::filesystem::path& path,
+                     std::size_t scan_threads) -> std::optional<FileTree> {
   // Check if path is directory or file
   if (!fs::is_directory(path)) {
     spdlog::error(
@@ -139,10 +203,353 @@ auto FileTree::build(const std::filesystem::path& path)
     return {};
   }
 
-  return FileTree {absolute_path};
+  return FileTree {absolute_path, scan_threads};
 }
 
-FileTree::FileTree(std::filesystem::path root_path)
+namespace {
+/// Entries of a directory as read from the disk
+struct DirectoryListing {
+  std::vector<std::pair<std::string, NodeType>> children;
+  std::vector<FileFingerprint> fingerprints;
+};
+
+/// Lists the files and directories directly under the given path. Entries
+/// of any other type are ignored.
+/// \param path
+/// \return
+auto list_directory(const fs::path& path) -> DirectoryListing {
+  auto listing = DirectoryListing {};
+  auto has_error = std::error_code {};
+  for (auto directory_iterator = fs::directory_iterator(path, has_error);
+       !has_error && directory_iterator != fs::directory_iterator();
+       directory_iterator.increment(has_error))
+  {
+    auto entry_error = std::error_code {};
+    if (directory_iterator->is_directory(entry_error)) {
+      listing.children.emplace_back(
+          directory_iterator->path().filename().string(), NodeType::directory);
+      listing.fingerprints.emplace_back();
+    } else if (directory_iterator->is_regular_file(entry_error)) {
+      listing.children.emplace_back(
+          directory_iterator->path().filename().string(), NodeType::file);
+      listing.fingerprints.push_back(
+          get_file_fingerprint(directory_iterator->path())
+              .value_or(FileFingerprint {}));
+    }
+  }
+
+  if (has_error) {
+    spdlog::error("Couldn't scan directory {}. Error: {}",
+                  path.string(),
+                  has_error.message());
+  }
+
+  return listing;
+}
+}  // namespace
+
+struct FileTree::HelperFunctions {
+  /// Node of a batch operation, with the position of the operation
+  using BatchNode = std::pair<FileGraph::NodeId, std::size_t>;
+
+  /// Calls the function for every node of a batch, holding the lock of its
+  /// stripe. The nodes are grouped by stripe, so each lock is taken once.
+  /// The graph lock has to be held.
+  /// \param tree
+  /// \param nodes Nodes of the batch, reordered by stripe
+  /// \param function Function that receives the node and its position
+  template<class Function>
+  static void for_each_by_stripe(const FileTree* tree,
+                                 std::vector<BatchNode>& nodes,
+                                 Function&& function) {
+    const auto stripes = tree->m_metadata_mutexes.size();
+    std::ranges::sort(nodes,
+                      [stripes](const auto& lhs, const auto& rhs)
+                      {
+                        return std::pair {lhs.first % stripes, lhs.second}
+                        < std::pair {rhs.first % stripes, rhs.second};
+                      });
+
+    auto first = nodes.begin();
+    while (first != nodes.end()) {
+      const auto stripe = first->first % stripes;
+      const auto last =
+          std::find_if(first,
+                       nodes.end(),
+                       [stripes, stripe](const auto& entry)
+                       { return entry.first % stripes != stripe; });
+
+      auto node_guard =
+          std::scoped_lock(tree->get_metadata_mutex(first->first));
+      for (; first != last; ++first) {
+        function(first->first, first->second);
+      }
+    }
+  }
+
+  /// Shared state while refreshing a tree
+  struct RefreshState {
+    std::atomic<std::size_t> added = 0;
+    std::atomic<std::size_t> modified = 0;
+
+    std::mutex removed_mutex;
+    std::vector<FileGraph::NodeId> removed;
+    std::vector<FileGraph::NodeId> new_nodes;  // Also under removed_mutex
+  };
+
+  /// Calls the function with every file in the subtrees of the given nodes
+  /// \param graph
+  /// \param nodes
+  /// \param function
+  template<class Function>
+  static void for_each_file(FileGraph& graph,
+                            boost::span<const FileGraph::NodeId> nodes,
+                            Function&& function) {
+    auto pending = std::vector(nodes.begin(), nodes.end());
+    while (!pending.empty()) {
+      const auto node = pending.back();
+      pending.pop_back();
+      if (graph.get_node_type(node) == NodeType::file) {
+        function(node);
+      } else {
+        std::ranges::copy(graph.get_node_children(node),
+                          std::back_inserter(pending));
+      }
+    }
+  }
+
+  /// Gives the metadata of the files that are about to be removed to the new
+  /// files with the same identity, which were moved or renamed. Needs the
+  /// graph lock.
+  /// \param tree
+  /// \param removed Nodes that are going to be removed, with their subtrees
+  /// \param added Nodes that were added, with their subtrees
+  /// \return Number of files that got their metadata back
+  static auto reattach_moved_files(FileTree* tree,
+                                   boost::span<const FileGraph::NodeId> removed,
+                                   boost::span<const FileGraph::NodeId> added)
+      -> std::size_t {
+    auto& graph = *tree->m_graph;
+    auto store = IdentityStore {};
+    for_each_file(graph,
+                  removed,
+                  [&graph, &store](FileGraph::NodeId node)
+                  {
+                    store.insert(graph.get_node_fingerprint(node),
+                                 graph.take_node_metadata(node));
+                  });
+    if (store.empty()) {
+      return 0;
+    }
+
+    auto ret = std::size_t {0};
+    for_each_file(graph,
+                  added,
+                  [&graph, &store, &ret](FileGraph::NodeId node)
+                  {
+                    if (auto metadata =
+                            store.extract(graph.get_node_fingerprint(node)))
+                    {
+                      graph.restore_node_metadata(node, std::move(*metadata));
+                      ++ret;
+                    }
+                  });
+    return ret;
+  }
+
+  /// Runs the given scan function sequentially, or fanned out across a task
+  /// arena where idle threads steal pending directories from busy ones.
+  /// \param scan_threads Threads for scanning, 0 for all cores
+  /// \param scan Function that receives the task group, or null
+  template<class ScanFunction>
+  static void run_scan(std::size_t scan_threads, ScanFunction&& scan) {
+    if (scan_threads == 1) {
+      scan(nullptr);
+      return;
+    }
+
+    auto arena = tbb::task_arena(scan_threads == 0
+                                     ? tbb::task_arena::automatic
+                                     : static_cast<int>(scan_threads));
+    arena.execute(
+        [&scan]()
+        {
+          auto group = tbb::task_group {};
+          scan(&group);
+          group.wait();
+        });
+  }
+
+  /// Runs the given function as a task of the group, or directly if no group
+  /// is provided
+  /// \param group
+  /// \param function
+  template<class Function>
+  static void run_task(tbb::task_group* group, Function&& function) {
+    if (group == nullptr) {
+      function();
+    } else {
+      group->run(std::forward<Function>(function));
+    }
+  }
+
+  /// Lists the directory in the given path and splices all its entries under
+  /// the given node, taking the graph lock only once. Sub-directories are
+  /// scanned recursively, as tasks of the group when one is provided.
+  /// \param tree Tree to populate
+  /// \param path Absolute path to the directory
+  /// \param node Node that represents the directory
+  /// \param group Task group for parallel scanning, or null
+  // NOLINTNEXTLINE(misc-no-recursion)
+  static void scan_directory(FileTree* tree,
+                             const fs::path& path,
+                             FileGraph::NodeId node,
+                             tbb::task_group* group) {
+    // Gather the listing of the directory without holding the lock
+    const auto listing = list_directory(path);
+
+    // Splice the listing into the graph
+    auto child_nodes = std::vector<FileGraph::NodeId> {};
+    {
+      auto guard = std::scoped_lock(tree->m_graph_mutex);
+      child_nodes = tree->m_graph->add_children(node, listing.children);
+      for (auto index = std::size_t {0}; index < child_nodes.size(); ++index) {
+        tree->m_graph->set_node_fingerprint(child_nodes[index],
+                                            listing.fingerprints[index]);
+      }
+    }
+
+    // Continue with the sub-directories
+    for (auto index = std::size_t {0}; index < child_nodes.size(); ++index) {
+      if (listing.children[index].second != NodeType::directory) {
+        continue;
+      }
+
+      run_task(group,
+               [tree,
+                child_path = path / listing.children[index].first,
+                child_node = child_nodes[index],
+                group]()
+               { scan_directory(tree, child_path, child_node, group); });
+    }
+  }
+
+  /// Compares the directory in the given path with the node that represents
+  /// it, adding new entries, collecting the missing ones for removal and
+  /// invalidating the files whose fingerprint changed.
+  /// \param tree Tree to refresh
+  /// \param path Absolute path to the directory
+  /// \param node Node that represents the directory
+  /// \param group Task group for parallel scanning, or null
+  /// \param state Shared state of the refresh
+  // NOLINTNEXTLINE(misc-no-recursion)
+  static void refresh_directory(FileTree* tree,
+                                const fs::path& path,
+                                FileGraph::NodeId node,
+                                tbb::task_group* group,
+                                RefreshState& state) {
+    // Gather the listing of the directory without holding the lock
+    const auto listing = list_directory(path);
+
+    auto new_children = std::vector<std::pair<std::string, NodeType>> {};
+    auto new_fingerprints = std::vector<FileFingerprint> {};
+    auto new_nodes = std::vector<FileGraph::NodeId> {};
+    auto existing_directories =
+        std::vector<std::pair<fs::path, FileGraph::NodeId>> {};
+    auto modified = std::size_t {0};
+    {
+      auto guard = std::scoped_lock(tree->m_graph_mutex);
+
+      // Index the current children by name
+      auto current_children =
+          std::unordered_map<std::string, FileGraph::NodeId> {};
+      for (const auto child : tree->m_graph->get_node_children(node)) {
+        current_children.emplace(tree->m_graph->get_node_name(child), child);
+      }
+
+      for (auto index = std::size_t {0}; index < listing.children.size();
+           ++index)
+      {
+        const auto& [name, type] = listing.children[index];
+        const auto& fingerprint = listing.fingerprints[index];
+
+        // Entries that are not in the tree, or that changed their type, are
+        // added as new
+        const auto position = current_children.find(name);
+        if (position == current_children.end()
+            || tree->m_graph->get_node_type(position->second) != type)
+        {
+          new_children.emplace_back(name, type);
+          new_fingerprints.push_back(fingerprint);
+          continue;
+        }
+
+        const auto child = position->second;
+        current_children.erase(position);
+        if (type == NodeType::directory) {
+          existing_directories.emplace_back(path / name, child);
+          continue;
+        }
+
+        // Files that changed lose the information calculated from them. An
+        // unknown fingerprint comes from an older cache, and is adopted.
+        const auto previous = tree->m_graph->get_node_fingerprint(child);
+        if (previous != fingerprint) {
+          if (!previous.is_empty()) {
+            tree->m_graph->clear_node_metadata(child);
+            ++modified;
+          }
+          tree->m_graph->set_node_fingerprint(child, fingerprint);
+        }
+      }
+
+      new_nodes = tree->m_graph->add_children(node, new_children);
+      for (auto index = std::size_t {0}; index < new_nodes.size(); ++index) {
+        tree->m_graph->set_node_fingerprint(new_nodes[index],
+                                            new_fingerprints[index]);
+      }
+
+      // Whatever was not found on disk has to be removed
+      auto removed_guard = std::scoped_lock(state.removed_mutex);
+      std::ranges::transform(current_children,
+                             std::back_inserter(state.removed),
+                             [](const auto& pair) { return pair.second; });
+      std::ranges::copy(new_nodes, std::back_inserter(state.new_nodes));
+    }
+    state.added += new_nodes.size();
+    state.modified += modified;
+
+    // New directories are scanned from scratch, while existing ones are
+    // refreshed
+    for (auto index = std::size_t {0}; index < new_nodes.size(); ++index) {
+      if (new_children[index].second != NodeType::directory) {
+        continue;
+      }
+
+      run_task(group,
+               [tree,
+                child_path = path / new_children[index].first,
+                child_node = new_nodes[index],
+                group]()
+               { scan_directory(tree, child_path, child_node, group); });
+    }
+
+    for (auto& [child_path, child_node] : existing_directories) {
+      run_task(group,
+               [tree,
+                child_path = std::move(child_path),
+                child_node = child_node,
+                group,
+                &state]()
+               {
+                 refresh_directory(
+                     tree, child_path, child_node, group, state);
+               });
+    }
+  }
+};
+
+FileTree::FileTree(std::filesystem::path root_path, std::size_t scan_threads)
     : m_root_path(std::move(root_path))
     , m_graph(std::make_unique<FileGraph>(true)) {
   // Check that the path is a directory
@@ -154,99 +561,399 @@ FileTree::FileTree(std::filesystem::path root_path)
   }
 
   // Create the file tree recursively
-  add_directory(m_root_path, /*add_files=*/true, /*recursive=*/true);
+  const auto root_node = m_graph->get_node({}).value();
+  HelperFunctions::run_scan(
+      scan_threads,
+      [this, root_node](tbb::task_group* group)
+      {
+        HelperFunctions::scan_directory(this, m_root_path, root_node, group);
+      });
 }
-auto FileTree::get_element(const std::filesystem::path& path)
-    -> std::optional<Element> {
-  // On empty path return the root
-  if (path.empty()) {
-    return std::make_optional<Element>(PathType::directory, m_root_path, this);
+auto FileTree::refresh(std::size_t scan_threads) -> RefreshSummary {
+  if (!fs::is_directory(m_root_path)) {
+    spdlog::error("Cannot refresh FileTree, root {} is not a directory.",
+                  m_root_path.string());
+    return {};
   }
 
-  // Check path
-  if (!is_subpath(path)) {
-    return {};
+  auto root_node = FileGraph::NodeId {};
+  {
+    auto guard = std::shared_lock(m_graph_mutex);
+    root_node = m_graph->get_node({}).value();
   }
 
-  const auto relative_path = std::filesystem::relative(path, m_root_path);
-  auto path_list = to_path_list(relative_path);
+  auto update_guard = std::scoped_lock(m_update_mutex);
+  auto state = HelperFunctions::RefreshState {};
+  HelperFunctions::run_scan(
+      scan_threads,
+      [this, root_node, &state](tbb::task_group* group)
+      {
+        HelperFunctions::refresh_directory(
+            this, m_root_path, root_node, group, state);
+      });
 
-  auto guard = std::shared_lock(m_graph_mutex);
-  const auto node = m_graph->get_node(path_list);
+  // Removals renumber the graph, so they are applied at once at the end,
+  // after the files that were moved got their metadata back
+  auto moved = std::size_t {0};
+  {
+    auto guard = std::scoped_lock(m_graph_mutex);
+    moved = HelperFunctions::reattach_moved_files(
+        this, state.removed, state.new_nodes);
+    m_graph->remove_nodes(state.removed);
+  }
 
-  if (!node) {
-    return {};
+  return RefreshSummary {
+      .added = state.added,
+      .removed = state.removed.size(),
+      .modified = state.modified,
+      .moved = moved,
+  };
+}
+auto FileTree::apply_events(boost::span<const FileEvent> events)
+    -> std::vector<std::filesystem::path> {
+  auto update_guard = std::scoped_lock(m_update_mutex);
+
+  // Removed nodes are only detached while the batch is applied, so the
+  // NodeIds stay valid until they are all removed at the end
+  auto detached = std::vector<FileGraph::NodeId> {};
+  auto new_directories = std::vector<fs::path> {};
+  auto changed_files = std::set<fs::path> {};
+  {
+    auto guard = std::scoped_lock(m_graph_mutex);
+
+    auto detach = [this, &detached](FileGraph::NodeId node)
+    {
+      if (m_graph->detach_node(node)) {
+        detached.push_back(node);
+      }
+    };
+
+    auto update_file = [this, &changed_files](FileGraph::NodeId node,
+                                              const fs::path& path)
+    {
+      // The file could have been removed already
+      const auto fingerprint = get_file_fingerprint(path);
+      if (!fingerprint) {
+        return;
+      }
+
+      const auto previous = m_graph->get_node_fingerprint(node);
+      if (previous != *fingerprint) {
+        if (!previous.is_empty()) {
+          m_graph->clear_node_metadata(node);
+        }
+        m_graph->set_node_fingerprint(node, *fingerprint);
+        changed_files.insert(path);
+      }
+    };
+
+    auto add_entry = [this, &detach, &update_file, &new_directories](
+                         const fs::path& path,
+                         std::vector<std::string>& path_list,
+                         bool is_directory)
+    {
+      const auto type = is_directory ? NodeType::directory : NodeType::file;
+      auto node = m_graph->get_node(path_list);
+      if (node && m_graph->get_node_type(*node) != type) {
+        detach(*node);
+        node = {};
+      }
+      if (!node) {
+        node = m_graph->add_node(path_list, type);
+      }
+
+      if (is_directory) {
+        new_directories.push_back(path);
+      } else {
+        update_file(*node, path);
+      }
+    };
+
+    for (const auto& event : events) {
+      auto path_list = get_path_list(event.path);
+      if (!path_list || path_list->empty()) {
+        continue;
+      }
+
+      switch (event.type) {
+        case FileEventType::created:
+          add_entry(event.path, *path_list, event.is_directory);
+          break;
+        case FileEventType::modified:
+          if (auto node = m_graph->get_node(*path_list);
+              node && m_graph->get_node_type(*node) == NodeType::file)
+          {
+            update_file(*node, event.path);
+          } else {
+            add_entry(event.path, *path_list, event.is_directory);
+          }
+          break;
+        case FileEventType::removed:
+          if (auto node = m_graph->get_node(*path_list)) {
+            detach(*node);
+          }
+          break;
+        case FileEventType::moved: {
+          auto node = m_graph->get_node(*path_list);
+          auto new_path_list = get_path_list(event.new_path);
+          if (!new_path_list || new_path_list->empty()) {
+            // Moved outside the tree
+            if (node) {
+              detach(*node);
+            }
+            break;
+          }
+
+          if (!node) {
+            add_entry(event.new_path, *new_path_list, event.is_directory);
+            break;
+          }
+
+          // Replaced entries are detached instead of letting the move remove
+          // them, which would renumber the graph
+          if (auto destination = m_graph->get_node(*new_path_list)) {
+            detach(*destination);
+          }
+          m_graph->move_node(*path_list, *new_path_list);
+
+          // Directories that are pending to be scanned moved along
+          for (auto& directory : new_directories) {
+            if (auto rebased =
+                    rebase_path(directory, event.path, event.new_path))
+            {
+              directory = std::move(*rebased);
+            }
+          }
+          break;
+        }
+        case FileEventType::overflow:
+          break;
+      }
+    }
   }
 
-  // Convert from NodeType to PathType
-  auto path_type = from_node_type(m_graph->get_node_type(*node));
+  // New directories could already have contents, these are compared with
+  // the disk to not duplicate entries that had their own events
+  auto state = HelperFunctions::RefreshState {};
+  for (const auto& directory : new_directories) {
+    auto node = std::optional<FileGraph::NodeId> {};
+    if (const auto path_list = get_path_list(directory)) {
+      auto guard = std::shared_lock(m_graph_mutex);
+      node = m_graph->get_node(*path_list);
+    }
 
-  return std::make_optional<Element>(path_type, fs::absolute(path), this);
-}
+    if (node) {
+      HelperFunctions::refresh_directory(
+          this, directory, *node, nullptr, state);
+    }
+  }
 
-// NOLINTNEXTLINE(misc-no-recursion)
-auto FileTree::add_directory(const std::filesystem::path& path,
-                             bool add_files,
-                             bool recursive) -> bool {
-  // Check that directory is subdirectory of root
-  if (path != m_root_path && !is_subpath(path)) {
-    spdlog::error("Path {} is not a subpath of root.", path.string());
-    return false;
+  {
+    auto guard = std::scoped_lock(m_graph_mutex);
+    std::ranges::copy(state.removed, std::back_inserter(detached));
+
+    // Files that left with a removal and came back with a creation, like
+    // moves from or to outside the watched folders, keep their metadata
+    auto added = std::move(state.new_nodes);
+    for (const auto& path : changed_files) {
+      if (const auto path_list = get_path_list(path)) {
+        if (const auto node = m_graph->get_node(*path_list)) {
+          added.push_back(*node);
+        }
+      }
+    }
+    HelperFunctions::reattach_moved_files(this, detached, added);
+
+    m_graph->remove_nodes(detached);
   }
 
-  // Check that it is a directory
-  if (!fs::is_directory(path)) {
-    spdlog::error("Path {} is not a directory.", path.string());
-    return false;
+  // Every file of the new directories is new
+  for (const auto& directory : new_directories) {
+    auto element = get_element(directory);
+    if (!element) {
+      continue;
+    }
+
+    for (auto iterator = FileTreeIterator(std::move(*element));
+         iterator != end();
+         ++iterator)
+    {
+      if (iterator->get_type() == PathType::file) {
+        changed_files.insert(iterator->get_path());
+      }
+    }
   }
 
-  // Set root dir as current dir
-  auto temporary_cwd = TempCurrentDir(m_root_path);
+  return {changed_files.begin(), changed_files.end()};
+}
+auto FileTree::rebase(const std::filesystem::path& new_root,
+                      std::size_t sample_size) -> bool {
+  if (!fs::is_directory(new_root)) {
+    spdlog::error("Cannot move FileTree, {} is not a directory.",
+                  new_root.string());
+    return false;
+  }
 
-  // Add the file to the internal representation
-  const auto relative_path = fs::relative(path, m_root_path);
-  auto path_list = to_path_list(relative_path);
-  if (path != m_root_path) {
-    auto guard = std::scoped_lock(m_graph_mutex);
-    m_graph->add_node(path_list, NodeType::directory);
-  } else {
-    // Clear the path list to not include "."
-    path_list.clear();
+  auto has_error = std::error_code {};
+  auto absolute_root = fs::absolute(new_root, has_error);
+  if (has_error) {
+    spdlog::error("Couldn't convert path {} to absolute. Error: {}",
+                  new_root.string(),
+                  has_error.message());
+    return false;
   }
 
-  // Iterate through all the files
-  for (auto directory_iterator = fs::directory_iterator(path);
-       directory_iterator != fs::directory_iterator();
-       ++directory_iterator)
+  auto update_guard = std::scoped_lock(m_update_mutex);
+  auto guard = std::scoped_lock(m_graph_mutex);
+
+  // Sample files with random walks from the root, which doesn't need to
+  // visit the whole tree
+  auto random = std::minstd_rand {};
+  auto checked = std::size_t {0};
+  auto matched = std::size_t {0};
+  const auto max_walks = 4 * sample_size;
+  for (auto walk = std::size_t {0}; walk < max_walks && checked < sample_size;
+       ++walk)
   {
-    // Check if it is directory or file
-    if (directory_iterator->is_directory() && recursive) {
-      add_directory(directory_iterator->path(), add_files, recursive);
-    } else if (directory_iterator->is_regular_file() && add_files) {
-      path_list.push_back(directory_iterator->path().filename().string());
-      auto guard = std::scoped_lock(m_graph_mutex);
-      m_graph->add_node(path_list, NodeType::file);
-      path_list.pop_back();
+    auto node = m_graph->get_node({}).value();
+    auto children = m_graph->get_node_children(node);
+    while (m_graph->get_node_type(node) == NodeType::directory
+           && !children.empty())
+    {
+      node = children[random() % children.size()];
+      children = m_graph->get_node_children(node);
     }
+    if (m_graph->get_node_type(node) != NodeType::file) {
+      continue;
+    }
+
+    auto path = absolute_root;
+    for (const auto& name : m_graph->get_node_path(node)) {
+      path /= name;
+    }
+    const auto previous = m_graph->get_node_fingerprint(node);
+    const auto current = get_file_fingerprint(path);
+    ++checked;
+    if (current && (previous.is_empty() || *current == previous)) {
+      ++matched;
+    }
+  }
+
+  // Without any file there is no evidence that the folder is the same
+  if (checked == 0) {
+    spdlog::error("Cannot move FileTree to {}, no file could be sampled.",
+                  new_root.string());
+    return false;
+  }
+
+  // Some files could have changed since the tree was stored
+  constexpr auto min_matched_percent = std::size_t {90};
+  if (matched * 100 < checked * min_matched_percent) {
+    spdlog::error("Cannot move FileTree to {}, only {} of {} sampled files "
+                  "match.",
+                  new_root.string(),
+                  matched,
+                  checked);
+    return false;
   }
 
+  m_root_path = std::move(absolute_root);
   return true;
 }
+auto FileTree::get_element(const std::filesystem::path& path)
+    -> std::optional<Element> {
+  // On empty path return the root
+  if (path.empty()) {
+    return std::make_optional<Element>(PathType::directory, m_root_path, this);
+  }
+
+  // Check path
+  const auto absolute_path = resolve_path(path);
+  const auto path_list = get_path_list(absolute_path);
+  if (!path_list) {
+    return {};
+  }
+
+  auto guard = std::shared_lock(m_graph_mutex);
+  const auto node = m_graph->get_node(*path_list);
+
+  if (!node) {
+    return {};
+  }
+
+  // Convert from NodeType to PathType
+  auto path_type = from_node_type(m_graph->get_node_type(*node));
+
+  return Element {
+      path_type, absolute_path, this, *node, m_graph->get_generation()};
+}
+
 auto FileTree::is_subpath(const std::filesystem::path& path) const -> bool {
+  return get_path_list(path).has_value();
+}
+auto FileTree::resolve_path(const std::filesystem::path& path) const
+    -> std::filesystem::path {
+  if (path.is_absolute()) {
+    return path;
+  }
+  return m_root_path / path;
+}
+auto FileTree::get_path_list(const std::filesystem::path& path) const
+    -> std::optional<std::vector<std::string>> {
   if (path == m_root_path) {
-    return true;
+    return std::vector<std::string> {};
+  }
+
+  // Most paths are plain paths under the root, which don't need the disk
+  if (auto path_list = get_lexical_path_list(path)) {
+    return path_list;
   }
 
+  // Fall back to resolving symlinks and dot components through the disk
   auto error_code = std::error_code {};
   const auto relative_path = fs::relative(path, m_root_path, error_code);
   if (error_code) {
-    spdlog::error("Couldn't add directory {}. Error: {}",
+    spdlog::error("Couldn't resolve path {}. Error: {}",
                   path.string(),
                   error_code.message());
-    return false;
+    return {};
   }
 
-  return !relative_path.empty() && relative_path.native()[0] != '.';
+  // Paths outside the root start by going to the parent
+  if (relative_path.empty() || *relative_path.begin() == "..") {
+    return {};
+  }
+  if (relative_path == ".") {
+    return std::vector<std::string> {};
+  }
+  return to_path_list(relative_path);
+}
+auto FileTree::get_lexical_path_list(const std::filesystem::path& path) const
+    -> std::optional<std::vector<std::string>> {
+  // Match the components of the root, ignoring a trailing separator
+  auto position = path.begin();
+  for (const auto& root_component : m_root_path) {
+    if (root_component.empty()) {
+      continue;
+    }
+    if (position == path.end() || *position != root_component) {
+      return {};
+    }
+    ++position;
+  }
+
+  // The rest are the names in the tree, unless they need to be resolved
+  auto path_list = std::vector<std::string> {};
+  for (; position != path.end(); ++position) {
+    if (position->empty()) {
+      continue;
+    }
+    if (*position == "." || *position == "..") {
+      return {};
+    }
+    path_list.push_back(position->string());
+  }
+  return path_list;
 }
 auto FileTree::to_path_list(const std::filesystem::path& path)
     -> std::vector<std::string> {
@@ -286,11 +993,38 @@ auto FileTree::begin() -> FileTreeIterator {
 auto FileTree::end() -> FileTreeIterator {
   return FileTreeIterator();
 }
-void FileTree::to_stream(std::ostream& output) const {
-  auto archiver = boost::archive::binary_oarchive {output};
-  archiver << *this;
+void FileTree::to_stream(std::ostream& output,
+                         StreamCompression compression) const {
+  if (compression == StreamCompression::none) {
+    auto archiver = boost::archive::binary_oarchive {output};
+    archiver << *this;
+    return;
+  }
+
+  // The archive is compressed as a whole, after it is written
+  auto buffer = std::ostringstream {};
+  {
+    auto archiver = boost::archive::binary_oarchive {buffer};
+    archiver << *this;
+  }
+  CompressedStream::write(buffer.view(), output);
+}
+auto FileTree::write_mapped(const std::filesystem::path& path) const -> bool {
+  // Exclusive as in save, so no metadata is written while the columns are
+  // copied
+  auto guard = std::scoped_lock(m_graph_mutex);
+  return MappedFileTree::write(m_graph->freeze(), m_root_path, path);
 }
 auto FileTree::from_stream(std::istream& input) -> std::optional<FileTree> {
+  if (CompressedStream::is_compressed(input)) {
+    auto data = CompressedStream::read(input);
+    if (!data) {
+      return {};
+    }
+    auto buffer = std::istringstream {std::move(*data)};
+    return from_stream(buffer);
+  }
+
   auto archiver = boost::archive::binary_iarchive {input};
   try {
     auto new_tree = files::FileTree {};
@@ -305,105 +1039,343 @@ auto FileTree::from_stream(std::istream& input) -> std::optional<FileTree> {
 auto FileTree::get_elements_under_path(const std::filesystem::path& path,
                                        std::vector<Element>& output) -> bool {
   // Check if path belongs to the tree
-  if (!is_subpath(path)) {
+  const auto path_list = get_path_list(resolve_path(path));
+  if (!path_list) {
     return false;
   }
 
   // Get the children under the path
-  const auto relative_path = fs::relative(path, m_root_path);
-  auto path_list = to_path_list(relative_path);
-  auto node = std::optional<FileGraph::NodeId> {};
-  {
-    auto guard = std::shared_lock(m_graph_mutex);
-    node = m_graph->get_node(path_list);
-    if (!node) {
-      return false;
-    }
+  auto guard = std::shared_lock(m_graph_mutex);
+  const auto node = m_graph->get_node(*path_list);
+  if (!node) {
+    return false;
   }
 
-  auto children = std::vector<FileGraph::NodeId> {};
-  {
-    auto guard = std::shared_lock(m_graph_mutex);
-    children = m_graph->get_node_children(*node);
+  auto node_path = m_root_path;
+  for (const auto& name : *path_list) {
+    node_path /= name;
+  }
+  add_child_elements(*node, node_path, output);
+  return true;
+}
+auto FileTree::get_root_element() -> Element {
+  auto guard = std::shared_lock(m_graph_mutex);
+  return {PathType::directory,
+          m_root_path,
+          this,
+          m_graph->get_node({}).value(),
+          m_graph->get_generation()};
+}
+auto FileTree::get_metadata_mutex(FileGraph::NodeId node) const
+    -> std::mutex& {
+  return m_metadata_mutexes[node % m_metadata_mutexes.size()].mutex;
+}
+auto FileTree::get_element_node(const Element& element) const
+    -> std::optional<FileGraph::NodeId> {
+  if (element.m_generation == m_graph->get_generation()) {
+    return element.m_node;
   }
 
-  // Create the Elements from the children
-  std::ranges::transform(
-      children,
-      std::back_inserter(output),
-      [this](auto child)
-      {
-        auto guard = std::scoped_lock(m_graph_mutex);
-        auto type = m_graph->get_node_type(child);
-        auto current_path_list = m_graph->get_node_path(child);
+  // The node is unknown or was renumbered, so find it by its path
+  const auto path_list = get_path_list(resolve_path(element.get_path()));
+  if (!path_list) {
+    return {};
+  }
+  return m_graph->get_node(*path_list);
+}
+void FileTree::add_child_elements(FileGraph::NodeId node,
+                                  const std::filesystem::path& path,
+                                  std::vector<Element>& output) {
+  const auto children = m_graph->get_node_children(node);
+  output.reserve(output.size() + children.size());
+  for (const auto child : children) {
+    output.push_back(
+        Element {from_node_type(m_graph->get_node_type(child)),
+                 path / m_graph->get_node_name(child),
+                 this,
+                 child,
+                 m_graph->get_generation()});
+  }
+}
+auto FileTree::get_children(const Element& element) -> std::vector<Element> {
+  auto guard = std::shared_lock(m_graph_mutex);
+  const auto node = get_element_node(element);
+  if (!node) {
+    return {};
+  }
 
-        auto current_path = m_root_path;
-        for (auto& element : current_path_list) {
-          current_path.append(element);
-        }
+  auto ret = std::vector<Element> {};
+  add_child_elements(*node, element.get_path(), ret);
+  return ret;
+}
+auto FileTree::get_parent(const Element& element) -> std::optional<Element> {
+  auto guard = std::shared_lock(m_graph_mutex);
+  const auto node = get_element_node(element);
+  if (!node) {
+    return {};
+  }
 
-        return Element {from_node_type(type), current_path, this};
-      });
+  const auto parent = m_graph->get_node_parent(*node);
+  if (!parent) {
+    return {};
+  }
+
+  return Element {from_node_type(m_graph->get_node_type(*parent)),
+                  element.get_path().parent_path(),
+                  this,
+                  *parent,
+                  m_graph->get_generation()};
+}
+auto FileTree::set_metadata(const Element& element,
+                            AttributeKey key,
+                            const PathAttribute& attribute)
+    -> std::optional<PathAttribute> {
+  auto guard = std::shared_lock(m_graph_mutex);
+  const auto node = get_element_node(element);
+  if (!node) {
+    return {};
+  }
+
+  auto node_guard = std::scoped_lock(get_metadata_mutex(*node));
+  return m_graph->set_node_metadata(*node, key, attribute);
+}
+auto FileTree::get_metadata(const Element& element, AttributeKey key) const
+    -> std::optional<PathAttribute> {
+  auto guard = std::shared_lock(m_graph_mutex);
+  const auto node = get_element_node(element);
+  if (!node) {
+    return {};
+  }
+
+  auto node_guard = std::scoped_lock(get_metadata_mutex(*node));
+  return m_graph->get_node_metadata(*node, key);
+}
+auto FileTree::remove_metadata(const Element& element, AttributeKey key)
+    -> std::optional<PathAttribute> {
+  auto guard = std::shared_lock(m_graph_mutex);
+  const auto node = get_element_node(element);
+  if (!node) {
+    return {};
+  }
+
+  auto node_guard = std::scoped_lock(get_metadata_mutex(*node));
+  return m_graph->remove_node_metadata(*node, key);
+}
+auto FileTree::set_metadata(const Element& element,
+                            boost::span<const MetadataEntry> entries) -> bool {
+  auto guard = std::shared_lock(m_graph_mutex);
+  const auto node = get_element_node(element);
+  if (!node) {
+    return false;
+  }
 
+  auto node_guard = std::scoped_lock(get_metadata_mutex(*node));
+  for (const auto& entry : entries) {
+    m_graph->set_node_metadata(*node, entry.key, entry.attribute);
+  }
   return true;
 }
-auto FileTree::get_root_element() -> Element {
-  return {PathType::directory, m_root_path, this};
+auto FileTree::get_metadata(const Element& element,
+                            boost::span<const AttributeKey> keys) const
+    -> std::vector<std::optional<PathAttribute>> {
+  auto ret = std::vector<std::optional<PathAttribute>>(keys.size());
+  auto guard = std::shared_lock(m_graph_mutex);
+  const auto node = get_element_node(element);
+  if (!node) {
+    return ret;
+  }
+
+  auto node_guard = std::scoped_lock(get_metadata_mutex(*node));
+  for (auto index = std::size_t {0}; index < keys.size(); ++index) {
+    ret[index] = m_graph->get_node_metadata(*node, keys[index]);
+  }
+  return ret;
+}
+auto FileTree::get_hashes(const Element& element,
+                          boost::span<const HashColumn> columns) const
+    -> std::vector<std::optional<std::uint64_t>> {
+  auto ret = std::vector<std::optional<std::uint64_t>>(columns.size());
+  auto guard = std::shared_lock(m_graph_mutex);
+  const auto node = get_element_node(element);
+  if (!node) {
+    return ret;
+  }
+
+  auto node_guard = std::scoped_lock(get_metadata_mutex(*node));
+  const auto& attribute_columns = m_graph->get_columns();
+  for (auto index = std::size_t {0}; index < columns.size(); ++index) {
+    ret[index] = attribute_columns.get_hash(columns[index], *node);
+  }
+  return ret;
+}
+auto FileTree::set_hashes(const Element& element,
+                          boost::span<const HashColumn> columns,
+                          boost::span<const std::uint64_t> hashes,
+                          std::optional<std::uint8_t> state) -> bool {
+  auto guard = std::shared_lock(m_graph_mutex);
+  const auto node = get_element_node(element);
+  if (!node) {
+    return false;
+  }
+
+  auto node_guard = std::scoped_lock(get_metadata_mutex(*node));
+  auto& attribute_columns = m_graph->get_columns();
+  for (auto index = std::size_t {0}; index < columns.size(); ++index) {
+    attribute_columns.set_hash(columns[index], *node, hashes[index]);
+  }
+  if (state) {
+    attribute_columns.set_state(*node, *state);
+  }
+  return true;
+}
+auto FileTree::get_state(const Element& element) const -> std::uint8_t {
+  auto guard = std::shared_lock(m_graph_mutex);
+  const auto node = get_element_node(element);
+  if (!node) {
+    return 0;
+  }
+
+  auto node_guard = std::scoped_lock(get_metadata_mutex(*node));
+  return m_graph->get_columns().get_state(*node);
+}
+void FileTree::set_state(const Element& element, std::uint8_t state) {
+  auto guard = std::shared_lock(m_graph_mutex);
+  const auto node = get_element_node(element);
+  if (!node) {
+    return;
+  }
+
+  auto node_guard = std::scoped_lock(get_metadata_mutex(*node));
+  m_graph->get_columns().set_state(*node, state);
+}
+auto FileTree::get_fingerprint(const Element& element) const
+    -> FileFingerprint {
+  // Fingerprints only change with the structure, under the exclusive lock
+  auto guard = std::shared_lock(m_graph_mutex);
+  const auto node = get_element_node(element);
+  if (!node) {
+    return {};
+  }
+  return m_graph->get_node_fingerprint(*node);
+}
+auto FileTree::set_metadata_batch(boost::span<const MetadataWrite> writes)
+    -> std::size_t {
+  auto guard = std::shared_lock(m_graph_mutex);
+  auto nodes = std::vector<HelperFunctions::BatchNode> {};
+  nodes.reserve(writes.size());
+  for (auto index = std::size_t {0}; index < writes.size(); ++index) {
+    if (const auto node = get_element_node(*writes[index].element)) {
+      nodes.emplace_back(*node, index);
+    }
+  }
+
+  HelperFunctions::for_each_by_stripe(
+      this,
+      nodes,
+      [this, writes](FileGraph::NodeId node, std::size_t index)
+      {
+        const auto& write = writes[index];
+        m_graph->set_node_metadata(node, write.key, write.attribute);
+      });
+  return nodes.size();
+}
+auto FileTree::get_metadata_batch(boost::span<const Element> elements,
+                                  AttributeKey key) const
+    -> std::vector<std::optional<PathAttribute>> {
+  auto ret = std::vector<std::optional<PathAttribute>>(elements.size());
+  auto guard = std::shared_lock(m_graph_mutex);
+  auto nodes = std::vector<HelperFunctions::BatchNode> {};
+  nodes.reserve(elements.size());
+  for (auto index = std::size_t {0}; index < elements.size(); ++index) {
+    if (const auto node = get_element_node(elements[index])) {
+      nodes.emplace_back(*node, index);
+    }
+  }
+
+  HelperFunctions::for_each_by_stripe(
+      this,
+      nodes,
+      [this, &ret, key](FileGraph::NodeId node, std::size_t index)
+      { ret[index] = m_graph->get_node_metadata(node, key); });
+  return ret;
+}
+auto FileTree::get_hash_batch(boost::span<const Element> elements,
+                              HashColumn column) const
+    -> std::vector<std::optional<std::uint64_t>> {
+  auto ret = std::vector<std::optional<std::uint64_t>>(elements.size());
+  auto guard = std::shared_lock(m_graph_mutex);
+  auto nodes = std::vector<HelperFunctions::BatchNode> {};
+  nodes.reserve(elements.size());
+  for (auto index = std::size_t {0}; index < elements.size(); ++index) {
+    if (const auto node = get_element_node(elements[index])) {
+      nodes.emplace_back(*node, index);
+    }
+  }
+
+  const auto& attribute_columns = m_graph->get_columns();
+  HelperFunctions::for_each_by_stripe(
+      this,
+      nodes,
+      [&attribute_columns, &ret, column](FileGraph::NodeId node,
+                                         std::size_t index)
+      { ret[index] = attribute_columns.get_hash(column, node); });
+  return ret;
 }
 auto FileTree::set_metadata(const std::filesystem::path& path,
                             const std::string& key,
                             const PathAttribute& attribute)
     -> std::optional<PathAttribute> {
   // Check if path belongs to the tree
-  if (!is_subpath(path)) {
+  const auto path_list = get_path_list(resolve_path(path));
+  if (!path_list) {
     return {};
   }
-  const auto relative_path = fs::relative(path, m_root_path);
-  auto path_list = to_path_list(relative_path);
 
-  auto guard = std::scoped_lock(m_graph_mutex);
-  const auto node = m_graph->get_node(path_list);
+  // Only the metadata of the node changes, so the graph can be shared
+  auto guard = std::shared_lock(m_graph_mutex);
+  const auto node = m_graph->get_node(*path_list);
   if (!node) {
     return {};
   }
 
+  auto node_guard = std::scoped_lock(get_metadata_mutex(*node));
   return m_graph->set_node_metadata(node.value(), key, attribute);
 }
 auto FileTree::get_metadata(const std::filesystem::path& path,
                             const std::string& key) const
     -> std::optional<PathAttribute> {
   // Check if path belongs to the tree
-  if (!is_subpath(path)) {
+  const auto path_list = get_path_list(resolve_path(path));
+  if (!path_list) {
     return {};
   }
-  const auto relative_path = fs::relative(path, m_root_path);
-  auto path_list = to_path_list(relative_path);
 
   auto guard = std::shared_lock(m_graph_mutex);
-  const auto node = m_graph->get_node(path_list);
+  const auto node = m_graph->get_node(*path_list);
   if (!node) {
     return {};
   }
 
   // Retrieve the node metadata
+  auto node_guard = std::scoped_lock(get_metadata_mutex(*node));
   return m_graph->get_node_metadata(node.value(), key);
 }
 auto FileTree::remove_metadata(const std::filesystem::path& path,
                                const std::string& key)
     -> std::optional<PathAttribute> {
   // Check if path belongs to the tree
-  if (!is_subpath(path)) {
+  const auto path_list = get_path_list(resolve_path(path));
+  if (!path_list) {
     return {};
   }
-  const auto relative_path = fs::relative(path, m_root_path);
-  auto path_list = to_path_list(relative_path);
 
-  auto guard = std::scoped_lock(m_graph_mutex);
-  const auto node = m_graph->get_node(path_list);
+  auto guard = std::shared_lock(m_graph_mutex);
+  const auto node = m_graph->get_node(*path_list);
   if (!node) {
     return {};
   }
 
+  auto node_guard = std::scoped_lock(get_metadata_mutex(*node));
   return m_graph->remove_node_metadata(node.value(), key);
 }
 FileTreeIterator::FileTreeIterator(value_type starting_element) {
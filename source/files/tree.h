@@ -5,7 +5,10 @@
 #ifndef ALBUMARCHITECT_TREE_H
 #define ALBUMARCHITECT_TREE_H
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <filesystem>
 #include <istream>
 #include <iterator>
@@ -13,13 +16,18 @@
 #include <mutex>
 #include <optional>
 #include <ostream>
+#include <shared_mutex>
 #include <string>
 #include <vector>
 
+#include <boost/core/span.hpp>
 #include <boost/serialization/split_member.hpp>
 #include <boost/serialization/unique_ptr.hpp>
 
+#include "files/attribute_columns.h"
+#include "files/attribute_map.h"
 #include "files/common.h"
+#include "files/compressed_stream.h"
 #include "files/graph.h"
 
 namespace album_architect::files {
@@ -35,7 +43,16 @@ enum class NodeType : std::uint8_t;
 /// \return
 auto from_node_type(const NodeType& path_type) -> PathType;
 
-/// Represents an element from within the FileTree
+/// Metadata attribute to store with a key, as part of a batch
+struct MetadataEntry {
+  AttributeKey key;
+  PathAttribute attribute;
+};
+
+/// Represents an element from within the FileTree. Elements obtained from the
+/// tree remember their node, so their operations don't need to find the path
+/// in the tree again. If the tree removes nodes afterwards, they fall back to
+/// finding their path.
 class Element {
 public:
   using ElementList = std::vector<Element>;
@@ -75,23 +92,107 @@ public:
   /// \return Previous attribute if any
   auto set_metadata(const std::string& key, const PathAttribute& attribute)
       -> std::optional<PathAttribute>;
+  auto set_metadata(AttributeKey key, const PathAttribute& attribute)
+      -> std::optional<PathAttribute>;
 
-  /// Returns the metadata for the given node, if any
+  /// Returns the metadata for the given node, if any. Looking up by
+  /// AttributeKey avoids finding the name of the key.
   /// \param key Key to get the value from
   /// \return Optional with a copy of the attribute
   auto get_metadata(const std::string& key) const
       -> std::optional<PathAttribute>;
+  auto get_metadata(AttributeKey key) const -> std::optional<PathAttribute>;
 
   /// Removes the metadata from the node with the given key
   /// \param node
   /// \param key Key to get the value from
   /// \return Optional with the removed attribute
   auto remove_metadata(const std::string& key) -> std::optional<PathAttribute>;
+  auto remove_metadata(AttributeKey key) -> std::optional<PathAttribute>;
+
+  /// Sets several metadata values at once. The node is found and locked only
+  /// once for all of them.
+  /// \param entries Keys and attributes to store
+  /// \return True if the element is still part of the tree
+  auto set_metadata(boost::span<const MetadataEntry> entries) -> bool;
+
+  /// Returns the metadata for several keys at once
+  /// \param keys Keys to get the values from
+  /// \return Optional with a copy of the attribute of each key, in order
+  auto get_metadata(boost::span<const AttributeKey> keys) const
+      -> std::vector<std::optional<PathAttribute>>;
+
+  /// Returns the stored hash of the element, if any
+  /// \param column
+  /// \return
+  auto get_hash(HashColumn column) const -> std::optional<std::uint64_t>;
+
+  /// Returns several stored hashes at once
+  /// \param columns
+  /// \return Hash of each column, in order
+  auto get_hashes(boost::span<const HashColumn> columns) const
+      -> std::vector<std::optional<std::uint64_t>>;
+
+  /// Stores several hashes together with the state, at once
+  /// \param columns
+  /// \param hashes Hash of each column
+  /// \param state State to store, 0 removes it and None keeps the current
+  /// \return True if the element is still part of the tree
+  auto set_hashes(boost::span<const HashColumn> columns,
+                  boost::span<const std::uint64_t> hashes,
+                  std::optional<std::uint8_t> state) -> bool;
+
+  /// Returns the stored state of the element, 0 if there is none
+  /// \return
+  auto get_state() const -> std::uint8_t;
+
+  /// Stores the state of the element
+  /// \param state State to store, 0 removes it
+  void set_state(std::uint8_t state);
+
+  /// Returns the fingerprint recorded for the file when the tree was scanned.
+  /// It is empty for directories, or if it is unknown.
+  /// \return
+  auto get_fingerprint() const -> FileFingerprint;
 
 private:
+  friend class FileTree;
+
+  /// Creates an Element for a node of the tree
+  /// \param type
+  /// \param path
+  /// \param parent
+  /// \param node
+  /// \param generation Generation of the graph when the node was found
+  Element(PathType type,
+          std::filesystem::path path,
+          FileTree* parent,
+          FileGraph::NodeId node,
+          std::uint64_t generation);
+
   PathType m_type;
   std::filesystem::path m_path;
   FileTree* m_parent;
+
+  /// Node of the element, only valid while the graph has the same generation.
+  /// A generation of 0 means that the node is unknown.
+  FileGraph::NodeId m_node = 0;
+  std::uint64_t m_generation = 0;
+};
+
+/// Metadata attribute to store in an element, as part of a batch
+struct MetadataWrite {
+  const Element* element;
+  AttributeKey key;
+  PathAttribute attribute;
+};
+
+/// Summary of the changes applied when refreshing a FileTree
+struct RefreshSummary {
+  std::size_t added = 0;  // New entries, a new directory counts only once
+  std::size_t removed = 0;  // Entries that no longer exist, with their contents
+  std::size_t modified = 0;  // Files whose fingerprint changed
+  std::size_t moved = 0;  // New files that kept the metadata of a removed one
 };
 
 /// Represents a tree from the filesystem, mirroring the values inside
@@ -110,22 +211,65 @@ public:
 
   /// Creates a file tree from the specified root directory.
   /// \param path Path to a directory to search recursively.
+  /// \param scan_threads Number of threads used to scan the directories. A
+  /// value of 1 scans sequentially, 0 uses all the available cores.
   /// \return A file tree, or None if a directory is not specified
-  static auto build(const std::filesystem::path& path)
-      -> std::optional<FileTree>;
-
-  /// Builds a filetree from the provided stream
+  static auto build(const std::filesystem::path& path,
+                    std::size_t scan_threads = 1) -> std::optional<FileTree>;
+
+  /// Walks the root directory again and applies only the differences with
+  /// the tree. New entries are added, missing ones are removed and files whose
+  /// fingerprint (size, modification time, inode) changed lose their metadata.
+  /// Metadata of untouched files is kept.
+  /// \param scan_threads Threads used for scanning, 0 for all cores
+  /// \return Summary of the applied changes
+  auto refresh(std::size_t scan_threads = 1) -> RefreshSummary;
+
+  /// Applies a batch of filesystem events to the tree. The graph lock is taken
+  /// once for the whole batch, and removals are applied together at the end.
+  /// Directories that appear are scanned, and files whose fingerprint changed
+  /// lose their metadata. Overflow events are ignored, a refresh should be
+  /// done instead.
+  /// \param events Events with absolute paths, in the order they happened
+  /// \return Paths of the files that are new or changed and could need to be
+  /// analyzed again
+  auto apply_events(boost::span<const FileEvent> events)
+      -> std::vector<std::filesystem::path>;
+
+  /// Moves the tree to another root, for when the photos folder was moved or
+  /// mounted somewhere else. Paths in the tree are relative to the root, so
+  /// all the metadata is kept. Some files are checked first, and the tree is
+  /// only moved if most of them are found under the new root with the same
+  /// fingerprint. A tree where no file can be sampled is never moved.
+  /// Elements returned before keep their previous paths. Not thread-safe
+  /// with other calls.
+  /// \param new_root
+  /// \param sample_size Number of files to check
+  /// \return True if the tree was moved
+  auto rebase(const std::filesystem::path& new_root,
+              std::size_t sample_size = 32) -> bool;
+
+  /// Builds a filetree from the provided stream, compressed or not
   /// \param input
   /// \return
   static auto from_stream(std::istream& input) -> std::optional<FileTree>;
 
   /// Writes the FileTree to the provided stream
   /// \param output
-  /// \return
-  void to_stream(std::ostream& output) const;
+  /// \param compression
+  void to_stream(std::ostream& output,
+                 StreamCompression compression = StreamCompression::none) const;
+
+  /// Writes the FileTree in the format of MappedFileTree, which can be
+  /// queried without loading it. The metadata map of the elements is not
+  /// written, only the attribute columns.
+  /// \param path File to write
+  /// \return False if the file couldn't be written
+  auto write_mapped(const std::filesystem::path& path) const -> bool;
 
   /// Returns an optional PathType if the given path is part of the tree. In
-  /// case it exists it returns the path type.
+  /// case it exists it returns the path type. Relative paths are resolved
+  /// against the root of the tree, not the current directory.
   /// \param path
   /// \return
   auto get_element(const std::filesystem::path& path) -> std::optional<Element>;
@@ -163,6 +307,32 @@ public:
   auto remove_metadata(const std::filesystem::path& path,
                        const std::string& key) -> std::optional<PathAttribute>;
 
+  /// Sets the metadata of many elements at once. The graph lock is taken once
+  /// for the whole batch, and the lock of each stripe of nodes only once.
+  /// Writes to elements that are no longer in the tree are skipped.
+  /// \param writes Elements, keys and attributes to store
+  /// \return Number of attributes stored
+  auto set_metadata_batch(boost::span<const MetadataWrite> writes)
+      -> std::size_t;
+
+  /// Returns the metadata of many elements at once, with the same locking as
+  /// set_metadata_batch
+  /// \param elements
+  /// \param key Key to get the values from
+  /// \return Optional with a copy of the attribute of each element, in order
+  auto get_metadata_batch(boost::span<const Element> elements,
+                          AttributeKey key) const
+      -> std::vector<std::optional<PathAttribute>>;
+
+  /// Returns a stored hash of many elements at once, with the same locking as
+  /// set_metadata_batch
+  /// \param elements
+  /// \param column
+  /// \return Stored hash of each element, in order
+  auto get_hash_batch(boost::span<const Element> elements,
+                      HashColumn column) const
+      -> std::vector<std::optional<std::uint64_t>>;
+
   /// Outputs a graphviz representation to the given stream
   /// \param ostream
   void to_graphviz(std::ostream& ostream) const;
@@ -208,20 +378,12 @@ public:
   auto end() -> FileTreeIterator;
 
 private:
-  /// Adds a directory that is a part of the filesystem
-  /// \param path Path to use
-  /// \param add_files Add files to the tree
-  /// \param recursive Recursively add the sub-directories
-  /// \return
-  auto add_directory(const std::filesystem::path& path,
-                     bool add_files,
-                     bool recursive) -> bool;
-
   /// Recursively populates the tree with all the files and folders under the
   /// root path. Root path should be a directory. If a file is provided an
   /// exception is thrown.
   /// \param root_path
-  explicit FileTree(std::filesystem::path root_path);
+  /// \param scan_threads Threads used for scanning, 0 for all cores
+  FileTree(std::filesystem::path root_path, std::size_t scan_threads);
 
   /// Default constructor to allow building from a stream
   FileTree() = default;
@@ -231,15 +393,105 @@ private:
   /// \return
   auto is_subpath(const std::filesystem::path& path) const -> bool;
 
+  /// Resolves the given path within the tree. Relative paths are taken as
+  /// relative to the root, so no resolution depends on the current directory.
+  /// \param path
+  /// \return Absolute path
+  auto resolve_path(const std::filesystem::path& path) const
+      -> std::filesystem::path;
+
+  /// Converts an absolute path into a path list relative to the root. Paths
+  /// under the root are matched lexically, only other paths are resolved
+  /// through the filesystem, which can be slow on network drives.
+  /// \param path
+  /// \return Path list, or None if the path is not part of the tree
+  auto get_path_list(const std::filesystem::path& path) const
+      -> std::optional<std::vector<std::string>>;
+
+  /// Converts a path into a path list relative to the root, without accessing
+  /// the filesystem
+  /// \param path
+  /// \return Path list, or None if the path doesn't start with the root or
+  /// has dot components
+  auto get_lexical_path_list(const std::filesystem::path& path) const
+      -> std::optional<std::vector<std::string>>;
+
   /// Converts a path into a path list
   /// \param path
   /// \return
   static auto to_path_list(const std::filesystem::path& path)
       -> std::vector<std::string>;
 
+  /// Returns the node of the element. Uses the node stored in the element if
+  /// the graph didn't change its numbering since, otherwise finds its path
+  /// again. The graph lock has to be held.
+  /// \param element
+  /// \return
+  auto get_element_node(const Element& element) const
+      -> std::optional<FileGraph::NodeId>;
+
+  /// Creates the Elements of the children of the node. The graph lock has to
+  /// be held.
+  /// \param node
+  /// \param path Path of the node
+  /// \param output
+  void add_child_elements(FileGraph::NodeId node,
+                          const std::filesystem::path& path,
+                          std::vector<Element>& output);
+
+  // Operations of Element, through its node
+  auto get_children(const Element& element) -> std::vector<Element>;
+  auto get_parent(const Element& element) -> std::optional<Element>;
+  auto set_metadata(const Element& element,
+                    AttributeKey key,
+                    const PathAttribute& attribute)
+      -> std::optional<PathAttribute>;
+  auto get_metadata(const Element& element, AttributeKey key) const
+      -> std::optional<PathAttribute>;
+  auto remove_metadata(const Element& element, AttributeKey key)
+      -> std::optional<PathAttribute>;
+  auto set_metadata(const Element& element,
+                    boost::span<const MetadataEntry> entries) -> bool;
+  auto get_metadata(const Element& element,
+                    boost::span<const AttributeKey> keys) const
+      -> std::vector<std::optional<PathAttribute>>;
+  auto get_hashes(const Element& element,
+                  boost::span<const HashColumn> columns) const
+      -> std::vector<std::optional<std::uint64_t>>;
+  auto set_hashes(const Element& element,
+                  boost::span<const HashColumn> columns,
+                  boost::span<const std::uint64_t> hashes,
+                  std::optional<std::uint8_t> state) -> bool;
+  auto get_state(const Element& element) const -> std::uint8_t;
+  void set_state(const Element& element, std::uint8_t state);
+  auto get_fingerprint(const Element& element) const -> FileFingerprint;
+
   std::filesystem::path m_root_path;
   std::unique_ptr<FileGraph> m_graph;
+
+  /// Protects the graph. Changes to the structure take it exclusively, while
+  /// reading or writing the metadata of a node only needs it shared plus the
+  /// lock of the node, so metadata writes of different nodes run in parallel.
   mutable std::shared_mutex m_graph_mutex;
+
+  /// Lock for the metadata of a stripe of nodes, in its own cache line
+  struct alignas(64) MetadataMutex {
+    std::mutex mutex;
+  };
+  mutable std::array<MetadataMutex, 256> m_metadata_mutexes;
+
+  /// Returns the lock that protects the metadata of the node
+  /// \param node
+  /// \return
+  auto get_metadata_mutex(FileGraph::NodeId node) const -> std::mutex&;
+
+  /// Serializes the updates that remove nodes, as removals renumber the graph
+  std::mutex m_update_mutex;
+
+  /// Contains internal helper functions
+  struct HelperFunctions;
+
+  friend class Element;
 };
 
 /// Allows for recursive iteration of the whole FileTree
@@ -0,0 +1,274 @@
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "files/watcher.h"
+
+#include <spdlog/spdlog.h>
+
+#include "files/common.h"
+#include "files/helper.h"
+
+#ifdef __linux__
+#  include <poll.h>
+#  include <sys/inotify.h>
+#  include <unistd.h>
+#endif
+
+namespace album_architect::files {
+
+namespace fs = std::filesystem;
+
+namespace {
+/// Maximum amount of events gathered in a single batch
+constexpr auto max_batch_size = std::size_t {65536};
+
+/// Time to wait for more events once a batch has started
+constexpr auto batch_settle_time = std::chrono::milliseconds {50};
+
+#ifdef __linux__
+/// Changes that are watched on every directory
+constexpr auto watch_mask = std::uint32_t {
+    IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO
+    | IN_ONLYDIR};
+
+/// Size of the buffer used for reading events
+constexpr auto event_buffer_size = std::size_t {64 * 1024};
+#endif
+
+/// Creates an event for a single path
+/// \param type
+/// \param path
+/// \param is_directory
+/// \return
+auto make_event(FileEventType type, fs::path path, bool is_directory)
+    -> FileEvent {
+  auto event = FileEvent {};
+  event.type = type;
+  event.path = std::move(path);
+  event.is_directory = is_directory;
+  return event;
+}
+}  // namespace
+
+FileWatcher::FileWatcher(int descriptor, std::filesystem::path root)
+    : m_descriptor(descriptor)
+    , m_root(std::move(root)) {}
+FileWatcher::~FileWatcher() {
+#ifdef __linux__
+  if (m_descriptor >= 0) {
+    ::close(m_descriptor);
+  }
+#endif
+}
+FileWatcher::FileWatcher(FileWatcher&& other) noexcept
+    : m_descriptor(std::exchange(other.m_descriptor, -1))
+    , m_root(std::move(other.m_root))
+    , m_watches(std::move(other.m_watches))
+    , m_pending_moves(std::move(other.m_pending_moves)) {}
+auto FileWatcher::operator=(FileWatcher&& other) noexcept -> FileWatcher& {
+  if (this != &other) {
+#ifdef __linux__
+    if (m_descriptor >= 0) {
+      ::close(m_descriptor);
+    }
+#endif
+    m_descriptor = std::exchange(other.m_descriptor, -1);
+    m_root = std::move(other.m_root);
+    m_watches = std::move(other.m_watches);
+    m_pending_moves = std::move(other.m_pending_moves);
+  }
+  return *this;
+}
+
+#ifdef __linux__
+auto FileWatcher::create(const std::filesystem::path& root)
+    -> std::optional<FileWatcher> {
+  if (!fs::is_directory(root)) {
+    spdlog::error("Cannot watch {}. Path should be a directory.",
+                  root.string());
+    return {};
+  }
+
+  const auto descriptor = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (descriptor < 0) {
+    spdlog::error("Couldn't initialize inotify. Error: {}",
+                  std::strerror(errno));
+    return {};
+  }
+
+  auto watcher = FileWatcher {descriptor, root};
+  watcher.add_watches(root);
+  return std::make_optional(std::move(watcher));
+}
+void FileWatcher::add_watches(const std::filesystem::path& path) {
+  auto add_watch = [this](const fs::path& directory)
+  {
+    const auto watch =
+        ::inotify_add_watch(m_descriptor, directory.c_str(), watch_mask);
+    if (watch < 0) {
+      spdlog::error("Couldn't watch directory {}. Error: {}",
+                    directory.string(),
+                    std::strerror(errno));
+      return;
+    }
+    m_watches[watch] = directory;
+  };
+
+  add_watch(path);
+  auto has_error = std::error_code {};
+  for (auto iterator = fs::recursive_directory_iterator(path, has_error);
+       !has_error && iterator != fs::recursive_directory_iterator();
+       iterator.increment(has_error))
+  {
+    auto entry_error = std::error_code {};
+    if (iterator->is_directory(entry_error)) {
+      add_watch(iterator->path());
+    }
+  }
+}
+auto FileWatcher::read_events(std::vector<FileEvent>& output) -> bool {
+  alignas(inotify_event) auto buffer = std::array<char, event_buffer_size> {};
+  auto has_read = false;
+
+  while (true) {
+    const auto length = ::read(m_descriptor, buffer.data(), buffer.size());
+    if (length <= 0) {
+      break;
+    }
+    has_read = true;
+
+    for (auto offset = std::size_t {0};
+         offset < static_cast<std::size_t>(length);)
+    {
+      // NOLINTNEXTLINE(*-reinterpret-cast,*-pointer-arithmetic)
+      const auto* event = reinterpret_cast<inotify_event*>(&buffer[offset]);
+      offset += sizeof(inotify_event) + event->len;
+
+      if ((event->mask & IN_Q_OVERFLOW) != 0U) {
+        spdlog::warn("Watch queue overflowed, some changes were lost");
+        output.push_back(make_event(FileEventType::overflow, {}, false));
+        continue;
+      }
+
+      if ((event->mask & IN_IGNORED) != 0U) {
+        m_watches.erase(event->wd);
+        continue;
+      }
+
+      const auto directory = m_watches.find(event->wd);
+      if (directory == m_watches.end() || event->len == 0) {
+        continue;
+      }
+
+      const auto is_directory = (event->mask & IN_ISDIR) != 0U;
+      auto path = directory->second / std::string {event->name};
+
+      if ((event->mask & IN_CREATE) != 0U) {
+        if (is_directory) {
+          add_watches(path);
+        }
+        output.push_back(
+            make_event(FileEventType::created, std::move(path), is_directory));
+      } else if ((event->mask & IN_DELETE) != 0U) {
+        output.push_back(
+            make_event(FileEventType::removed, std::move(path), is_directory));
+      } else if ((event->mask & IN_CLOSE_WRITE) != 0U) {
+        output.push_back(
+            make_event(FileEventType::modified, std::move(path), is_directory));
+      } else if ((event->mask & IN_MOVED_FROM) != 0U) {
+        m_pending_moves[event->cookie] =
+            make_event(FileEventType::removed, std::move(path), is_directory);
+      } else if ((event->mask & IN_MOVED_TO) != 0U) {
+        const auto source = m_pending_moves.find(event->cookie);
+        if (source == m_pending_moves.end()) {
+          // Moved from outside the watched directory
+          if (is_directory) {
+            add_watches(path);
+          }
+          output.push_back(make_event(
+              FileEventType::created, std::move(path), is_directory));
+          continue;
+        }
+
+        // Watches of moved directories keep pointing to the old path
+        if (is_directory) {
+          for (auto& [watch, watched_path] : m_watches) {
+            if (auto rebased =
+                    rebase_path(watched_path, source->second.path, path))
+            {
+              watched_path = std::move(*rebased);
+            }
+          }
+        }
+
+        auto event = make_event(FileEventType::moved,
+                                std::move(source->second.path),
+                                is_directory);
+        event.new_path = std::move(path);
+        output.push_back(std::move(event));
+        m_pending_moves.erase(source);
+      }
+    }
+  }
+
+  return has_read;
+}
+
+auto FileWatcher::wait_events(std::chrono::milliseconds timeout)
+    -> std::vector<FileEvent> {
+  auto events = std::vector<FileEvent> {};
+  auto poll_descriptor =
+      pollfd {.fd = m_descriptor, .events = POLLIN, .revents = 0};
+
+  auto wait_time = timeout;
+  while (events.size() < max_batch_size
+         && ::poll(&poll_descriptor, 1, static_cast<int>(wait_time.count()))
+             > 0)
+  {
+    if (!read_events(events)) {
+      break;
+    }
+    wait_time = batch_settle_time;
+  }
+
+  // Moves whose destination never arrived left the watched directory, and
+  // their watches are not needed anymore
+  for (auto& [cookie, source] : m_pending_moves) {
+    if (source.is_directory) {
+      for (const auto& [watch, watched_path] : m_watches) {
+        if (rebase_path(watched_path, source.path, source.path)) {
+          ::inotify_rm_watch(m_descriptor, watch);
+        }
+      }
+    }
+    events.push_back(std::move(source));
+  }
+  m_pending_moves.clear();
+
+  return events;
+}
+#else
+auto FileWatcher::create(const std::filesystem::path& root)
+    -> std::optional<FileWatcher> {
+  spdlog::error("Cannot watch {}. Watching is only supported on Linux.",
+                root.string());
+  return {};
+}
+void FileWatcher::add_watches(const std::filesystem::path& /*path*/) {}
+auto FileWatcher::read_events(std::vector<FileEvent>& /*output*/) -> bool {
+  return false;
+}
+auto FileWatcher::wait_events(std::chrono::milliseconds /*timeout*/)
+    -> std::vector<FileEvent> {
+  return {};
+}
+#endif
+}  // namespace album_architect::files
@@ -0,0 +1,70 @@
+#ifndef ALBUMARCHITECT_FILES_WATCHER_H
+#define ALBUMARCHITECT_FILES_WATCHER_H
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "files/common.h"
+
+namespace album_architect::files {
+
+/// Watches a directory recursively for changes, reporting them as batches of
+/// FileEvent. Backed by inotify, so it is only supported on Linux.
+class FileWatcher {
+public:
+  /// Starts watching the given directory and all its sub-directories
+  /// \param root Absolute path to the directory
+  /// \return The watcher, or None if the directory couldn't be watched
+  static auto create(const std::filesystem::path& root)
+      -> std::optional<FileWatcher>;
+
+  /// Stops watching
+  ~FileWatcher();
+
+  // Disable copy
+  FileWatcher(const FileWatcher& other) = delete;
+  auto operator=(const FileWatcher& other) -> FileWatcher& = delete;
+
+  // Move operations
+  FileWatcher(FileWatcher&& other) noexcept;
+  auto operator=(FileWatcher&& other) noexcept -> FileWatcher&;
+
+  /// Waits until changes are available or the timeout expires. Once the first
+  /// change arrives, everything that follows closely is gathered in the same
+  /// batch, so bursts of changes are reported together.
+  /// \param timeout Maximum time to wait for the first change
+  /// \return Batch of events, empty if the timeout expired
+  auto wait_events(std::chrono::milliseconds timeout) -> std::vector<FileEvent>;
+
+private:
+  /// Creates the watcher from an inotify descriptor
+  /// \param descriptor
+  /// \param root
+  FileWatcher(int descriptor, std::filesystem::path root);
+
+  /// Adds watches to the given directory and all its sub-directories
+  /// \param path
+  void add_watches(const std::filesystem::path& path);
+
+  /// Reads all the events that are available without blocking
+  /// \param output
+  /// \return False if nothing could be read
+  auto read_events(std::vector<FileEvent>& output) -> bool;
+
+  int m_descriptor = -1;
+  std::filesystem::path m_root;
+
+  /// Watched directory of each watch descriptor
+  std::unordered_map<int, std::filesystem::path> m_watches;
+
+  /// Sources of moves waiting for their destination, by cookie
+  std::unordered_map<std::uint32_t, FileEvent> m_pending_moves;
+};
+
+}  // namespace album_architect::files
+
+#endif  // ALBUMARCHITECT_FILES_WATCHER_H
@@ -50,6 +50,22 @@ inline auto mat_to_uint64(cv::Mat mat) -> std::uint64_t {
   return result;
 }
 
+/// Converts a 64bit value into a Matrix of type UCHAR with 8 bytes, as the
+/// inverse of mat_to_uint64
+/// @param value
+/// @return
+inline auto uint64_to_mat(std::uint64_t value) -> cv::Mat {
+  constexpr auto max_size = 8;
+  auto result = cv::Mat(1, max_size, CV_8UC1);
+  for (auto i = 0U; i < max_size; ++i) {
+    // NOLINTNEXTLINE(*-magic-numbers)
+    result.at<uint8_t>(static_cast<int>(i)) =
+        static_cast<uint8_t>(value >> (8U * (7U - i)));
+  }
+
+  return result;
+}
+
 }  // namespace album_architect::cvmat
 
 #endif  // ALBUMARCHITECT_CV_MAT_OPERATIONS_H
@@ -60,6 +60,20 @@ auto main(int argc, char* argv[]) -> int {
                  common_parameters.cache_path,
                  "Path to the cache file.")
       ->default_val(".albumarchitect.cache");
+  app.add_option("--threads,-j",
+                 common_parameters.scan_threads,
+                 "Number of threads used to scan the photos folder. Use 0 "
+                 "for all the available cores.")
+      ->default_val(0);
+  app.add_flag("--compress-cache",
+               common_parameters.compress_cache,
+               "Write the cache file compressed. Compressed caches are "
+               "always read.");
+  app.add_flag("--rebase",
+               common_parameters.rebase,
+               "Keep the cache if it was written for another photos path, "
+               "like when the folder was moved or mounted somewhere else. "
+               "Some files are checked first.");
   app.add_flag_callback(
       "--verbose,-v",
       []() { spdlog::set_level(spdlog::level::debug); },
@@ -76,9 +90,37 @@ auto main(int argc, char* argv[]) -> int {
                 album_architect::commands::perform_analysis(
                     common_parameters, analysis_parameters);
               });
+  analyze_command->add_flag(
+      "--rescan,-r",
+      analysis_parameters.rescan,
+      "Rescans the photos folder, updating only the entries that changed "
+      "since the cache was written");
+  analyze_command
+      ->add_flag(
+          "--read-only",
+          analysis_parameters.read_only,
+          "Uses the hashes in the mapped cache without loading or updating it")
+      ->excludes("--rescan");
+  analyze_command->add_option(
+      "--scope",
+      analysis_parameters.scope,
+      "Directory to analyze, absolute or relative to the photos folder. With "
+      "--read-only, only its part of the cache is read.");
+  analyze_command
+      ->add_option("--checkpoint-interval",
+                   analysis_parameters.checkpoint_interval,
+                   "Seconds between writes of the cache while hashing, so an "
+                   "interrupted run can resume. Use 0 to disable.")
+      ->default_val(300);
   analyze_command->add_flag("--analyze-duplicates,-d",
                             analysis_parameters.analyze_duplicates,
                             "Performs an analysis for full duplicates");
+  analyze_command
+      ->add_flag("--exact-duplicates,-x",
+                 analysis_parameters.analyze_exact_duplicates,
+                 "Finds files of any type with the same contents, byte by "
+                 "byte")
+      ->excludes("--read-only");
   // analyze_command
   //     ->add_option("--duplicate-start-path",
   //                  analysis_parameters.duplicates_start_path,
@@ -95,6 +137,25 @@ auto main(int argc, char* argv[]) -> int {
       analysis_parameters.output_path,
       "Path to the output report file. Defaults to stdout.");
 
+  // Watch parameters
+  auto watch_parameters = album_architect::commands::WatchParameters {};
+  auto* watch_command =
+      app.add_subcommand("watch",
+                         "Keep the cache up to date while the photos folder "
+                         "changes")
+          ->fallthrough()
+          ->callback(
+              [&common_parameters, &watch_parameters]()
+              {
+                album_architect::commands::perform_watch(common_parameters,
+                                                         watch_parameters);
+              });
+  watch_command
+      ->add_option("--flush-interval",
+                   watch_parameters.flush_interval,
+                   "Seconds between writes of the cache file")
+      ->default_val(60);
+
   CLI11_PARSE(app, argc, argv);
 
   return 0;
@@ -2,12 +2,17 @@
 // Created by jorge on 09/08/24.
 //
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
+#include <fstream>
 #include <map>
 #include <numeric>
 #include <optional>
 #include <set>
 #include <string>
+#include <vector>
 
 #include <boost/algorithm/string/case_conv.hpp>
 #include <catch2/catch_test_macros.hpp>
@@ -16,12 +21,16 @@
 #include <opencv2/core.hpp>
 #include <opencv2/img_hash/average_hash.hpp>
 #include <opencv2/img_hash/phash.hpp>
+#include <opencv2/imgproc.hpp>
 #include <spdlog/spdlog.h>
 
+#include "album/hash.h"
 #include "album/image.h"
 #include "album/photo.h"
 #include "album/photo_metadata.h"
 #include "common.h"
+#include "files/helper.h"
+#include "helper/cv_mat_operations.h"
 
 using namespace album_architect;  // NOLINT(*-build-using-namespace)
 
@@ -179,7 +188,34 @@ TEST_CASE("Hashing", "[album][image][hash]") {
       const auto sha256 = image->get_hash(album::HashAlgorithm::sha256);
       REQUIRE(sha256);
       REQUIRE(sha256.value() == expected_sha256);
+
+      // Several hashes at once, some of them already calculated
+      const auto hashes = image->get_hashes(
+          std::array {album::HashAlgorithm::xxh3_128,
+                      album::HashAlgorithm::md5,
+                      album::HashAlgorithm::sha256});
+      REQUIRE(hashes.size() == 3);
+      REQUIRE(hashes[0] == hash::Hash::calculate_xxh3_128(path));
+      REQUIRE(hashes[1] == expected_md5);
+      REQUIRE(hashes[2] == expected_sha256);
+    }
+
+    // Several files at once, including one that can't be read
+    auto paths = std::vector<fs::path> {};
+    for (const auto& test_image : test_images) {
+      paths.push_back(test_image.path);
     }
+    paths.push_back(images_dir / "missing.jpg");
+    const auto md5_list = hash::Hash::calculate_md5(paths);
+    const auto sha256_list = hash::Hash::calculate_sha256(paths);
+    REQUIRE(md5_list.size() == paths.size());
+    REQUIRE(sha256_list.size() == paths.size());
+    for (auto index = std::size_t {0}; index < test_images.size(); ++index) {
+      REQUIRE(md5_list[index] == test_images[index].md5);
+      REQUIRE(sha256_list[index] == test_images[index].sha256);
+    }
+    REQUIRE_FALSE(md5_list.back());
+    REQUIRE_FALSE(sha256_list.back());
   }
 
   SECTION("Image hashing") {
@@ -208,6 +244,80 @@ TEST_CASE("Hashing", "[album][image][hash]") {
       compare_hashes(test_image.value(), modified_mat);
     }
   }
+
+  SECTION("Same bits as cv::img_hash") {
+    const auto average_hasher = cv::img_hash::AverageHash::create();
+    const auto p_hasher = cv::img_hash::PHash::create();
+    const auto check = [&](const cv::Mat& input)
+    {
+      auto expected = cv::Mat {};
+      average_hasher->compute(input, expected);
+      REQUIRE(cvmat::compare_mat(hash::Hash::calculate_average_hash(input),
+                                 expected));
+      p_hasher->compute(input, expected);
+      REQUIRE(cvmat::compare_mat(hash::Hash::calculate_p_hash(input),
+                                 expected));
+    };
+
+    auto photo = cv::Mat {};
+    const auto image = album::Image::load(images_dir / "Home" / "IMG_5515.JPG");
+    REQUIRE(image);
+    REQUIRE(image->get_image(photo));
+    check(photo);
+
+    // Noise and blurred noise, in every size and number of channels accepted
+    cv::setRNGSeed(42);
+    for (const auto type : {CV_8UC1, CV_8UC3, CV_8UC4}) {
+      for (const auto size : {cv::Size {9, 9}, cv::Size {64, 48},
+                              cv::Size {333, 517}, cv::Size {1024, 768}})
+      {
+        INFO(fmt::format("Type {}, {}x{}", type, size.width, size.height));
+        auto noise = cv::Mat(size, type);
+        cv::randu(noise, 0, 256);
+        check(noise);
+        auto blurred = cv::Mat {};
+        cv::GaussianBlur(noise, blurred, {}, 3.0);
+        check(blurred);
+      }
+    }
+
+    // Flat images and gradients, whose coefficients are mostly close to 0
+    for (const auto type : {CV_8UC1, CV_8UC3}) {
+      for (const auto value : {0, 1, 127, 128, 255}) {
+        INFO(fmt::format("Type {}, uniform {}", type, value));
+        check(cv::Mat(64, 48, type, cv::Scalar::all(value)));
+      }
+      auto horizontal = cv::Mat(48, 64, type);
+      auto vertical = cv::Mat(48, 64, type);
+      for (auto row = 0; row < horizontal.rows; ++row) {
+        for (auto column = 0; column < horizontal.cols; ++column) {
+          horizontal.row(row).col(column).setTo(cv::Scalar::all(column * 4));
+          vertical.row(row).col(column).setTo(cv::Scalar::all(row * 5));
+        }
+      }
+      INFO(fmt::format("Type {}, gradients", type));
+      check(horizontal);
+      check(vertical);
+    }
+
+    // Other types are still rejected
+    REQUIRE_THROWS_AS(hash::Hash::calculate_p_hash(cv::Mat(32, 32, CV_16UC1)),
+                      cv::Exception);
+  }
+
+  SECTION("Difference hash") {
+    // Pixels get brighter to the right, so every bit is set
+    auto gradient = cv::Mat(48, 64, CV_8UC1);
+    for (auto column = 0; column < gradient.cols; ++column) {
+      gradient.col(column).setTo(column * 4);
+    }
+    REQUIRE(cvmat::mat_to_uint64(hash::Hash::calculate_d_hash(gradient))
+            == ~std::uint64_t {0});
+
+    auto flipped = cv::Mat {};
+    cv::flip(gradient, flipped, 1);
+    REQUIRE(cvmat::mat_to_uint64(hash::Hash::calculate_d_hash(flipped)) == 0);
+  }
 }
 
 TEST_CASE("Photo Basics", "[album][photo]") {
@@ -252,6 +362,32 @@ TEST_CASE("Photo Basics", "[album][photo]") {
           REQUIRE(album::PhotoMetadata::get_stored_hash(*current, hash_type));
         }
       }
+
+      DYNAMIC_SECTION("Testing digests") {
+        constexpr auto algorithms = std::array {album::HashAlgorithm::md5,
+                                                album::HashAlgorithm::xxh3_128};
+        const auto fingerprint =
+            files::get_file_fingerprint(current->get_path());
+        REQUIRE(fingerprint);
+        REQUIRE_FALSE(album::PhotoMetadata::get_stored_digests(
+                          *current, algorithms, *fingerprint)[0]);
+
+        // Digests are stored for the current state of the file
+        const auto digests = photo->get_hashes(algorithms);
+        REQUIRE(digests[0]
+                == hash::Hash::calculate_md5(current->get_path()));
+        REQUIRE(album::PhotoMetadata::get_stored_digests(
+                    *current, algorithms, *fingerprint)
+                == digests);
+        REQUIRE(photo->get_hash(album::HashAlgorithm::xxh3_128)
+                == digests[1]);
+
+        // A file with another modification time needs to be read again
+        auto modified = *fingerprint;
+        ++modified.mtime_ns;
+        REQUIRE_FALSE(album::PhotoMetadata::get_stored_digests(
+                          *current, algorithms, modified)[1]);
+      }
     }
   }
 
@@ -281,4 +417,44 @@ TEST_CASE("Photo Basics", "[album][photo]") {
     REQUIRE(album::PhotoMetadata::get_photo_state(*invalid_element)
             == album::PhotoState::error);
   }
-}
\ No newline at end of file
+}
+
+TEST_CASE("File digests", "[album][hash]") {
+  auto temporary_dir = files::TemporaryDirectory {};
+  const auto path = temporary_dir.get_path() / "abc.txt";
+  std::ofstream(path) << "abc";
+
+  constexpr auto expected_md5 = "900150983cd24fb0d6963f7d28e17f72";
+  constexpr auto expected_sha256 =
+      "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad";
+  constexpr auto expected_xxh3_128 = "06b05ab6733a618578af5f94892f3950";
+
+  SECTION("One digest at a time") {
+    REQUIRE(hash::Hash::calculate_md5(path) == expected_md5);
+    REQUIRE(hash::Hash::calculate_sha256(path) == expected_sha256);
+    REQUIRE(hash::Hash::calculate_xxh3_128(path) == expected_xxh3_128);
+  }
+
+  SECTION("Several digests with one read") {
+    const auto digests = hash::Hash::calculate_digests(
+        path,
+        std::array {hash::DigestAlgorithm::xxh3_128,
+                    hash::DigestAlgorithm::md5,
+                    hash::DigestAlgorithm::sha256});
+    REQUIRE(digests);
+    REQUIRE(*digests
+            == std::vector<std::string> {
+                expected_xxh3_128, expected_md5, expected_sha256});
+
+    REQUIRE_FALSE(hash::Hash::calculate_digests(
+        temporary_dir.get_path() / "missing.txt",
+        std::array {hash::DigestAlgorithm::md5}));
+  }
+
+  SECTION("Empty files") {
+    const auto empty_path = temporary_dir.get_path() / "empty.txt";
+    std::ofstream {empty_path};
+    REQUIRE(hash::Hash::calculate_xxh3_128(empty_path)
+            == "99aa06d3014798d86001c324468d497f");
+  }
+}
@@ -1,15 +1,22 @@
 #include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
 #include <optional>
 #include <ranges>
 #include <set>
+#include <string>
 #include <vector>
 
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers_range_equals.hpp>
 
 #include "album/photo.h"
+#include "analysis/exact_duplicates.h"
 #include "analysis/similarity_search.h"
 #include "common.h"
+#include "files/helper.h"
 #include "files/tree.h"
 
 using namespace album_architect;  // NOLINT(*-build-using-namespace)
@@ -117,4 +124,99 @@ TEST_CASE("Similarity test", "[SimilarityTest]") {
     REQUIRE_THAT(calculated_similar,
                  Catch::Matchers::RangeEquals(calculated_similar));
   }
-}
\ No newline at end of file
+}
+
+// NOLINTNEXTLINE(*-function-cognitive-complexity)
+TEST_CASE("Exact duplicates", "[analysis][exact_duplicates]") {
+  auto temporary_dir = files::TemporaryDirectory {};
+  const auto& root = temporary_dir.get_path();
+  const auto write_file = [&root](const std::string& name,
+                                  const std::string& contents)
+  {
+    std::filesystem::create_directories((root / name).parent_path());
+    std::ofstream(root / name, std::ios::binary) << contents;
+  };
+
+  // Large files only differ in the first byte or in the middle
+  const auto block_size = analysis::ExactDuplicates::edge_block_size;
+  auto contents = std::string(block_size * 4, 'x');
+  write_file("large.bin", contents);
+  write_file("copies/large.bin", contents);
+  contents[block_size * 2] = 'y';
+  write_file("same_edges.bin", contents);
+  contents[0] = 'y';
+  write_file("other_start.bin", contents);
+
+  // Small files are read whole with their edges
+  write_file("small.txt", "hello");
+  write_file("copies/small.txt", "hello");
+  write_file("other.txt", "world");
+
+  // Empty files are ignored
+  write_file("empty.txt", "");
+  write_file("copies/empty.txt", "");
+
+  auto file_tree = files::FileTree::build(root);
+  REQUIRE(file_tree);
+  const auto elements =
+      std::vector<files::Element> {file_tree->begin(), file_tree->end()};
+
+  auto summary = analysis::ExactDuplicatesSummary {};
+  const auto duplicates =
+      analysis::ExactDuplicates::find(*file_tree, elements, &summary);
+  auto duplicate_paths = std::vector<std::vector<std::filesystem::path>> {};
+  for (const auto& group : duplicates) {
+    auto& paths = duplicate_paths.emplace_back();
+    rng::transform(group,
+                   std::back_inserter(paths),
+                   [](const files::Element& element)
+                   { return element.get_path(); });
+  }
+  REQUIRE(duplicate_paths
+          == std::vector<std::vector<std::filesystem::path>> {
+              {root / "copies" / "large.bin", root / "large.bin"},
+              {root / "copies" / "small.txt", root / "small.txt"}});
+
+  CHECK(summary.files == 9);
+  CHECK(summary.same_size == 7);
+  CHECK(summary.same_edges == 5);
+  CHECK(summary.files_read == 10);
+
+  SECTION("Digests are stored in the tree") {
+    const auto cached_duplicates =
+        analysis::ExactDuplicates::find(*file_tree, elements, &summary);
+    REQUIRE(cached_duplicates == duplicates);
+    REQUIRE(summary.files_read == 0);
+  }
+
+  SECTION("Changed files are read again") {
+    write_file("copies/small.txt", "world");
+    std::filesystem::last_write_time(
+        root / "copies" / "small.txt",
+        std::filesystem::last_write_time(root / "small.txt")
+            + std::chrono::hours {1});
+
+    const auto changed_duplicates =
+        analysis::ExactDuplicates::find(*file_tree, elements, &summary);
+    REQUIRE(changed_duplicates.size() == 2);
+    REQUIRE(changed_duplicates[1]
+            == std::vector<files::Element> {
+                *file_tree->get_element(root / "copies" / "small.txt"),
+                *file_tree->get_element(root / "other.txt")});
+    REQUIRE(summary.files_read == 1);
+  }
+
+  SECTION("Files that grew after the scan are read whole") {
+    // Same edges and size, with the size of the scan still in the tree
+    auto grown = std::string(block_size * 4, 'x');
+    write_file("small.txt", grown);
+    grown[block_size * 2] = 'y';
+    write_file("copies/small.txt", grown);
+
+    const auto grown_duplicates =
+        analysis::ExactDuplicates::find(*file_tree, elements, &summary);
+    REQUIRE(grown_duplicates.size() == 1);
+    REQUIRE(grown_duplicates[0].front().get_path()
+            == root / "copies" / "large.bin");
+  }
+}
@@ -0,0 +1,218 @@
+//
+// Benchmarks, hidden by default. Run with: AlbumArchitect_test "[benchmark]"
+//
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/archive/binary_oarchive.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <fmt/format.h>
+#include <opencv2/core.hpp>
+#include <opencv2/img_hash/average_hash.hpp>
+#include <opencv2/img_hash/phash.hpp>
+
+#include "album/hash.h"
+#include "album/perceptual_hash.h"
+#include "files/common.h"
+#include "files/compressed_stream.h"
+#include "files/frozen_graph.h"
+#include "files/graph.h"
+#include "files/helper.h"
+
+// NOLINTNEXTLINE(*-build-using-namespace)
+using namespace album_architect;
+
+namespace {
+/// Creates the path lists of the given number of files in a single directory
+auto make_directory_entries(std::size_t count)
+    -> std::vector<std::vector<std::string>> {
+  auto ret = std::vector<std::vector<std::string>> {};
+  ret.reserve(count);
+  for (auto index = std::size_t {0}; index < count; ++index) {
+    ret.push_back({"camera", "dump", fmt::format("IMG_{:06}.jpg", index)});
+  }
+  return ret;
+}
+}  // namespace
+
+TEST_CASE("Graph directories with many entries", "[.][benchmark][graph]") {
+  const auto count = GENERATE(
+      std::size_t {1'000}, std::size_t {10'000}, std::size_t {100'000});
+  auto entries = make_directory_entries(count);
+
+  DYNAMIC_SECTION(count << " entries") {
+    BENCHMARK("Insert") {
+      auto graph = files::FileGraph {/*create_root=*/true};
+      for (auto& entry : entries) {
+        graph.add_node(entry, files::NodeType::file);
+      }
+      return graph.get_node(entries.back()).has_value();
+    };
+
+    auto graph = files::FileGraph {/*create_root=*/true};
+    for (auto& entry : entries) {
+      graph.add_node(entry, files::NodeType::file);
+    }
+
+    BENCHMARK("Lookup") {
+      auto found = std::size_t {0};
+      for (const auto& entry : entries) {
+        found += graph.get_node(entry).has_value() ? 1 : 0;
+      }
+      return found;
+    };
+
+    const auto frozen = graph.freeze();
+    BENCHMARK("Frozen lookup") {
+      auto found = std::size_t {0};
+      for (const auto& entry : entries) {
+        found += frozen.get_node(entry).has_value() ? 1 : 0;
+      }
+      return found;
+    };
+
+    BENCHMARK("Iterate") {
+      auto file_count = std::size_t {0};
+      auto pending = std::vector {graph.get_node({}).value()};
+      while (!pending.empty()) {
+        const auto node = pending.back();
+        pending.pop_back();
+        if (graph.get_node_type(node) == files::NodeType::file) {
+          ++file_count;
+        }
+        auto children = graph.get_node_children(node);
+        pending.insert(pending.end(), children.begin(), children.end());
+      }
+      return file_count;
+    };
+
+    BENCHMARK("Frozen iterate") {
+      auto file_count = std::size_t {0};
+      for (auto node = frozen.get_root_node(); node < frozen.size(); ++node) {
+        if (frozen.get_node_type(node) == files::NodeType::file) {
+          ++file_count;
+        }
+      }
+      return file_count;
+    };
+  }
+}
+
+TEST_CASE("Compressed cache streams", "[.][benchmark][stream]") {
+  auto entries = make_directory_entries(100'000);
+  auto graph = files::FileGraph {/*create_root=*/true};
+  for (auto& entry : entries) {
+    graph.add_node(entry, files::NodeType::file);
+  }
+
+  auto archive_stream = std::ostringstream {};
+  {
+    auto archiver = boost::archive::binary_oarchive {archive_stream};
+    archiver << graph;
+  }
+  const auto data = archive_stream.str();
+
+  BENCHMARK("Compress") {
+    auto output = std::ostringstream {};
+    files::CompressedStream::write(data, output);
+    return output.tellp();
+  };
+
+  auto compressed_stream = std::stringstream {};
+  files::CompressedStream::write(data, compressed_stream);
+  const auto compressed = compressed_stream.str();
+
+  BENCHMARK("Decompress") {
+    auto input = std::istringstream {compressed};
+    return files::CompressedStream::read(input)->size();
+  };
+}
+
+TEST_CASE("File content hashing", "[.][benchmark][hash]") {
+  // Files about the size of photos
+  constexpr auto file_count = 32;
+  constexpr auto file_size = std::size_t {8} << 20U;
+  auto temporary_dir = files::TemporaryDirectory {};
+  auto paths = std::vector<std::filesystem::path> {};
+  const auto contents = std::string(file_size, 'x');
+  for (auto index = 0; index < file_count; ++index) {
+    paths.push_back(temporary_dir.get_path() / fmt::format("{}.raw", index));
+    std::ofstream(paths.back(), std::ios::binary) << contents;
+  }
+
+  BENCHMARK("MD5 one file at a time") {
+    auto hashed = std::size_t {0};
+    for (const auto& path : paths) {
+      hashed += hash::Hash::calculate_md5(path).has_value() ? 1 : 0;
+    }
+    return hashed;
+  };
+
+  BENCHMARK("MD5 of all the files at once") {
+    return hash::Hash::calculate_md5(paths).size();
+  };
+
+  BENCHMARK("SHA256 of all the files at once") {
+    return hash::Hash::calculate_sha256(paths).size();
+  };
+
+  BENCHMARK("XXH3 of all the files at once") {
+    return hash::Hash::calculate_xxh3_128(paths).size();
+  };
+
+  BENCHMARK("MD5, SHA256 and XXH3 with one read of each file") {
+    constexpr auto algorithms = std::array {hash::DigestAlgorithm::md5,
+                                            hash::DigestAlgorithm::sha256,
+                                            hash::DigestAlgorithm::xxh3_128};
+    auto hashed = std::size_t {0};
+    for (const auto& path : paths) {
+      hashed += hash::Hash::calculate_digests(path, algorithms).has_value()
+          ? 1
+          : 0;
+    }
+    return hashed;
+  };
+}
+
+TEST_CASE("Perceptual hashes", "[.][benchmark][hash]") {
+  // A decoded photo is mostly scaling, a thumbnail is mostly overhead
+  const auto size = GENERATE(cv::Size {3264, 2448}, cv::Size {160, 120});
+  auto image = cv::Mat(size, CV_8UC3);
+  cv::setRNGSeed(42);
+  cv::randu(image, 0, 256);
+
+  DYNAMIC_SECTION(size.width << "x" << size.height << " pixels") {
+    BENCHMARK("cv::img_hash average hash") {
+      auto output = cv::Mat {};
+      cv::img_hash::AverageHash::create()->compute(image, output);
+      return output.at<std::uint8_t>(0);
+    };
+
+    BENCHMARK("Average hash") {
+      return hash::PerceptualHash::average_hash(image);
+    };
+
+    BENCHMARK("cv::img_hash pHash") {
+      auto output = cv::Mat {};
+      cv::img_hash::PHash::create()->compute(image, output);
+      return output.at<std::uint8_t>(0);
+    };
+
+    BENCHMARK("pHash") {
+      return hash::PerceptualHash::p_hash(image);
+    };
+
+    BENCHMARK("dHash") {
+      return hash::PerceptualHash::d_hash(image);
+    };
+  }
+}
@@ -3,27 +3,169 @@
 //
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
 #include <iterator>
+#include <map>
+#include <memory>
+#include <optional>
 #include <ranges>
+#include <sstream>
+#include <string>
 #include <thread>
 #include <vector>
 
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/graph/adjacency_list.hpp>
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers_range_equals.hpp>
+#include <fmt/format.h>
 #include <opencv2/core/mat.hpp>
 
 #include "common.h"
+#include "files/checkpointer.h"
+#include "files/compressed_stream.h"
+#include "files/content_digest.h"
+#include "files/frozen_graph.h"
 #include "files/graph.h"
 #include "files/helper.h"
+#include "files/mapped_tree.h"
 #include "files/tree.h"
+#include "files/watcher.h"
 #include "helper/cv_mat_operations.h"
 
 // NOLINTNEXTLINE(*-build-using-namespace)
 using namespace album_architect;
 
+namespace {
+/// Temporary directory with the files 0.txt to count - 1.txt, each holding
+/// its number, and the tree built over it. Built in place, as the elements
+/// point to the tree.
+struct NumberedFiles {
+  explicit NumberedFiles(std::size_t count) {
+    for (auto index = std::size_t {0}; index < count; ++index) {
+      std::ofstream(root / fmt::format("{}.txt", index)) << index;
+    }
+    tree = files::FileTree::build(root);
+    REQUIRE(tree);
+    REQUIRE(tree->get_elements_under_path(root, elements));
+    REQUIRE(elements.size() == count);
+  }
+  NumberedFiles(const NumberedFiles&) = delete;
+  auto operator=(const NumberedFiles&) -> NumberedFiles& = delete;
+
+  files::TemporaryDirectory directory;
+  fs::path root = directory.get_path();
+  std::optional<files::FileTree> tree;
+  std::vector<files::Element> elements;
+};
+
+/// VertexData as versions before 2 stored it, with the name of every key
+struct OldVertexData {
+  OldVertexData() = default;
+  explicit OldVertexData(files::NodeType type)
+      : type(type) {}
+
+  files::NodeType type = files::NodeType::directory;
+  std::map<std::string, files::VertexAttribute> attributes;
+  files::FileFingerprint fingerprint;
+
+  template<class Archive>
+  void serialize(Archive& archive, const unsigned int /*version*/) {
+    archive & type;
+    archive & attributes;
+    archive & fingerprint;
+  }
+};
+
+/// FileGraph as version 0 stored it, with the name in every edge
+struct OldestFileGraph {
+  boost::adjacency_list<boost::vecS,
+                        boost::vecS,
+                        boost::bidirectionalS,
+                        OldVertexData,
+                        files::LegacyEdgeData>
+      graph;
+  std::size_t root = 0;
+
+  template<class Archive>
+  void serialize(Archive& archive, const unsigned int /*version*/) {
+    archive & graph;
+    archive & root;
+  }
+};
+
+/// FileGraph as versions before 2 stored it, without attribute columns
+struct OldFileGraph {
+  files::NamePool names;
+  boost::adjacency_list<boost::vecS,
+                        boost::vecS,
+                        boost::bidirectionalS,
+                        OldVertexData,
+                        files::EdgeData>
+      graph;
+  std::size_t root = 0;
+
+  template<class Archive>
+  void serialize(Archive& archive, const unsigned int /*version*/) {
+    archive & names;
+    archive & graph;
+    archive & root;
+  }
+};
+
+/// FileGraph as the current version stores it, with the key table of
+/// another process
+struct ForeignFileGraph {
+  files::NamePool names;
+  std::vector<std::string> key_names;
+  files::GraphType graph;
+  std::size_t root = 0;
+  files::AttributeColumns columns;
+
+  template<class Archive>
+  void serialize(Archive& archive, const unsigned int /*version*/) {
+    archive & names;
+    archive & key_names;
+    archive & graph;
+    archive & root;
+    archive & columns;
+  }
+};
+
+/// FileTree as it is stored, with a graph in another layout
+template<class Graph>
+struct OldFileTree {
+  std::string root_path;
+  std::unique_ptr<Graph> graph = std::make_unique<Graph>();
+
+  template<class Archive>
+  void serialize(Archive& archive, const unsigned int /*version*/) {
+    archive & root_path;
+    archive & graph;
+  }
+
+  /// Writes the tree and loads it with the current FileTree
+  auto load() const -> std::optional<files::FileTree> {
+    auto stream = std::stringstream {};
+    {
+      auto archive = boost::archive::binary_oarchive {stream};
+      archive << *this;
+    }
+    return files::FileTree::from_stream(stream);
+  }
+};
+}  // namespace
+
+BOOST_CLASS_VERSION(OldVertexData, 1)
+BOOST_CLASS_VERSION(OldFileGraph, 1)
+BOOST_CLASS_VERSION(ForeignFileGraph, 3)
+
 // NOLINTNEXTLINE(*-function-cognitive-complexity)
 TEST_CASE("Tree structure of directory", "[files][tree]") {
   // Check that passing a file returns None
@@ -138,6 +280,41 @@ TEST_CASE("Tree structure of directory", "[files][tree]") {
     REQUIRE(cvmat::compare_mat(std::get<cv::Mat>(*retrieved2), val2));
   }
 
+  SECTION("Compressed serialization") {
+    auto album_one = directory_tree.get_element(album_one_path);
+    album_one->set_metadata(key1, val1);
+
+    auto stream = std::stringstream {};
+    directory_tree.to_stream(stream, files::StreamCompression::zstd);
+    REQUIRE(files::CompressedStream::is_compressed(stream));
+
+    // Compressed caches are detected when read
+    auto new_tree = files::FileTree::from_stream(stream);
+    REQUIRE(new_tree);
+    REQUIRE(directory_tree == new_tree);
+    auto retrieved = new_tree->get_metadata(album_one_path, key1);
+    REQUIRE(retrieved);
+    REQUIRE(std::get<std::string>(*retrieved) == val1);
+  }
+
+  SECTION("Relative paths are resolved against the root") {
+    // Change the current directory to make sure it is not used
+    auto temporary_cwd =
+        files::TempCurrentDir(fs::temp_directory_path().parent_path());
+
+    auto album_one = directory_tree.get_element("album_one");
+    REQUIRE(album_one);
+    REQUIRE(album_one->get_path() == album_one_path);
+
+    REQUIRE_FALSE(directory_tree.set_metadata("album_one", key1, val1));
+    auto retrieved = directory_tree.get_metadata(album_one_path, key1);
+    REQUIRE(retrieved);
+    REQUIRE(std::get<std::string>(*retrieved) == val1);
+
+    // Paths outside of the root are not part of the tree
+    REQUIRE_FALSE(directory_tree.get_element("../album_one"));
+  }
+
   auto expected_root_children = std::vector {resources_dir / "album_one",
                                              resources_dir / "album_two",
                                              resources_dir / "album_three",
@@ -233,6 +410,633 @@ TEST_CASE("Tree structure of directory", "[files][tree]") {
   }
 }
 
+TEST_CASE("Parallel scan of directory", "[files][tree]") {
+  // Build the same directory sequentially and in parallel
+  auto sequential_tree = files::FileTree::build(resources_dir, 1);
+  REQUIRE(sequential_tree);
+  auto parallel_tree = files::FileTree::build(resources_dir, 4);
+  REQUIRE(parallel_tree);
+
+  // Both trees should contain the same elements, order is not guaranteed
+  auto get_paths = [](files::FileTree& tree)
+  {
+    auto paths = std::vector<fs::path> {};
+    std::transform(std::begin(tree),
+                   std::end(tree),
+                   std::back_inserter(paths),
+                   std::mem_fn(&files::Element::get_path));
+    rng::sort(paths);
+    return paths;
+  };
+  REQUIRE_THAT(get_paths(*parallel_tree),
+               Catch::Matchers::RangeEquals(get_paths(*sequential_tree)));
+
+  // Elements should be resolved in the parallel tree
+  const auto album_three_two_path =
+      resources_dir / "album_three" / "album_three_two" / "three.two.1.svg";
+  auto element = parallel_tree->get_element(album_three_two_path);
+  REQUIRE(element);
+  REQUIRE(element->get_type() == files::PathType::file);
+}
+
+TEST_CASE("Refresh of a directory tree", "[files][tree]") {
+  // Create a small directory structure
+  auto temporary_dir = files::TemporaryDirectory {};
+  const auto root = temporary_dir.get_path();
+  fs::create_directories(root / "album" / "sub");
+  std::ofstream(root / "album" / "kept.txt") << "kept";
+  std::ofstream(root / "album" / "modified.txt") << "original";
+  std::ofstream(root / "album" / "sub" / "removed.txt") << "removed";
+
+  auto tree = files::FileTree::build(root);
+  REQUIRE(tree);
+
+  const auto key = "KEY"s;
+  const auto value = "VALUE"s;
+  tree->set_metadata(root / "album" / "kept.txt", key, value);
+  tree->set_metadata(root / "album" / "modified.txt", key, value);
+
+  // Change the structure on disk
+  std::ofstream(root / "album" / "modified.txt") << "a longer content";
+  fs::remove(root / "album" / "sub" / "removed.txt");
+  fs::create_directories(root / "new_album");
+  std::ofstream(root / "new_album" / "added.txt") << "added";
+  std::ofstream(root / "album" / "added.txt") << "added";
+
+  const auto summary = tree->refresh();
+  REQUIRE(summary.added == 2);
+  REQUIRE(summary.removed == 1);
+  REQUIRE(summary.modified == 1);
+
+  // Metadata of untouched files is kept, and cleared for changed ones
+  REQUIRE(tree->get_metadata(root / "album" / "kept.txt", key));
+  REQUIRE_FALSE(tree->get_metadata(root / "album" / "modified.txt", key));
+
+  // New elements are found, removed elements are not
+  REQUIRE(tree->get_element(root / "new_album" / "added.txt"));
+  REQUIRE(tree->get_element(root / "album" / "added.txt"));
+  REQUIRE_FALSE(tree->get_element(root / "album" / "sub" / "removed.txt"));
+  REQUIRE(tree->get_element(root / "album" / "sub"));
+
+  // A second refresh without changes should not touch anything
+  const auto second_summary = tree->refresh(2);
+  REQUIRE(second_summary.added == 0);
+  REQUIRE(second_summary.removed == 0);
+  REQUIRE(second_summary.modified == 0);
+  REQUIRE(tree->get_metadata(root / "album" / "kept.txt", key));
+
+  // Elements found before nodes are removed still point to their path
+  const auto kept = tree->get_element(root / "album" / "kept.txt");
+  REQUIRE(kept);
+  const auto parent = kept->get_parent();
+  REQUIRE(parent);
+  fs::remove(root / "album" / "added.txt");
+  REQUIRE(tree->refresh().removed == 1);
+  REQUIRE(kept->get_metadata(key));
+  REQUIRE(kept->get_parent() == parent);
+  REQUIRE(parent->get_children().size() == 3);
+}
+
+TEST_CASE("Moved files keep their metadata", "[files][tree]") {
+  auto temporary_dir = files::TemporaryDirectory {};
+  const auto root = temporary_dir.get_path();
+  fs::create_directories(root / "album");
+  fs::create_directories(root / "sorted");
+  std::ofstream(root / "album" / "photo.jpg") << "photo";
+  std::ofstream(root / "album" / "other.jpg") << "other";
+
+  auto tree = files::FileTree::build(root);
+  REQUIRE(tree);
+  const auto set_metadata = [&tree](const fs::path& path)
+  {
+    constexpr auto columns = std::array {files::HashColumn::p_hash};
+    constexpr auto hashes = std::array {std::uint64_t {0x1234}};
+    auto element = tree->get_element(path);
+    REQUIRE(element);
+    REQUIRE(element->set_hashes(columns, hashes, /*state=*/1));
+    element->set_metadata("key", "value"s);
+  };
+  const auto check_metadata = [&tree](const fs::path& path)
+  {
+    auto element = tree->get_element(path);
+    REQUIRE(element);
+    REQUIRE(element->get_hash(files::HashColumn::p_hash)
+            == std::uint64_t {0x1234});
+    REQUIRE(element->get_state() == 1);
+    REQUIRE(element->get_metadata("key"));
+  };
+  set_metadata(root / "album" / "photo.jpg");
+  set_metadata(root / "album" / "other.jpg");
+
+  SECTION("Refresh") {
+    // A renamed file and a file in a renamed directory
+    fs::rename(root / "album" / "photo.jpg", root / "sorted" / "renamed.jpg");
+    fs::rename(root / "album", root / "renamed_album");
+
+    const auto summary = tree->refresh();
+    REQUIRE(summary.moved == 2);
+    check_metadata(root / "sorted" / "renamed.jpg");
+    check_metadata(root / "renamed_album" / "other.jpg");
+  }
+
+  SECTION("Events") {
+    // Moves from outside the tree look like a removal and a creation
+    fs::rename(root / "album" / "photo.jpg", root / "sorted" / "photo.jpg");
+    auto events = std::vector<files::FileEvent>(2);
+    events[0].type = files::FileEventType::removed;
+    events[0].path = root / "album" / "photo.jpg";
+    events[1].type = files::FileEventType::created;
+    events[1].path = root / "sorted" / "photo.jpg";
+
+    tree->apply_events(events);
+    check_metadata(root / "sorted" / "photo.jpg");
+    REQUIRE_FALSE(tree->get_element(root / "album" / "photo.jpg"));
+  }
+}
+
+TEST_CASE("Parallel metadata writes", "[files][tree]") {
+  constexpr auto file_count = std::size_t {200};
+  auto numbered_files = NumberedFiles {file_count};
+  auto& elements = numbered_files.elements;
+
+  // Every thread writes several keys to all the elements
+  auto threads = std::vector<std::thread> {};
+  for (auto thread_index = 0; thread_index < 4; ++thread_index) {
+    threads.emplace_back(
+        [&elements, thread_index]
+        {
+          const auto key = fmt::format("KEY{}", thread_index);
+          for (auto& element : elements) {
+            element.set_metadata(key, element.get_path().filename().string());
+          }
+        });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (const auto& element : elements) {
+    for (auto thread_index = 0; thread_index < 4; ++thread_index) {
+      const auto value =
+          element.get_metadata(fmt::format("KEY{}", thread_index));
+      REQUIRE(value);
+      REQUIRE(std::get<std::string>(*value)
+              == element.get_path().filename().string());
+    }
+  }
+}
+
+TEST_CASE("Batched metadata", "[files][tree]") {
+  constexpr auto file_count = std::size_t {300};
+  auto numbered_files = NumberedFiles {file_count};
+  auto& tree = numbered_files.tree;
+  auto& elements = numbered_files.elements;
+
+  SECTION("Several keys of an element") {
+    auto& element = elements.front();
+    const auto key1 = files::AttributeKeys::intern("KEY1");
+    const auto key2 = files::AttributeKeys::intern("KEY2");
+    const auto entries = std::vector<files::MetadataEntry> {
+        {key1, std::string {"first"}}, {key2, std::string {"second"}}};
+    REQUIRE(element.set_metadata(entries));
+
+    const auto keys = std::vector {
+        key2, files::AttributeKeys::intern("MISSING"), key1};
+    const auto values = element.get_metadata(keys);
+    REQUIRE(values.size() == 3);
+    REQUIRE(std::get<std::string>(values[0].value()) == "second");
+    REQUIRE_FALSE(values[1]);
+    REQUIRE(std::get<std::string>(values[2].value()) == "first");
+  }
+
+  SECTION("A key of many elements") {
+    const auto key = files::AttributeKeys::intern("KEY");
+    auto writes = std::vector<files::MetadataWrite> {};
+    for (const auto& element : elements) {
+      writes.push_back(
+          {&element, key, element.get_path().filename().string()});
+    }
+    REQUIRE(tree->set_metadata_batch(writes) == file_count);
+
+    const auto values = tree->get_metadata_batch(elements, key);
+    REQUIRE(values.size() == file_count);
+    for (auto index = std::size_t {0}; index < values.size(); ++index) {
+      REQUIRE(std::get<std::string>(values[index].value())
+              == elements[index].get_path().filename().string());
+    }
+
+    // Elements that left the tree are skipped
+    fs::remove(elements.front().get_path());
+    tree->refresh();
+    REQUIRE(tree->set_metadata_batch(writes) == file_count - 1);
+    const auto refreshed_values = tree->get_metadata_batch(elements, key);
+    REQUIRE_FALSE(refreshed_values.front());
+    REQUIRE(refreshed_values.back());
+  }
+}
+
+TEST_CASE("Hash columns", "[files][tree]") {
+  constexpr auto file_count = std::size_t {100};
+  auto numbered_files = NumberedFiles {file_count};
+  const auto& root = numbered_files.root;
+  auto& tree = numbered_files.tree;
+  auto& elements = numbered_files.elements;
+
+  // Store the index of every file as its hash
+  constexpr auto columns =
+      std::array {files::HashColumn::average_hash, files::HashColumn::p_hash};
+  for (auto& element : elements) {
+    REQUIRE(element.get_state() == 0);
+    const auto value = std::uint64_t {
+        std::stoull(element.get_path().stem().string()) + 1};
+    const auto hashes = std::array {value, value * 2};
+    REQUIRE(element.set_hashes(columns, hashes, /*state=*/1));
+  }
+
+  const auto check_hashes = [&](files::FileTree& checked_tree)
+  {
+    for (const auto& element : elements) {
+      const auto stored = checked_tree.get_element(element.get_path());
+      REQUIRE(stored);
+      const auto value = std::uint64_t {
+          std::stoull(element.get_path().stem().string()) + 1};
+      const auto hashes = stored->get_hashes(columns);
+      REQUIRE(hashes[0] == value);
+      REQUIRE(hashes[1] == value * 2);
+      REQUIRE(stored->get_state() == 1);
+    }
+  };
+  check_hashes(*tree);
+
+  SECTION("Batch reads") {
+    const auto hashes =
+        tree->get_hash_batch(elements, files::HashColumn::p_hash);
+    for (auto index = std::size_t {0}; index < elements.size(); ++index) {
+      REQUIRE(hashes[index] == *elements[index].get_hash(
+                                   files::HashColumn::p_hash));
+    }
+  }
+
+  SECTION("Removed and modified files") {
+    fs::remove(root / "0.txt");
+    std::ofstream(root / "1.txt") << "a longer content";
+    REQUIRE(tree->refresh().removed == 1);
+    std::erase_if(elements,
+                  [&root](const auto& element)
+                  {
+                    return element.get_path() == root / "0.txt"
+                        || element.get_path() == root / "1.txt";
+                  });
+
+    // Remaining nodes are renumbered along with their values
+    check_hashes(*tree);
+    const auto modified = tree->get_element(root / "1.txt");
+    REQUIRE(modified);
+    REQUIRE_FALSE(modified->get_hash(files::HashColumn::average_hash));
+    REQUIRE(modified->get_state() == 0);
+  }
+
+  SECTION("Serialization") {
+    auto temp_file = files::TemporaryFile {};
+    {
+      auto out_file = std::ofstream {temp_file.get_path()};
+      tree->to_stream(out_file);
+    }
+
+    auto in_file = std::ifstream {temp_file.get_path()};
+    auto new_tree = files::FileTree::from_stream(in_file);
+    REQUIRE(new_tree);
+    check_hashes(*new_tree);
+  }
+}
+
+TEST_CASE("Mapped cache", "[files][tree]") {
+  auto temporary_dir = files::TemporaryDirectory {};
+  const auto root = temporary_dir.get_path() / "root";
+  fs::create_directories(root / "2023" / "summer");
+  fs::create_directories(root / "2024");
+  std::ofstream(root / "2023" / "summer" / "beach.jpg") << "beach";
+  std::ofstream(root / "2023" / "summer" / "alps.jpg") << "alps";
+  std::ofstream(root / "2024" / "party.jpg") << "party";
+
+  auto tree = files::FileTree::build(root);
+  REQUIRE(tree);
+  auto beach = tree->get_element(root / "2023" / "summer" / "beach.jpg");
+  REQUIRE(beach);
+  constexpr auto columns = std::array {files::HashColumn::p_hash};
+  constexpr auto hashes = std::array {std::uint64_t {0xABCD}};
+  REQUIRE(beach->set_hashes(columns, hashes, /*state=*/1));
+
+  auto temp_file = files::TemporaryFile {};
+  REQUIRE(tree->write_mapped(temp_file.get_path()));
+  const auto mapped = files::MappedFileTree::open(temp_file.get_path());
+  REQUIRE(mapped);
+  REQUIRE(mapped->get_root_path() == root);
+  REQUIRE(mapped->size() == 7);
+
+  // Lookups and navigation in place
+  const auto beach_path = std::vector {"2023"s, "summer"s, "beach.jpg"s};
+  const auto beach_node = mapped->get_node(beach_path);
+  REQUIRE(beach_node);
+  REQUIRE(mapped->get_node_type(*beach_node) == files::NodeType::file);
+  REQUIRE(mapped->get_node_name(*beach_node) == "beach.jpg");
+  REQUIRE(mapped->get_node_path(*beach_node) == beach->get_path());
+  REQUIRE_FALSE(mapped->get_node(std::vector {"2023"s, "winter"s}));
+
+  // Scopes given as paths
+  REQUIRE(mapped->get_node(root / "2023" / "summer" / "beach.jpg")
+          == beach_node);
+  REQUIRE(mapped->get_node(fs::path {"2023/summer/beach.jpg"}) == beach_node);
+  REQUIRE(mapped->get_node(root / "2024" / ".." / "2023")
+          == mapped->get_node(fs::path {"2023"}));
+  REQUIRE(mapped->get_node(root) == mapped->get_root_node());
+  REQUIRE_FALSE(mapped->get_node(root / ".." / "other"));
+
+  const auto summer = mapped->get_node_parent(*beach_node);
+  REQUIRE(summer);
+  const auto children = mapped->get_node_children(*summer);
+  REQUIRE(children.size() == 2);
+  REQUIRE(mapped->get_node_name(children[0]) == "alps.jpg");
+  REQUIRE(mapped->get_node_name(children[1]) == "beach.jpg");
+  REQUIRE(mapped->get_subtree_end(*summer) - *summer == 3);
+
+  // Every node of a directory is within its subtree
+  const auto year = mapped->get_node(fs::path {"2023"});
+  REQUIRE(year);
+  for (auto node = *year; node < mapped->get_subtree_end(*year); ++node) {
+    REQUIRE(mapped->get_node_path(node).string().starts_with(
+        (root / "2023").string()));
+  }
+
+  // Attribute columns
+  REQUIRE(mapped->get_hash(files::HashColumn::p_hash, *beach_node)
+          == std::uint64_t {0xABCD});
+  REQUIRE_FALSE(
+      mapped->get_hash(files::HashColumn::average_hash, *beach_node));
+  REQUIRE(mapped->get_state(*beach_node) == 1);
+  REQUIRE(mapped->get_state(children[0]) == 0);
+  REQUIRE(mapped->get_node_fingerprint(*beach_node)
+          == files::get_file_fingerprint(beach->get_path()));
+
+  SECTION("Invalid files are rejected") {
+    const auto size = fs::file_size(temp_file.get_path());
+    fs::resize_file(temp_file.get_path(), size / 2);
+    REQUIRE_FALSE(files::MappedFileTree::open(temp_file.get_path()));
+
+    std::ofstream(temp_file.get_path()) << "not a mapped cache";
+    REQUIRE_FALSE(files::MappedFileTree::open(temp_file.get_path()));
+    REQUIRE_FALSE(files::MappedFileTree::open(root / "missing"));
+  }
+
+  SECTION("Sections that refer to missing nodes are rejected") {
+    // The header has 32 bytes of identification and counts, followed by the
+    // offset and size of each section: the parents are the second one and
+    // the children the sixth one
+    const auto corrupt = [&temp_file](std::size_t section, std::size_t index)
+    {
+      auto file = std::fstream(temp_file.get_path(),
+                               std::ios::in | std::ios::out | std::ios::binary);
+      auto offset = std::uint64_t {};
+      file.seekg(static_cast<std::streamoff>(32 + (section * 16)));
+      // NOLINTNEXTLINE(*-reinterpret-cast)
+      file.read(reinterpret_cast<char*>(&offset), sizeof(offset));
+      constexpr auto missing_node = std::uint32_t {1000};
+      file.seekp(static_cast<std::streamoff>(offset + (index * 4)));
+      // NOLINTNEXTLINE(*-reinterpret-cast)
+      file.write(reinterpret_cast<const char*>(&missing_node),
+                 sizeof(missing_node));
+    };
+
+    SECTION("Parent") {
+      corrupt(1, 3);
+    }
+    SECTION("Child") {
+      corrupt(5, 0);
+    }
+    REQUIRE_FALSE(files::MappedFileTree::open(temp_file.get_path()));
+  }
+}
+
+TEST_CASE("Caches from before the hash columns", "[files][tree]") {
+  auto temporary_dir = files::TemporaryDirectory {};
+  const auto root = temporary_dir.get_path();
+
+  // Hashes and states were stored as attributes of the vertex
+  auto old_tree = OldFileTree<OldFileGraph> {root.string()};
+  auto& old_graph = *old_tree.graph;
+  old_graph.root = boost::add_vertex(OldVertexData {}, old_graph.graph);
+  auto photo = OldVertexData {files::NodeType::file};
+  photo.attributes["_HASH_average_hash_"] = cvmat::uint64_to_mat(0x1234);
+  photo.attributes["_HASH_p_hash_"] = cvmat::uint64_to_mat(0xABCD);
+  photo.attributes["_PHOTO_STATE_"] = std::string {"ok"};
+  photo.attributes["_OTHER_"] = std::string {"kept"};
+  boost::add_edge(old_graph.root,
+                  boost::add_vertex(photo, old_graph.graph),
+                  files::EdgeData {old_graph.names.intern("photo.jpg")},
+                  old_graph.graph);
+  boost::add_edge(old_graph.root,
+                  boost::add_vertex(OldVertexData {files::NodeType::file},
+                                    old_graph.graph),
+                  files::EdgeData {old_graph.names.intern("new.jpg")},
+                  old_graph.graph);
+
+  // They are moved to the columns when loaded
+  auto tree = old_tree.load();
+  REQUIRE(tree);
+  const auto element = tree->get_element(root / "photo.jpg");
+  REQUIRE(element);
+  REQUIRE(element->get_hash(files::HashColumn::average_hash) == 0x1234);
+  REQUIRE(element->get_hash(files::HashColumn::p_hash) == 0xABCD);
+  REQUIRE(element->get_state() == 1);
+  REQUIRE_FALSE(element->get_metadata("_HASH_p_hash_"));
+  REQUIRE_FALSE(element->get_metadata("_PHOTO_STATE_"));
+  REQUIRE(std::get<std::string>(*element->get_metadata("_OTHER_")) == "kept");
+  const auto new_element = tree->get_element(root / "new.jpg");
+  REQUIRE(new_element);
+  REQUIRE_FALSE(new_element->get_hash(files::HashColumn::p_hash));
+  REQUIRE(new_element->get_state() == 0);
+
+  // So the mapped cache has them too
+  auto temp_file = files::TemporaryFile {};
+  REQUIRE(tree->write_mapped(temp_file.get_path()));
+  const auto mapped = files::MappedFileTree::open(temp_file.get_path());
+  REQUIRE(mapped);
+  const auto node = mapped->get_node(root / "photo.jpg");
+  REQUIRE(node);
+  REQUIRE(mapped->get_hash(files::HashColumn::average_hash, *node) == 0x1234);
+  REQUIRE(mapped->get_hash(files::HashColumn::p_hash, *node) == 0xABCD);
+  REQUIRE(mapped->get_state(*node) == 1);
+}
+
+TEST_CASE("Moving the root of a tree", "[files][tree]") {
+  auto temporary_dir = files::TemporaryDirectory {};
+  const auto root = temporary_dir.get_path() / "root";
+  fs::create_directories(root / "album");
+  for (auto index = 0; index < 10; ++index) {
+    std::ofstream(root / "album" / fmt::format("{}.jpg", index)) << index;
+  }
+
+  auto tree = files::FileTree::build(root);
+  REQUIRE(tree);
+  REQUIRE_FALSE(tree->set_metadata(root / "album" / "0.jpg", "key", "value"s));
+
+  SECTION("Moved folder") {
+    const auto moved = temporary_dir.get_path() / "moved";
+    fs::rename(root, moved);
+    REQUIRE(tree->rebase(moved));
+    REQUIRE(tree->get_root_element().get_path() == moved);
+
+    // Metadata is kept
+    const auto retrieved =
+        tree->get_metadata(moved / "album" / "0.jpg", "key");
+    REQUIRE(retrieved);
+    REQUIRE(std::get<std::string>(*retrieved) == "value");
+  }
+
+  SECTION("Another folder") {
+    const auto other = temporary_dir.get_path() / "other";
+    fs::create_directories(other / "album");
+    std::ofstream(other / "album" / "0.jpg") << "other";
+    REQUIRE_FALSE(tree->rebase(other));
+    REQUIRE_FALSE(tree->rebase(temporary_dir.get_path() / "missing"));
+    REQUIRE(tree->get_root_element().get_path() == root);
+  }
+
+  SECTION("Tree without files") {
+    const auto empty_root = temporary_dir.get_path() / "empty";
+    fs::create_directories(empty_root / "album");
+    auto empty_tree = files::FileTree::build(empty_root);
+    REQUIRE(empty_tree);
+
+    const auto other = temporary_dir.get_path() / "other";
+    fs::create_directories(other);
+    REQUIRE_FALSE(empty_tree->rebase(other));
+    REQUIRE(empty_tree->get_root_element().get_path() == empty_root);
+  }
+}
+
+TEST_CASE("Paths that need to be resolved", "[files][tree]") {
+  auto temporary_dir = files::TemporaryDirectory {};
+  const auto root = temporary_dir.get_path() / "root";
+  fs::create_directories(root / "album");
+  std::ofstream(root / "album" / "photo.jpg") << "photo";
+
+  auto tree = files::FileTree::build(root);
+  REQUIRE(tree);
+
+  // Plain paths, with or without trailing separators
+  REQUIRE(tree->get_element(root / "album" / "photo.jpg"));
+  REQUIRE(tree->get_element(root / "album" / ""));
+  REQUIRE_FALSE(tree->get_element(root / "album" / "missing.jpg"));
+
+  // Dot components
+  REQUIRE(tree->get_element(root / "album" / ".." / "album" / "photo.jpg"));
+  REQUIRE(tree->get_element(root / "." / "album"));
+  REQUIRE_FALSE(tree->get_element(root / ".." / "root2"));
+
+  // Symlinks to the root
+  const auto link = temporary_dir.get_path() / "link";
+  fs::create_directory_symlink(root, link);
+  REQUIRE(tree->get_element(link / "album" / "photo.jpg"));
+}
+
+TEST_CASE("Applying filesystem events to a tree", "[files][tree]") {
+  auto temporary_dir = files::TemporaryDirectory {};
+  const auto root = temporary_dir.get_path();
+  fs::create_directories(root / "album");
+  std::ofstream(root / "album" / "kept.txt") << "kept";
+  std::ofstream(root / "album" / "modified.txt") << "original";
+  std::ofstream(root / "album" / "removed.txt") << "removed";
+  std::ofstream(root / "album" / "moved.txt") << "moved";
+
+  auto tree = files::FileTree::build(root);
+  REQUIRE(tree);
+
+  const auto key = "KEY"s;
+  const auto value = "VALUE"s;
+  tree->set_metadata(root / "album" / "kept.txt", key, value);
+  tree->set_metadata(root / "album" / "modified.txt", key, value);
+  tree->set_metadata(root / "album" / "moved.txt", key, value);
+
+  // Change the structure on disk and describe it with events
+  std::ofstream(root / "album" / "modified.txt") << "a longer content";
+  fs::remove(root / "album" / "removed.txt");
+  fs::rename(root / "album" / "moved.txt", root / "album" / "renamed.txt");
+  fs::create_directories(root / "new_album" / "sub");
+  std::ofstream(root / "new_album" / "sub" / "added.txt") << "added";
+
+  auto events = std::vector<files::FileEvent> {4};
+  events[0].type = files::FileEventType::modified;
+  events[0].path = root / "album" / "modified.txt";
+  events[1].type = files::FileEventType::removed;
+  events[1].path = root / "album" / "removed.txt";
+  events[2].type = files::FileEventType::moved;
+  events[2].path = root / "album" / "moved.txt";
+  events[2].new_path = root / "album" / "renamed.txt";
+  events[3].type = files::FileEventType::created;
+  events[3].path = root / "new_album";
+  events[3].is_directory = true;
+
+  const auto changed = tree->apply_events(events);
+  REQUIRE_THAT(changed,
+               Catch::Matchers::UnorderedRangeEquals(std::vector<fs::path> {
+                   root / "album" / "modified.txt",
+                   root / "new_album" / "sub" / "added.txt"}));
+
+  // Metadata follows moved files, and is cleared for modified ones
+  REQUIRE(tree->get_metadata(root / "album" / "kept.txt", key));
+  REQUIRE(tree->get_metadata(root / "album" / "renamed.txt", key));
+  REQUIRE_FALSE(tree->get_metadata(root / "album" / "modified.txt", key));
+  REQUIRE_FALSE(tree->get_element(root / "album" / "moved.txt"));
+  REQUIRE_FALSE(tree->get_element(root / "album" / "removed.txt"));
+  REQUIRE(tree->get_element(root / "new_album" / "sub" / "added.txt"));
+
+  // The result should be the same as a full refresh
+  const auto summary = tree->refresh();
+  REQUIRE(summary.added == 0);
+  REQUIRE(summary.removed == 0);
+  REQUIRE(summary.modified == 0);
+}
+
+#ifdef __linux__
+TEST_CASE("Watching a directory", "[files][watcher]") {
+  using namespace std::chrono_literals;
+
+  auto temporary_dir = files::TemporaryDirectory {};
+  const auto root = temporary_dir.get_path();
+  fs::create_directories(root / "album");
+
+  auto watcher = files::FileWatcher::create(root);
+  REQUIRE(watcher);
+
+  std::ofstream(root / "album" / "photo.jpg") << "photo";
+  fs::rename(root / "album", root / "renamed");
+  std::ofstream(root / "renamed" / "other.jpg") << "other";
+
+  auto events = std::vector<files::FileEvent> {};
+  for (auto attempt = 0; attempt < 10 && events.size() < 4; ++attempt) {
+    std::ranges::move(watcher->wait_events(200ms),
+                      std::back_inserter(events));
+  }
+
+  const auto has_event = [&](files::FileEventType type, const fs::path& path)
+  {
+    return std::ranges::any_of(
+        events, [&](const auto& event)
+        { return event.type == type && event.path == path; });
+  };
+  REQUIRE(
+      has_event(files::FileEventType::created, root / "album" / "photo.jpg"));
+  REQUIRE(
+      has_event(files::FileEventType::modified, root / "album" / "photo.jpg"));
+  REQUIRE(has_event(files::FileEventType::moved, root / "album"));
+
+  // Watches follow the renamed directory
+  REQUIRE(
+      has_event(files::FileEventType::created, root / "renamed" / "other.jpg"));
+}
+#endif
+
 TEST_CASE("Graph for directories", "[files][graph]") {
   auto tree_graph = files::FileGraph {/*create_root=*/true};
 
@@ -309,6 +1113,128 @@ TEST_CASE("Graph for directories", "[files][graph]") {
 
     // ... renaming the root should fail
     REQUIRE_FALSE(tree_graph.rename_node({}, "new_root_name"));
+
+    // ... and so should taking the name of a sibling
+    auto new_path2 = path2;
+    new_path2.back() = "new_first";
+    REQUIRE_FALSE(tree_graph.rename_node(path2, "new_first"));
+    REQUIRE(tree_graph.get_node(path2));
+    REQUIRE(tree_graph.get_node(new_path2) != tree_graph.get_node(path2));
+  }
+
+  SECTION("Adding nodes after renaming and moving directories") {
+    // The parent directories are cached when adding nodes
+    auto route = std::vector {"route"s};
+    REQUIRE(tree_graph.rename_node(route, "renamed"s));
+
+    // New nodes should be added under the renamed directory
+    auto third_path = std::vector {"renamed"s, "to"s, "third"s};
+    const auto third = tree_graph.add_node(third_path, files::NodeType::file);
+    REQUIRE(tree_graph.get_node_path(third) == third_path);
+    REQUIRE(tree_graph.get_node_children(
+                tree_graph.get_node(std::vector {"renamed"s, "to"s}).value())
+                .size()
+            == 3);
+
+    // ... and the old path should be created again
+    const auto fourth = tree_graph.add_node(path1, files::NodeType::file);
+    REQUIRE(tree_graph.get_node_path(fourth) == path1);
+    REQUIRE(tree_graph.get_node_children(*tree_graph.get_node({})).size()
+            == 2);
+
+    // Moving a directory updates the paths of its sub-directories
+    auto moved = std::vector {"moved"s};
+    REQUIRE(tree_graph.move_node(route, moved));
+    auto fifth_path = std::vector {"moved"s, "to"s, "fifth"s};
+    const auto fifth = tree_graph.add_node(fifth_path, files::NodeType::file);
+    REQUIRE(tree_graph.get_node_path(fifth) == fifth_path);
+    auto sixth_path = std::vector {"route"s, "to"s, "sixth"s};
+    const auto sixth = tree_graph.add_node(sixth_path, files::NodeType::file);
+    REQUIRE(tree_graph.get_node_path(sixth) == sixth_path);
+  }
+
+  SECTION("Freezing the graph") {
+    auto path3 = std::vector {"path"s, "to"s, "third"s};
+    tree_graph.add_node(path3, files::NodeType::file);
+    const auto key = "GraphKey"s;
+    const auto value = "GraphValue"s;
+    tree_graph.set_node_metadata(*tree_graph.get_node(path1), key, value);
+    tree_graph.get_columns().set_hash(
+        files::HashColumn::p_hash, *tree_graph.get_node(path1), 42);
+
+    const auto frozen = tree_graph.freeze();
+    REQUIRE(frozen.size() == 8);
+
+    // Lookups
+    auto non_existent_path = std::vector {"route"s, "non"s, "existent"s};
+    REQUIRE_FALSE(frozen.get_node(non_existent_path));
+    const auto first = frozen.get_node(path1);
+    REQUIRE(first);
+    REQUIRE(frozen.get_node_type(*first) == files::NodeType::file);
+    REQUIRE(frozen.get_node_name(*first) == "first");
+    REQUIRE(frozen.get_node_path(*first) == path1);
+    REQUIRE(std::get<std::string>(*frozen.get_node_metadata(*first, key))
+            == value);
+    REQUIRE(frozen.get_columns().get_hash(files::HashColumn::p_hash, *first)
+            == 42U);
+
+    // Navigation
+    const auto root = frozen.get_root_node();
+    REQUIRE_FALSE(frozen.get_node_parent(root));
+    REQUIRE(frozen.get_node_children(root).size() == 2);
+    const auto route_to = frozen.get_node(std::vector {"route"s, "to"s});
+    REQUIRE(route_to);
+    REQUIRE(frozen.get_node_children(*route_to).size() == 2);
+    REQUIRE(frozen.get_node_parent(*first) == route_to);
+
+    // Subtrees are contiguous
+    REQUIRE(frozen.get_subtree_end(root) == frozen.size());
+    REQUIRE(frozen.get_subtree_end(*route_to) - *route_to == 3);
+    REQUIRE(*first > *route_to);
+    REQUIRE(*first < frozen.get_subtree_end(*route_to));
+
+    // Back to a mutable graph
+    auto thawed = frozen.thaw();
+    REQUIRE(thawed.get_node(path1) == std::optional<std::size_t> {*first});
+    REQUIRE(thawed.get_node(path3));
+    auto path4 = std::vector {"route"s, "to"s, "fourth"s};
+    thawed.add_node(path4, files::NodeType::file);
+    REQUIRE(thawed.get_node(path4));
+    REQUIRE(thawed.get_columns().get_hash(files::HashColumn::p_hash, *first)
+            == 42U);
+  }
+
+  SECTION("Lookups after moving and removing nodes") {
+    auto moved_path = std::vector {"other"s, "first"s};
+    REQUIRE(tree_graph.move_node(path1, moved_path));
+    REQUIRE_FALSE(tree_graph.get_node(path1));
+    REQUIRE(tree_graph.get_node(moved_path));
+
+    // Removal renumbers the nodes, lookups should still find the right ones
+    const auto removed = tree_graph.get_node(moved_path).value();
+    tree_graph.remove_nodes({&removed, 1});
+    REQUIRE_FALSE(tree_graph.get_node(moved_path));
+    const auto second_node = tree_graph.get_node(path2);
+    REQUIRE(second_node);
+    REQUIRE(tree_graph.get_node_path(*second_node) == path2);
+  }
+
+  SECTION("Names of removed and renamed nodes are dropped") {
+    const auto name_count = tree_graph.get_names().size();
+    REQUIRE(tree_graph.rename_node(path1, "renamed_first"s));
+    REQUIRE(tree_graph.get_names().size() == name_count + 1);
+
+    // The pool is compacted on the next removal
+    const auto removed = tree_graph.get_node(path2).value();
+    tree_graph.remove_nodes({&removed, 1});
+    REQUIRE(tree_graph.get_names().size() == name_count - 1);
+    REQUIRE_FALSE(tree_graph.get_names().find("first"));
+    REQUIRE_FALSE(tree_graph.get_names().find("second"));
+    const auto renamed_path = std::vector {"route"s, "to"s, "renamed_first"s};
+    const auto renamed = tree_graph.get_node(renamed_path);
+    REQUIRE(renamed);
+    REQUIRE(tree_graph.get_node_path(*renamed) == renamed_path);
+    REQUIRE(tree_graph.get_node(std::vector {"route"s, "to"s}));
   }
 
   SECTION("Node metadata") {
@@ -351,6 +1277,325 @@ TEST_CASE("Graph for directories", "[files][graph]") {
   //  tree_graph.to_graphviz(std::cout);
 }
 
+TEST_CASE("Name pool", "[files][graph]") {
+  auto pool = files::NamePool {};
+  const auto photo = pool.intern("photo.jpg");
+  const auto album = pool.intern("album");
+  REQUIRE(photo != album);
+  REQUIRE(pool.intern("photo.jpg") == photo);
+  REQUIRE(pool.size() == 2);
+  REQUIRE(pool.find("album") == album);
+  REQUIRE_FALSE(pool.find("missing"));
+  REQUIRE(pool.get(photo) == "photo.jpg");
+  REQUIRE(pool.intern("") == 2);
+
+  const auto check_ids = [&](const files::NamePool& other)
+  {
+    REQUIRE(other.size() == pool.size());
+    REQUIRE(other.find("photo.jpg") == photo);
+    REQUIRE(other.find("album") == album);
+    REQUIRE(other.get(album) == "album");
+  };
+
+  SECTION("Copies keep the ids") {
+    auto copy = pool;
+    check_ids(copy);
+
+    // The copy owns its names
+    pool = files::NamePool {};
+    REQUIRE(copy.get(photo) == "photo.jpg");
+  }
+
+  SECTION("Serialization keeps the ids") {
+    auto stream = std::stringstream {};
+    {
+      auto archive = boost::archive::binary_oarchive {stream};
+      archive << pool;
+    }
+    auto loaded = files::NamePool {};
+    loaded.intern("stale");
+    auto archive = boost::archive::binary_iarchive {stream};
+    archive >> loaded;
+    check_ids(loaded);
+    REQUIRE_FALSE(loaded.find("stale"));
+  }
+}
+
+TEST_CASE("Graphs from before the name pool", "[files][graph]") {
+  auto temporary_dir = files::TemporaryDirectory {};
+  const auto root = temporary_dir.get_path();
+
+  // Every edge stored its own copy of the name
+  auto old_tree = OldFileTree<OldestFileGraph> {root.string()};
+  auto& old_graph = *old_tree.graph;
+  old_graph.root = boost::add_vertex(OldVertexData {}, old_graph.graph);
+  for (const auto& album : {"2023"s, "2024"s}) {
+    const auto album_node =
+        boost::add_vertex(OldVertexData {}, old_graph.graph);
+    boost::add_edge(old_graph.root,
+                    album_node,
+                    files::LegacyEdgeData {album},
+                    old_graph.graph);
+    boost::add_edge(album_node,
+                    boost::add_vertex(OldVertexData {files::NodeType::file},
+                                      old_graph.graph),
+                    files::LegacyEdgeData {"photo.jpg"},
+                    old_graph.graph);
+  }
+
+  auto tree = old_tree.load();
+  REQUIRE(tree);
+  for (const auto& album : {"2023"s, "2024"s}) {
+    const auto element = tree->get_element(root / album / "photo.jpg");
+    REQUIRE(element);
+    REQUIRE(element->get_type() == files::PathType::file);
+    REQUIRE(element->get_parent()->get_path() == root / album);
+  }
+  REQUIRE_FALSE(tree->get_element(root / "2025"));
+}
+
+TEST_CASE("Attribute keys and maps", "[files][graph]") {
+  const auto first = files::AttributeKeys::intern("_FIRST_KEY_");
+  const auto second = files::AttributeKeys::intern("_SECOND_KEY_");
+  REQUIRE(first != second);
+  REQUIRE(files::AttributeKeys::intern("_FIRST_KEY_") == first);
+  REQUIRE(files::AttributeKeys::find("_FIRST_KEY_") == first);
+  REQUIRE_FALSE(files::AttributeKeys::find("_NEVER_REGISTERED_KEY_"));
+  REQUIRE(files::AttributeKeys::get_name(second) == "_SECOND_KEY_");
+
+  auto attributes = files::AttributeMap {};
+  REQUIRE_FALSE(attributes.insert_or_assign(second, std::string {"two"}));
+  REQUIRE_FALSE(attributes.insert_or_assign(first, std::string {"one"}));
+  REQUIRE(attributes.size() == 2);
+  REQUIRE(attributes.begin()->first == first);
+  REQUIRE(std::get<std::string>(*attributes.find(second)) == "two");
+
+  // Replacing and removing return the previous value
+  const auto previous = attributes.insert_or_assign(second, std::string {});
+  REQUIRE(std::get<std::string>(previous.value()) == "two");
+  REQUIRE(std::get<std::string>(attributes.erase(first).value()) == "one");
+  REQUIRE(attributes.find(first) == nullptr);
+  REQUIRE_FALSE(attributes.erase(first));
+
+  // Keys read from another process are mapped to the ones of this process
+  auto stored = files::AttributeMap {};
+  stored.insert_or_assign(files::AttributeKey {0}, std::string {"one"});
+  stored.insert_or_assign(files::AttributeKey {1}, std::string {"two"});
+  const auto keys = std::vector {second, first};
+  stored.remap_keys(keys);
+  REQUIRE(std::get<std::string>(*stored.find(first)) == "two");
+  REQUIRE(std::get<std::string>(*stored.find(second)) == "one");
+  REQUIRE(std::is_sorted(stored.begin(),
+                         stored.end(),
+                         [](const auto& lhs, const auto& rhs)
+                         { return lhs.first < rhs.first; }));
+}
+
+TEST_CASE("Attribute keys in archives", "[files][graph]") {
+  auto temporary_dir = files::TemporaryDirectory {};
+  const auto root = temporary_dir.get_path();
+  std::ofstream(root / "photo.jpg") << "photo";
+
+  SECTION("Saved keys are found again by name") {
+    auto tree = files::FileTree::build(root);
+    REQUIRE(tree);
+    REQUIRE_FALSE(
+        tree->set_metadata(root / "photo.jpg", "_SAVED_KEY_", "saved"s));
+    auto stream = std::stringstream {};
+    tree->to_stream(stream);
+
+    // The key gets an id that is not in the archive
+    const auto later_key = files::AttributeKeys::intern("_LATER_KEY_");
+    auto loaded = files::FileTree::from_stream(stream);
+    REQUIRE(loaded);
+    auto photo = loaded->get_element(root / "photo.jpg");
+    REQUIRE(photo);
+    REQUIRE(std::get<std::string>(*photo->get_metadata("_SAVED_KEY_"))
+            == "saved");
+    REQUIRE_FALSE(photo->get_metadata(later_key));
+    REQUIRE_FALSE(photo->set_metadata(later_key, "later"s));
+    REQUIRE(std::get<std::string>(*photo->get_metadata(later_key)) == "later");
+    REQUIRE(std::get<std::string>(*photo->get_metadata("_SAVED_KEY_"))
+            == "saved");
+  }
+
+  // The archive numbers its keys in another order than this process
+  files::AttributeKeys::intern("_SAVED_KEY_");
+  auto archived = OldFileTree<ForeignFileGraph> {root.string()};
+  auto& graph = *archived.graph;
+  graph.key_names = {"_ARCHIVED_ONLY_KEY_", "_SAVED_KEY_"};
+  graph.root = boost::add_vertex(files::VertexData {}, graph.graph);
+  auto attributes = files::AttributeMap {};
+  attributes.insert_or_assign(files::AttributeKey {0}, "archived"s);
+  attributes.insert_or_assign(files::AttributeKey {1}, "saved"s);
+
+  SECTION("Keys of another process") {
+    boost::add_edge(
+        graph.root,
+        boost::add_vertex(files::VertexData {files::NodeType::file, attributes},
+                          graph.graph),
+        files::EdgeData {graph.names.intern("photo.jpg")},
+        graph.graph);
+    auto loaded = archived.load();
+    REQUIRE(loaded);
+    auto photo = loaded->get_element(root / "photo.jpg");
+    REQUIRE(photo);
+    REQUIRE(std::get<std::string>(*photo->get_metadata("_SAVED_KEY_"))
+            == "saved");
+    REQUIRE(std::get<std::string>(*photo->get_metadata("_ARCHIVED_ONLY_KEY_"))
+            == "archived");
+  }
+
+  SECTION("Key ids that are not in the table") {
+    attributes.insert_or_assign(files::AttributeKey {2}, "missing"s);
+    boost::add_edge(
+        graph.root,
+        boost::add_vertex(files::VertexData {files::NodeType::file, attributes},
+                          graph.graph),
+        files::EdgeData {graph.names.intern("photo.jpg")},
+        graph.graph);
+    REQUIRE_FALSE(archived.load());
+  }
+}
+
+TEST_CASE("Checkpoints", "[files][checkpoint]") {
+  using namespace std::chrono_literals;
+  auto writes = std::atomic<int> {0};
+  const auto write = [&writes] { ++writes; };
+
+  SECTION("Stopping doesn't wait for the interval") {
+    const auto start = std::chrono::steady_clock::now();
+    {
+      auto checkpointer = files::Checkpointer {1h, write};
+      checkpointer.add_change();
+    }
+    REQUIRE(std::chrono::steady_clock::now() - start < 10s);
+    REQUIRE(writes == 0);
+  }
+
+  SECTION("Only changes are written") {
+    auto checkpointer = files::Checkpointer {10ms, write};
+    std::this_thread::sleep_for(50ms);
+    REQUIRE(writes == 0);
+
+    checkpointer.add_change();
+    const auto deadline = std::chrono::steady_clock::now() + 10s;
+    while (writes == 0 && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(5ms);
+    }
+    std::this_thread::sleep_for(50ms);
+    REQUIRE(writes == 1);
+  }
+
+  SECTION("Checkpoints can be disabled") {
+    auto checkpointer = files::Checkpointer {0ms, write};
+    checkpointer.add_change();
+    std::this_thread::sleep_for(50ms);
+    REQUIRE(writes == 0);
+  }
+}
+
+TEST_CASE("Compressed streams", "[files][stream]") {
+  auto data = std::string {};
+  for (auto index = 0; index < 1000; ++index) {
+    data += fmt::format("/photos/2024/IMG_{:04}.jpg;", index);
+  }
+
+  // Several blocks, the last one partial
+  constexpr auto block_size = std::size_t {1000};
+  auto stream = std::stringstream {};
+  REQUIRE(files::CompressedStream::write(data, stream, block_size));
+  REQUIRE(files::CompressedStream::is_compressed(stream));
+  REQUIRE(files::CompressedStream::read(stream) == data);
+
+  SECTION("Empty data") {
+    auto empty_stream = std::stringstream {};
+    REQUIRE(files::CompressedStream::write({}, empty_stream));
+    REQUIRE(files::CompressedStream::read(empty_stream) == std::string {});
+  }
+
+  SECTION("Truncated streams are rejected") {
+    const auto contents = stream.str();
+    auto truncated =
+        std::stringstream {contents.substr(0, contents.size() / 2)};
+    REQUIRE_FALSE(files::CompressedStream::read(truncated));
+
+    auto not_compressed = std::stringstream {"serialization::archive"};
+    REQUIRE_FALSE(files::CompressedStream::is_compressed(not_compressed));
+    REQUIRE_FALSE(files::CompressedStream::read(not_compressed));
+  }
+
+  SECTION("Headers that don't match their blocks are rejected") {
+    // The header has 16 bytes of identification, followed by the
+    // uncompressed size, the block size and the block count
+    constexpr auto block_count = std::uint64_t {1000};
+    constexpr auto large_block_size = std::uint64_t {1} << 26U;
+    const auto make_container = [&stream](std::uint64_t block_size,
+                                          std::uint64_t block_sizes,
+                                          const std::string& blocks)
+    {
+      auto ret = stream.str().substr(0, 16);
+      const auto append = [&ret](std::uint64_t value)
+      {
+        // NOLINTNEXTLINE(*-reinterpret-cast)
+        ret.append(reinterpret_cast<const char*>(&value), sizeof(value));
+      };
+      append(block_size * block_count);
+      append(block_size);
+      append(block_count);
+      for (auto block = std::uint64_t {0}; block < block_count; ++block) {
+        append(block_sizes);
+      }
+      for (auto block = std::uint64_t {0}; block < block_count; ++block) {
+        ret += blocks;
+      }
+      return std::stringstream {ret};
+    };
+
+    // Empty blocks
+    auto empty_blocks = make_container(large_block_size, 0, {});
+    REQUIRE_FALSE(files::CompressedStream::read(empty_blocks));
+
+    // Blocks that aren't frames of the expected size
+    auto not_frames =
+        make_container(large_block_size, 8, std::string(8, '\x28'));
+    REQUIRE_FALSE(files::CompressedStream::read(not_frames));
+    auto small_frames = std::stringstream {};
+    REQUIRE(files::CompressedStream::write("frame", small_frames));
+    const auto frame = small_frames.str().substr(40 + 8);
+    auto wrong_size = make_container(large_block_size, frame.size(), frame);
+    REQUIRE_FALSE(files::CompressedStream::read(wrong_size));
+  }
+}
+
+TEST_CASE("Content digests", "[files][digest]") {
+  constexpr auto digest = "06b05ab6733a618578af5f94892f3950";
+  const auto fingerprint =
+      files::FileFingerprint {.size = 3, .mtime_ns = -42, .inode = 7};
+  const auto attribute =
+      std::optional {files::ContentDigest::to_attribute(fingerprint, digest)};
+  REQUIRE(files::ContentDigest::from_attribute(attribute, fingerprint)
+          == digest);
+
+  // Moved files keep their digest
+  auto moved = fingerprint;
+  moved.inode = 8;
+  REQUIRE(files::ContentDigest::from_attribute(attribute, moved) == digest);
+
+  // Changed files don't
+  auto modified = fingerprint;
+  modified.mtime_ns = 42;
+  REQUIRE_FALSE(files::ContentDigest::from_attribute(attribute, modified));
+  auto resized = fingerprint;
+  resized.size = 4;
+  REQUIRE_FALSE(files::ContentDigest::from_attribute(attribute, resized));
+
+  // Digests stored without a fingerprint are ignored
+  REQUIRE_FALSE(files::ContentDigest::from_attribute(
+      files::PathAttribute {std::string {digest}}, fingerprint));
+  REQUIRE_FALSE(files::ContentDigest::from_attribute({}, fingerprint));
+}
+
 TEST_CASE("TempCurrentDir tests", "[files][helper]") {
   // Get current directories
   auto original_dir = fs::current_path();